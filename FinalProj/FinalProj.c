@@ -1,7 +1,6 @@
 #include <avr/io.h>
 #include <avr/interrupt.h>
 #include <stdlib.h>
-#include <stdio.h>
 #include <math.h>
 
 #include "io.h"
@@ -13,15 +12,28 @@
 #include "bluetooth.h"
 #include "ui.h"
 #include "sound.h"
+#include "telemetry.h"
+#include "capture.h"
+#include "lib/prof.h"
+#include "trace.h"
+#include "boot.h"
+#include "calib.h"
+#include "safety.h"
+#include "pose.h"
+#include "grid.h"
+#include "radar.h"
+#include "explore.h"
+#include "plan.h"
+#include "goal.h"
+#include "lib/trig.h"
 
 void ui_control(void);
-void autonomous(void);
+void autonomous(explore_strategy strategy);
 void evasive_action(int dist, char left_evasive);
+void win(const char* msg);
 int path_blocked_w_data(int target_dist, obj_t* objects, int count);
-int find_goal(obj_t* objects, int count, int* dist, int* final_angle);
 
 oi_t* sensor_data;
-const char WIDTH_THRESHOLD = 3;
 
 /// Main function
 /**
@@ -31,38 +43,37 @@ int main(void)
 {
 	int initialzed = 0;
 		
-	// Init hardware
+	// Init hardware.  The UART comes up first so the menu can be shown while boot_poll() brings up the rest.
+	clock_init();
+	prof_init();
 	init_UART();
-	lcd_init();
-	sensor_data = init_iRobot();
-	
-	lprintf("Welcome to\nBlastOffToMars.c!");
+	sensor_data = boot_start();
 	
     while(1)
 	{
 		menu_option user_choice = main_menu();
+		boot_finish();
 		if (user_choice == INIT){
-			send_msg("Welcome to IRobot Mars Robot interface\r\n");
-			send_msg("The servo and IR sensor are being initialized\r\n");
-			lprintf("The hardware has been initialized.");
-			//init hardware methods
-			init_servo();
-			init_ir();
+			send_msg_P(PSTR("Welcome to IRobot Mars Robot interface\r\n"));
+			send_msg_P(PSTR("The servo and IR sensor are being initialized\r\n"));
+			lprintf_P(PSTR("The hardware has been initialized."));
+			// The hardware was brought up by the boot sequencer
+			show_boot();
 			songs(MARIO);
 			initialzed = 1;
 		}
 		else if (user_choice==STANDBY){
-			send_msg("The robot has reached the retrieval zone\r\n");
+			send_msg_P(PSTR("The robot has reached the retrieval zone\r\n"));
 			songs(DARTHVADER);
-			lprintf("The robot has reached the retrieval zone");
+			lprintf_P(PSTR("The robot has reached the retrieval zone"));
 		}
 		else if (user_choice==ZONE_IDENTIFY){
-			send_msg("The robot has identified the retrieval zone\r\n");
-			lprintf("The robot has identified the retrieval zone");
+			send_msg_P(PSTR("The robot has identified the retrieval zone\r\n"));
+			lprintf_P(PSTR("The robot has identified the retrieval zone"));
 		}
 		else if (user_choice==MOVEMENT){
 			if (!initialzed) {
-				send_msg("Please initialize the robot first.\r\n");
+				send_msg_P(PSTR("Please initialize the robot first.\r\n"));
 			} else {
 				move_menu(sensor_data, 0);
 			}
@@ -71,17 +82,17 @@ int main(void)
 		}
 		else if (user_choice==SCAN){
 			if (!initialzed) {
-				send_msg("Please initialize the robot first.\r\n");
+				send_msg_P(PSTR("Please initialize the robot first.\r\n"));
 			} else {
-				lprintf("Scanning the area");
+				lprintf_P(PSTR("Scanning the area"));
 								
 				show_sensors(sensor_data);
-				send_msg("Scanning the area...\r\n");
+				send_msg_P(PSTR("Scanning the area...\r\n"));
 				show_objects();
 			}
 		} else if (user_choice == AUTO) {
 			// AUTO
-			autonomous();
+			autonomous(EXPLORE_STRAIGHT);
 		} else if (user_choice == PROGRAM_UI) {
 			ui_control();
 		}
@@ -91,117 +102,378 @@ int main(void)
 /// Hidden mode for GUI frontend interface
 /**
  * This is a hidden menu that is designed for our GUI frontend to communicate with.  It has simplified commands to reduce frontend parsing and USART transmission sizes.
+ * Moves, rotations, and scans run as cooperative tasks, so commands keep being parsed while the robot drives or scans.  A stop command is caught by the
+ * receive ISR and ends any motion and scan within one loop iteration.
  */
 void ui_control(void) {
 	in_program_ui = 1;
-	stop_reason reason;
+	move_t move;
+	rotate_t rotation;
+	char motion = 0;	// 0 when idle, otherwise the command that started the motion ('m' or 'r')
+	char scanning = 0;
+	char full_report = 0;
 	int result;
+	uint32_t latency;
 	char ignore_sensors;
-	char msg[80];
-	init_servo();
-	init_ir();
 	
 	char user_input[20];
 	while (1) {
-		ignore_sensors = 0;
-		read_line(user_input, 20);
-		switch (user_input[0]) {
-		case 'a':
-			autonomous();
-		case 'e':
-			// Send sensor data
-			show_sensors(sensor_data);
-			break;
-		case 'i':
-			// Move ignoring sensors
-			ignore_sensors = 1;
-		case 'm':
-			// Move
-			result = move_result(atoi(user_input + 2), sensor_data, ignore_sensors, ignore_sensors, &reason);
-			sprintf(msg, "m,%d,%s.", result, stop_reason_descrip[reason]);
-			send_msg(msg);
-			break;
-		case 'r':
-			// Rotate
-			result = rotate_deg(atoi(user_input + 2), sensor_data);
-			sprintf(msg, "r,%d.", result);
-			send_msg(msg);
-			break;
-		case 'c':
-			// Scan
-			show_objects();
-			break;
-		case  'o':
-			songs(DARTHVADER);
-			break;
+		if (stop_requested()) {
+			if (motion == 'm') {
+				move_cancel(&move);
+			} else if (motion == 'r') {
+				rotate_cancel(&rotation);
+			}
+			latency = stop_latency_us();
+			if (motion == 'm') {
+				send_fmt("m,%d,%S.", move.sum, stop_reason_descrip[move.reason]);
+			} else if (motion == 'r') {
+				send_fmt("r,%d.", rotation.degree);
+			}
+			motion = 0;
+			scanning = 0;
+			clear_stop();
+			trace(TRACE_STOP, 0, latency / 1000);
+			send_fmt("s,%lu.", (unsigned long) (latency / 1000));
+			// Post-mortem of what led up to the stop
+			trace_dump();
+		}
+
+		if (line_ready()) {
+			ignore_sensors = 0;
+			read_line(user_input, 20);
+			switch (user_input[0]) {
+			case 'a':
+				if (motion || scanning) {
+					send_msg_P(PSTR("b,a."));
+					break;
+				}
+				// "a f" explores with the frontier planner
+				autonomous(user_input[2] == 'f' ? EXPLORE_FRONTIER : EXPLORE_STRAIGHT);
+				break;
+			case 'e':
+				// Send sensor data.  This moves the servo and reads the OI, so it has to wait for the robot to be idle.
+				if (motion || scanning) {
+					send_msg_P(PSTR("b,e."));
+					break;
+				}
+				show_sensors(sensor_data);
+				break;
+			case 'i':
+				// Move ignoring sensors
+				ignore_sensors = 1;
+			case 'm':
+				// Move
+				if (motion) {
+					send_msg_P(PSTR("b,m."));
+					break;
+				}
+				move_init(&move, atoi(user_input + 2), ignore_sensors, ignore_sensors);
+				motion = 'm';
+				break;
+			case 'r':
+				// Rotate
+				if (motion) {
+					send_msg_P(PSTR("b,r."));
+					break;
+				}
+				rotate_init(&rotation, atoi(user_input + 2));
+				motion = 'r';
+				break;
+			case 'w':
+				// Move forward sweeping the IR over the lane ahead; needs the servo, so not while scanning
+				if (motion || scanning) {
+					send_msg_P(PSTR("b,w."));
+					break;
+				}
+				move_init(&move, atoi(user_input + 2), 0, 0);
+				move_radar(&move);
+				motion = 'm';
+				break;
+			case 'c':
+				// Scan
+				if (scanning || (motion == 'm' && move.radar)) {
+					send_msg_P(PSTR("b,c."));
+					break;
+				}
+				scan_init();
+				scanning = 1;
+				// "c f" reports every tracked object, not just the changes
+				full_report = user_input[2] == 'f';
+				break;
+			case 'q':
+				// Status
+				send_fmt("q,%d,%d.", motion == 'm' ? 1 : motion == 'r' ? 2 : 0, scanning);
+				break;
+			case  'o':
+				songs(DARTHVADER);
+				break;
+#if PROFILE
+			case 'f':
+				// Profiler dump, "f r" also clears the statistics
+				show_profile();
+				if (user_input[2] == 'r') {
+					prof_reset();
+				}
+				break;
+#endif
+			case 'u':
+				// SRAM usage
+				show_memory();
+				break;
+			case 'n':
+				// Boot timing
+				show_boot();
+				break;
+			case 'v':
+				// Speed governor statistics, "v r" also clears them
+				show_speed();
+				if (user_input[2] == 'r') {
+					speed_reset_stats();
+				}
+				break;
+			case 'x':
+				// Dead reckoned pose, "x r" makes the current position the origin
+				if (user_input[2] == 'r') {
+					pose_reset();
+				}
+				show_pose();
+				break;
+			case 'g':
+				// Occupancy grid, "g c" forgets it first
+				if (user_input[2] == 'c') {
+					grid_clear();
+				}
+				show_grid();
+				break;
+			case 'h':
+				// Goal hypotheses, "h c" forgets them first
+				if (user_input[2] == 'c') {
+					goal_clear();
+				}
+				show_goals();
+				break;
+			case 'z':
+				// Safety reflex statistics, "z r" also clears them
+				show_safety();
+				if (user_input[2] == 'r') {
+					safety_reset_stats();
+				}
+				break;
+			case 'k':
+				// Calibration, "k s" saves it to EEPROM with the learned cliff baselines, "k c" goes back to the defaults,
+				// "k a deg" measures the servo at deg (0, 45, 90, 135 or 180) against a target placed there,
+				// "k o" measures the rotation overshoot both ways and saves it
+				if (user_input[2] == 's') {
+					cliff_baselines(calib.cliff_baseline);
+					calib_save();
+				} else if (user_input[2] == 'c') {
+					calib_clear();
+				} else if (user_input[2] == 'a') {
+					if (motion || scanning) {
+						send_msg_P(PSTR("b,k."));
+						break;
+					}
+					int deg = atoi(user_input + 4);
+					int ocr = -1;
+					if (deg >= 0 && deg <= 180 && deg % SERVO_CAL_STEP == 0) {
+						ocr = servo_calibrate(deg / SERVO_CAL_STEP);
+					}
+					if (ocr >= 0) {
+						calib_servo_point(deg / SERVO_CAL_STEP, ocr);
+					}
+					send_fmt("k,a,%d,%d.", deg, ocr);
+				} else if (user_input[2] == 'o') {
+					if (motion || scanning) {
+						send_msg_P(PSTR("b,k."));
+						break;
+					}
+					int cw = rotate_overshoot(-ROTATE_CAL_DEG, sensor_data);
+					int ccw = rotate_overshoot(ROTATE_CAL_DEG, sensor_data);
+					// A turn cut short measures nothing; keep what was there
+					if (cw >= 0 && ccw >= 0 && cw < ROTATE_CAL_DEG / 2 && ccw < ROTATE_CAL_DEG / 2) {
+						calib.rotate_overshoot_cw = cw;
+						calib.rotate_overshoot_ccw = ccw;
+						calib_save();
+					}
+					send_fmt("k,o,%d,%d.", cw, ccw);
+				}
+				show_calib();
+				break;
+			case 'd':
+				// Trace dump, "d c" also clears the trace
+				trace_dump();
+				if (user_input[2] == 'c') {
+					trace_clear();
+				}
+				break;
+			case 't':
+				// Telemetry subscription, 0 to stop
+				result = atoi(user_input + 2);
+				if (result > 0) {
+					telemetry_start(result);
+				} else {
+					telemetry_stop();
+				}
+				send_fmt("t,%d.", result);
+				break;
+#if CAPTURE
+			case 'y':
+				// Capture for replay, "y 0" to stop
+				if (atoi(user_input + 2)) {
+					capture_start();
+				} else {
+					capture_stop();
+				}
+				send_fmt("y,%d.", capture_on);
+				break;
+#endif
+			}
+		}
+
+		if (motion == 'm' && move_task(&move, sensor_data) == TASK_DONE) {
+			send_fmt("m,%d,%S.", move.sum, stop_reason_descrip[move.reason]);
+			motion = 0;
+		} else if (motion == 'r' && rotate_task(&rotation, sensor_data) == TASK_DONE) {
+			send_fmt("r,%d.", rotation.degree);
+			motion = 0;
+		}
+		if (scanning && scan_task() == TASK_DONE) {
+			report_objects(full_report);
+			scanning = 0;
 		}
+		telemetry_poll();
+		sound_poll();
 	}
 }
 
 /// Autonomous mode
 /**
  * This is the autonomous loop.  The robot will search for the end goal endlessly until it thinks it finds the goal.
+ * @param strategy how to explore while the goal has not been found
  */
-void autonomous(void) {
+void autonomous(explore_strategy strategy) {
 	const int EXPLORE_DIST = 500;
+	// The IR watches the lane while driving, so legs can be longer without running into anything
+	const int RADAR_EXPLORE_DIST = 1000;
 	int count;
 	obj_t* objects;
 	int dist;
 	stop_reason reason;
 	int index;
 	int angle;
-	char msg[80];
 	char left_evasive;
 	
 	while (1) {
-		lprintf("Scanning area");
-		send_msg("Scanning area\r\n");
+		if (stop_requested()) {
+			// Hand control back to the program UI
+			return;
+		}
+		lprintf_P(PSTR("Scanning area"));
+		send_msg_P(PSTR("Scanning area\r\n"));
 		left_evasive = 1;
+		reason = NONE;
 		
 		objects = do_scan(&count);
-		if (find_goal(objects, count, &dist, &angle) != -1) {
+		goal_update(objects, count);
+		const goal_t* goal = goal_best(GOAL_CONFIDENT);
+		const goal_t* maybe_goal = goal_best(1);
+		if (goal != NULL) {
+			int goal_angle;
+			goal_aim(goal, &goal_angle, &dist, &angle);
+			send_fmt("Goal seen %u times, confidence %u: %d cm at %d deg\r\n", goal->sightings, goal->confidence, dist, goal_angle);
 			if ((index = path_blocked_w_data(EXPLORE_DIST, objects, count)) != -1) {
-				send_msg("Path blocked\r\n");
-				// Path is blocked
-				int offset_angle = side_side_side(10 + objects[index].width / 2, objects[index].dist);
-				sprintf(msg, "Path blocked in exploration, rotating %d to avoid object\r\n", offset_angle);
-				send_msg(msg);
-				rotate_deg(offset_angle, sensor_data);
+				send_msg_P(PSTR("Path blocked\r\n"));
+				// Path is blocked.  Plan a way around on this scan so the approach does not need another one.
+				waypoint_t path[PLAN_MAX_WAYPOINTS];
+				uint8_t n = plan_path(objects, count, goal_angle, dist, path);
+				if (n) {
+					// Where the direct approach would have ended up facing
+					int16_t final_heading = pose_get()->heading + goal_angle - 90 + angle;
+					trace(TRACE_PLAN, n, goal_angle);
+					send_fmt("Planned %u waypoints around object %d\r\n", n, index);
+					reason = plan_follow(path, n, sensor_data);
+					if (reason == COLOR) {
+						win(PSTR("WE WIN3!\r\n"));
+					}
+					if (reason == NONE) {
+						int16_t turn = wrap_deg(final_heading - pose_get()->heading);
+						rotate_deg(turn > 180 ? turn - 360 : turn, sensor_data);
+						dist = move_result(400, sensor_data, 0, 0, &reason);
+						if (reason == COLOR) {
+							win(PSTR("WE WIN4!\r\n"));
+						}
+						// Went through and it was not the goal
+						goal_reject(goal);
+					}
+				} else {
+					// No way around on the planning grid; turn away and look again
+					int offset_angle = side_side_side(10 + obj_width(&objects[index]) / 2, objects[index].dist);
+					trace(TRACE_PATH_BLOCKED, index, offset_angle);
+					send_fmt("Path blocked in exploration, rotating %d to avoid object\r\n", offset_angle);
+					rotate_deg(offset_angle, sensor_data);
+				}
 			} else {
 				// Found a small object
-				send_msg("Small objects found\r\n");
-				int offset_angle = find_goal(objects, count, &dist, &angle);
-				rotate_deg(offset_angle - 90, sensor_data);
-				dist = move_result(dist, sensor_data, 0, 0, &reason);
+				send_msg_P(PSTR("Small objects found\r\n"));
+				trace(TRACE_GOAL, goal_angle, dist);
+				rotate_deg(goal_angle - 90, sensor_data);
+				dist = move_result(dist * 10, sensor_data, 0, 0, &reason);
 				if (reason == COLOR) {
-					lprintf("WE WIN!");
-					send_msg("WE WIN1!\r\n");
-					songs(DARTHVADER);
-					while (1) {}
+					win(PSTR("WE WIN1!\r\n"));
 				}
 				rotate_deg(angle, sensor_data);
 				dist = move_result(400, sensor_data, 0, 0, &reason);
 				if (reason == COLOR) {
-					lprintf("WE WIN!");
-					send_msg("WE WIN2!\r\n");
-					songs(DARTHVADER);
-					while (1) {}
+					win(PSTR("WE WIN2!\r\n"));
+				}
+				if (reason == NONE) {
+					// Went through and it was not the goal
+					goal_reject(goal);
 				}
 			}
+		} else if (maybe_goal != NULL) {
+			// Something like the goal, but not seen enough yet.  Get closer and look again from there.
+			int goal_angle;
+			goal_aim(maybe_goal, &goal_angle, &dist, &angle);
+			send_fmt("Maybe a goal, confidence %u: %d cm at %d deg.  Getting closer\r\n", maybe_goal->confidence, dist, goal_angle);
+			rotate_deg(goal_angle - 90, sensor_data);
+			dist = move_ahead(dist * 10 / 2 < GOAL_CONFIRM_MM ? dist * 10 / 2 : GOAL_CONFIRM_MM, sensor_data, &reason);
+		} else if (strategy == EXPLORE_FRONTIER) {
+			// Did not find a small object.  Go where the map knows the least for the least travel
+			explore_plan_t plan;
+			if (!explore_plan(&plan)) {
+				// Everything in reach is known; start over in case the map has stale obstacles
+				send_msg_P(PSTR("Nothing left to explore, forgetting the map\r\n"));
+				grid_clear();
+				evasive_action(0, left_evasive);
+				continue;
+			}
+			trace(TRACE_EXPLORE, plan.cells > 255 ? 255 : plan.cells, plan.turn);
+			send_fmt("Exploring: turn %d, %d mm, %u unknown cells\r\n", plan.turn, plan.leg, plan.cells);
+			rotate_deg(plan.turn, sensor_data);
+			dist = move_ahead(plan.leg, sensor_data, &reason);
+			send_fmt("Reason: %S\r\n", stop_reason_descrip[reason]);
 		} else {
 			// Did not find a small object.  Explore
 			if ((index = path_blocked_w_data(EXPLORE_DIST, objects, count)) != -1) {
-				send_msg("Path blocked\r\n");
+				send_msg_P(PSTR("Path blocked\r\n"));
 				// Path is blocked
-				int offset_angle = side_side_side(10 + objects[index].width / 2, objects[index].dist);
-				sprintf(msg, "Path blocked in exploration, rotating %d to avoid object\r\n", offset_angle);
-				send_msg(msg);
+				int offset_angle = side_side_side(10 + obj_width(&objects[index]) / 2, objects[index].dist);
+				trace(TRACE_PATH_BLOCKED, index, offset_angle);
+				send_fmt("Path blocked in exploration, rotating %d to avoid object\r\n", offset_angle);
 				rotate_deg(offset_angle, sensor_data);
 			}
-			// Path is not blocked.  Continue
-			dist = move_result(EXPLORE_DIST, sensor_data, 0, 0, &reason);
-			sprintf(msg, "Reason: %s\r\n", stop_reason_descrip[reason]);
-			send_msg(msg);
+			// Path is not blocked.  Continue, stopping short of anything the scan missed or that is past its range, and of anything the
+			// map remembers from earlier scans
+			int leg = grid_free_length(pose_get()->heading, RADAR_CORRIDOR_MM, RADAR_EXPLORE_DIST) - RADAR_CLEARANCE_MM;
+			if (leg < EXPLORE_DIST / 2) {
+				send_fmt("Mapped obstacle %d mm ahead\r\n", leg + RADAR_CLEARANCE_MM);
+				evasive_action(0, left_evasive);
+				continue;
+			}
+			dist = move_ahead(leg, sensor_data, &reason);
+			send_fmt("Reason: %S\r\n", stop_reason_descrip[reason]);
 		}
 		static char rred = 0;
 		switch (reason) {
@@ -209,40 +481,40 @@ void autonomous(void) {
 			left_evasive = 0;
 		case BUMP_R:
 			// Evasive action
-			send_msg("That's an object.\r\n");
-			lprintf("Ouch!");
+			send_msg_P(PSTR("That's an object.\r\n"));
+			lprintf_P(PSTR("Ouch!"));
 			if (rred == 0) { songs(RICKROLLED); }
 			rred = 1;
+			// Low objects can be under the IR
+			explore_mark_edge();
 			evasive_action(200, left_evasive);
 			break;
 		case CLIFF_L:
 			left_evasive = 0;
 		case CLIFF_R:
 			// Evasive action
-			send_msg("That's a cliff.\r\n");
-			lprintf("That's a cliff");
+			send_msg_P(PSTR("That's a cliff.\r\n"));
+			lprintf_P(PSTR("That's a cliff"));
 			if (rred == 0) { songs(RICKROLLED); }
 			rred = 1;
+			explore_mark_edge();
 			evasive_action(500, left_evasive);
 			break;
 		case COLOR:
-			send_msg("Found an edge.\r\n");
+			send_msg_P(PSTR("Found an edge.\r\n"));
 			char obj_in_range = 0;
 			objects = do_scan(&count);
 			for (int i = 0; i < count; i++) {
-				if (objects[i].dist < 50 && objects[i].angular_location < 90) {
+				if (objects[i].dist < 50 && obj_angle(&objects[i]) < 90) {
 					obj_in_range = 1;
 				}
-				if (obj_in_range && objects[i].dist < 50 && objects[i].angular_location > 90) {
-					lprintf("WE WIN!");
-					send_msg("WE WIN\r\n");
-					move_result(150, sensor_data, 0, 1, &reason);
-					songs(DARTHVADER);
-					while (1) {}
+				if (obj_in_range && objects[i].dist < 50 && obj_angle(&objects[i]) > 90) {
+					win(PSTR("WE WIN\r\n"));
 				}
 			}
-			lprintf("I don't want to go there");
-			if (rand() % 1) {
+			lprintf_P(PSTR("I don't want to go there"));
+			explore_mark_edge();
+			if (rand() % 2) {
 				rotate_deg(100, sensor_data);
 			} else {
 				rotate_deg(-100, sensor_data);
@@ -253,35 +525,18 @@ void autonomous(void) {
 	}
 }
 
-/// Searches the surrounding area for objects that look like the goal
+/// Ends autonomous mode at the goal
 /**
- * This function searches the surrounding area for small objects that appear to be about 60 cm apart.
- * @param objects the list of objects from a scan (so we don't need to repeat the scan)
- * @param count the number of objects in the objects array
- * @param dist (return) the estimated distance between the robot and the goal posts
- * @param final_angle (return) the angle to rotate the robot to face the final goal after moving toward it
- * @return the angle to the center of the goal posts, or -1 if the goals are not found
+ * Called with the robot stopped and backed up from the tape between the posts.  Drives over the tape into the retrieval zone, ignoring color,
+ * and plays the victory song forever.
+ * @param msg the message to send, in program memory
  */
-int find_goal(obj_t* objects, int count, int* dist, int* final_angle) {
-	char msg[80];
-	for (int i = 0; i < count; i++) {
-		if (objects[i].width < WIDTH_THRESHOLD) {
-			for (int j = i + 1; j < count; j++) {
-				if (objects[j].width < WIDTH_THRESHOLD) {
-					int angle = objects[j].angular_location - objects[i].angular_location;
-					int separation = side_angle_side2(angle, objects[j].dist, objects[i].dist);
-					if (separation > 40 && separation < 80) {
-						sprintf(msg, "Separation between two small objects: %d (%d - %d) center %d\r\n", separation, objects[j].angular_location, objects[i].angular_location, objects[i].angular_location + angle / 2);
-						send_msg(msg);
-						*final_angle = sin((objects[i].dist - objects[j].dist) / (double) separation);
-						*dist = (objects[i].dist + objects[j].dist) / 2;
-						return objects[i].angular_location + angle / 2;
-					}
-				}
-			}
-		}
-	}
-	return -1;
+void win(const char* msg) {
+	lprintf_P(PSTR("WE WIN!"));
+	send_msg_P(msg);
+	move_result(150, sensor_data, 0, 1, NULL);
+	songs(DARTHVADER);
+	while (1) { sound_poll(); }
 }
 
 /// Rotates to avoid an object
@@ -290,10 +545,10 @@ int find_goal(obj_t* objects, int count, int* dist, int* final_angle) {
  */
 void evasive_action(int dist, char left_evasive) {
 	if (left_evasive) {
-		send_msg("Evasive action, to the left\r\n");
+		send_msg_P(PSTR("Evasive action, to the left\r\n"));
 		rotate_deg(90, sensor_data);
 	} else {
-		send_msg("Evasive action, to the left\r\n");
+		send_msg_P(PSTR("Evasive action, to the left\r\n"));
 		rotate_deg(-90, sensor_data);
 	}
 }
@@ -301,13 +556,11 @@ void evasive_action(int dist, char left_evasive) {
 int path_blocked_w_data(int target_dist, obj_t* objects, int count) {
 	int dist;
 	int horiz_dist;
-	char msg[80];
 	for (int i = 0; i < count; i++) {
-		dist = objects[i].dist * sin(objects[i].angular_location / 180.0 * M_PI);
-		horiz_dist = objects[i].dist * cos(objects[i].angular_location / 180.0 * M_PI);
+		dist = objects[i].dist * sin(obj_angle(&objects[i]) / 180.0 * M_PI);
+		horiz_dist = objects[i].dist * cos(obj_angle(&objects[i]) / 180.0 * M_PI);
 		if (abs(horiz_dist) < 10 && abs(dist) < target_dist) {
-			sprintf(msg, "Path blocked at %d deg, %d dist.  %d to the right, %d ahead.\r\n", objects[i].angular_location, objects[i].dist, horiz_dist, dist);
-			send_msg(msg);
+			send_fmt("Path blocked at %d deg, %d dist.  %d to the right, %d ahead.\r\n", obj_angle(&objects[i]), objects[i].dist, horiz_dist, dist);
 			return i;
 		}
 	}
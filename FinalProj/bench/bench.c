@@ -0,0 +1,231 @@
+/**
+ * bench.c: cycle counts of the firmware's hot paths
+ *
+ * Built for the ATmega128 together with the firmware and run under simavr by runner.c.  Each benchmark calls one function over a fixed set of
+ * representative inputs and times every call with the profiler's cycle counter (timer 1 at the CPU clock), less the cost of reading the counter.
+ * Results go out USART0 as "cycles,<name>,<calls>,<min>,<avg>,<max>" lines followed by "done".
+ *
+ * Interrupts stay on as they are on the robot, so the 1 ms tick lands in some calls: min is the steady cost, max includes the tick.  The output
+ * ring is drained before every call so no call waits on the UART.
+ */
+
+#include <stdint.h>
+#include <avr/interrupt.h>
+#include <avr/pgmspace.h>
+#include <avr/sleep.h>
+#include "../lib/prof.h"
+#include "../lib/util.h"
+#include "../lib/lcd.h"
+#include "../lib/open_interface.h"
+#include "../bluetooth.h"
+#include "../calib.h"
+#include "../goal.h"
+#include "../io.h"
+#include "../movement.h"
+#include "../plan.h"
+#include "../pose.h"
+#include "../scan.h"
+
+int ir_ADC_to_cm(int reading);
+int path_blocked_w_data(int target_dist, obj_t* objects, int count);
+
+/// Statistics of one benchmark, in cycles
+typedef struct {
+	uint16_t calls;
+	uint32_t min;
+	uint32_t max;
+	uint32_t total;
+} bench_t;
+
+// Keeps results alive so calls are not optimized away
+volatile int32_t sink;
+
+static uint32_t overhead;
+static bench_t b;
+
+// A scan with nothing straight ahead, and the same with an object in the lane last
+static obj_t scan_clear[] = {
+	{20, 28, 38, 40, 43, 9, 6 << OBJ_WIDTH_SHIFT},
+	{41, 44, 52, 53, 55, 4, 3 << OBJ_WIDTH_SHIFT},
+	{60, 75, 30, 33, 36, 16, 9 << OBJ_WIDTH_SHIFT},
+	{118, 121, 45, 46, 48, 4, 2 << OBJ_WIDTH_SHIFT},
+	{135, 150, 25, 27, 29, 16, 7 << OBJ_WIDTH_SHIFT},
+	{166, 174, 55, 57, 58, 9, 8 << OBJ_WIDTH_SHIFT},
+};
+static obj_t scan_blocked[] = {
+	{20, 28, 38, 40, 43, 9, 6 << OBJ_WIDTH_SHIFT},
+	{41, 44, 52, 53, 55, 4, 3 << OBJ_WIDTH_SHIFT},
+	{118, 121, 45, 46, 48, 4, 2 << OBJ_WIDTH_SHIFT},
+	{135, 150, 25, 27, 29, 16, 7 << OBJ_WIDTH_SHIFT},
+	{166, 174, 55, 57, 58, 9, 8 << OBJ_WIDTH_SHIFT},
+	{86, 95, 30, 31, 33, 10, 5 << OBJ_WIDTH_SHIFT},
+};
+// Two goal posts 60 cm apart among wider objects
+static obj_t scan_goal[] = {
+	{30, 38, 50, 52, 55, 9, 7 << OBJ_WIDTH_SHIFT},
+	{58, 60, 44, 45, 46, 3, 2 << OBJ_WIDTH_SHIFT},
+	{75, 88, 35, 37, 40, 14, 8 << OBJ_WIDTH_SHIFT},
+	{126, 128, 44, 45, 47, 3, 2 << OBJ_WIDTH_SHIFT},
+	{150, 165, 28, 29, 31, 16, 8 << OBJ_WIDTH_SHIFT},
+};
+
+// A group 6 response: the robot driving slowly forward on the floor
+static const uint8_t group6[52] PROGMEM = {
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,	// 7 - 14
+	0x00, 0x00, 0xFF, 0x00, 0x00, 0x0C, 0xFF, 0xFE,		// 15 - 20: 12 mm, -2 degrees
+	0x00, 0x3E, 0x80, 0xFE, 0xD4, 0x19, 0x09, 0xC4,		// 21 - 25
+	0x0A, 0x8C, 0x00, 0x00, 0x01, 0xF4, 0x01, 0xEA,		// 26 - 29
+	0x01, 0xF9, 0x01, 0xF0, 0x00, 0x00, 0x00, 0x00,		// 30 - 34
+	0x03, 0x00, 0x00, 0x00, 0x00, 0xC8, 0x7F, 0xFF,		// 35 - 40
+	0x00, 0xC8, 0x00, 0xC8							// 41, 42
+};
+
+static void drain(void);
+static void begin(void);
+static void record(uint32_t cycles);
+static void report(const char* name);
+static int16_t noise(void);
+
+#define MEASURE(...) do { \
+		drain(); \
+		uint32_t start = prof_cycles(); \
+		__VA_ARGS__; \
+		record(prof_cycles() - start); \
+	} while (0)
+
+int main(void) {
+	clock_init();
+	prof_init();
+	init_UART();
+	lcd_init();
+	calib_load();
+
+	// The cost of reading the counter twice
+	overhead = UINT32_MAX;
+	for (uint8_t i = 0; i < 16; i++) {
+		uint32_t start = prof_cycles();
+		uint32_t cycles = prof_cycles() - start;
+		overhead = cycles < overhead ? cycles : overhead;
+	}
+
+	begin();
+	for (int adc = 100; adc <= 900; adc += 8) {
+		MEASURE(sink = ir_ADC_to_cm(adc));
+	}
+	report(PSTR("ir_ADC_to_cm"));
+
+	begin();
+	for (int angle = 0; angle <= 180; angle += 2) {
+		MEASURE(sink = side_angle_side2(angle, 40, 55));
+	}
+	report(PSTR("side_angle_side2"));
+
+	begin();
+	for (int dist = 300; dist <= 1000; dist += 50) {
+		MEASURE(sink = path_blocked_w_data(dist, scan_clear, sizeof(scan_clear) / sizeof(obj_t)));
+	}
+	report(PSTR("path_blocked_clear"));
+
+	// Includes formatting the "Path blocked" message into the output ring
+	begin();
+	for (int dist = 400; dist <= 1000; dist += 50) {
+		MEASURE(sink = path_blocked_w_data(dist, scan_blocked, sizeof(scan_blocked) / sizeof(obj_t)));
+	}
+	report(PSTR("path_blocked_hit"));
+
+	// A first sighting each time, then the same pair seen again and again
+	begin();
+	for (uint8_t i = 0; i < 16; i++) {
+		goal_clear();
+		pose_reset();
+		MEASURE(goal_update(scan_goal, sizeof(scan_goal) / sizeof(obj_t)));
+	}
+	report(PSTR("goal_update_new"));
+	begin();
+	for (uint8_t i = 0; i < 16; i++) {
+		MEASURE(goal_update(scan_goal, sizeof(scan_goal) / sizeof(obj_t)));
+	}
+	report(PSTR("goal_update_seen"));
+
+	// A goal 80 cm out at angles around the object in the lane, so most plans bend around it
+	begin();
+	for (int angle = 40; angle <= 140; angle += 10) {
+		static waypoint_t path[PLAN_MAX_WAYPOINTS];
+		pose_reset();
+		MEASURE(sink = plan_path(scan_blocked, sizeof(scan_blocked) / sizeof(obj_t), angle, 80, path));
+	}
+	report(PSTR("plan_path"));
+
+	// The decoding half of oi_update(), without the UART
+	begin();
+	for (uint8_t i = 0; i < 16; i++) {
+		static oi_t sensors;
+		oi_decoder_t decoder;
+		uint8_t j = 0;
+		MEASURE(
+			oi_decode_group(&decoder, OI_SENSOR_PACKET_GROUP6);
+			while (!oi_decode_byte(&decoder, &sensors, pgm_read_byte(&group6[j++])))
+				;
+		);
+		sink = sensors.distance;
+	}
+	report(PSTR("oi_decode_group6"));
+
+	// Floor readings with a little noise; every change of the averages redraws the LCD
+	begin();
+	for (uint8_t i = 0; i < 32; i++) {
+		static oi_t sensors;
+		sensors.cliff_left_signal = 500 + noise();
+		sensors.cliff_frontleft_signal = 480 + noise();
+		sensors.cliff_frontright_signal = 510 + noise();
+		sensors.cliff_right_signal = 495 + noise();
+		MEASURE(sink = check_cliff_signals(&sensors));
+	}
+	report(PSTR("check_cliff_signals"));
+
+	send_msg_P(PSTR("done\r\n"));
+	drain();
+	// simavr ends the run when the CPU sleeps with interrupts off
+	cli();
+	set_sleep_mode(SLEEP_MODE_PWR_DOWN);
+	sleep_enable();
+	sleep_cpu();
+	return 0;
+}
+
+/// Waits until the output ring is empty
+static void drain(void) {
+	while (out_buffer_free() < OUT_BUFFER_SIZE - 1)
+		;
+}
+
+static void begin(void) {
+	b.calls = 0;
+	b.min = UINT32_MAX;
+	b.max = 0;
+	b.total = 0;
+}
+
+static void record(uint32_t cycles) {
+	cycles -= overhead;
+	b.calls++;
+	b.min = cycles < b.min ? cycles : b.min;
+	b.max = cycles > b.max ? cycles : b.max;
+	b.total += cycles;
+}
+
+/// Sends the statistics of the benchmark that just ran
+/**
+ * @param name the benchmark's name, in program memory
+ */
+static void report(const char* name) {
+	drain();
+	send_fmt("cycles,%S,%u,%lu,%lu,%lu\r\n", name, b.calls, (unsigned long) b.min, (unsigned long) (b.total / b.calls), (unsigned long) b.max);
+}
+
+/// -8 to 7 from a fixed sequence, the same on every run
+static int16_t noise(void) {
+	static uint16_t state = 1;
+	state = state * 25173 + 13849;
+	return (int16_t) (state >> 12) - 8;
+}
@@ -0,0 +1,53 @@
+#!/bin/sh
+# Measures the benchmarks and the footprint into results.csv and compares them with baseline.csv.
+#   cycles,<name>,<calls>,<min>,<avg>,<max>	from bench.elf under simavr
+#   flash,<name>,<bytes>					the whole firmware (.text + .data) and each benchmarked function
+#   sram,firmware,<bytes>					.data + .bss
+# A figure more than THRESHOLD percent (default 1) above the baseline is a regression and makes the script fail.  Cycles compare the minimum,
+# which the 1 ms tick does not disturb.  Without a baseline.csv the script fails too, so a tree without one never passes unmeasured;
+#   ./bench.sh baseline
+# measures and stores the results as baseline.csv instead of comparing.
+
+cd "$(dirname "$0")"
+THRESHOLD=${THRESHOLD:-1}
+FUNCTIONS="ir_ADC_to_cm side_angle_side2 path_blocked_w_data goal_update plan_path oi_decode_byte check_cliff_signals"
+
+{
+	./runner bench.elf || exit 1
+	avr-size -A firmware.elf | awk '
+		$1 == ".text" || $1 == ".data" { flash += $2 }
+		$1 == ".data" || $1 == ".bss" { sram += $2 }
+		END { printf "flash,firmware,%d\nsram,firmware,%d\n", flash, sram }'
+	for f in $FUNCTIONS; do
+		avr-nm -S -t d firmware.elf | awk -v f=$f '$4 == f { printf "flash,%s,%d\n", f, $2 }'
+	done
+} > results.csv || exit 1
+
+if [ "$1" = baseline ]; then
+	cp results.csv baseline.csv
+	cat baseline.csv
+	exit 0
+fi
+if [ ! -f baseline.csv ]; then
+	cat results.csv
+	echo "no baseline.csv to compare with; run make baseline and commit it" >&2
+	exit 1
+fi
+
+awk -F, -v threshold=$THRESHOLD '
+	# The figure compared: the minimum for cycles, the size otherwise
+	function figure(kind) { return kind == "cycles" ? $4 : $3 }
+	NR == FNR { base[$1 "," $2] = figure($1); next }
+	{
+		key = $1 "," $2
+		now = figure($1)
+		if (!(key in base)) {
+			printf "%-32s %10s %10d  new\n", key, "-", now
+			next
+		}
+		change = base[key] ? (now - base[key]) * 100 / base[key] : 0
+		flag = change > threshold ? "  REGRESSION" : change < -threshold ? "  better" : ""
+		regressions += change > threshold
+		printf "%-32s %10d %10d %+7.1f%%%s\n", key, base[key], now, change, flag
+	}
+	END { exit regressions > 0 }' baseline.csv results.csv
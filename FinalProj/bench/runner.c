@@ -0,0 +1,84 @@
+/**
+ * runner.c: runs bench.elf on simavr's ATmega128 and passes its results on
+ *
+ *   runner bench.elf
+ *
+ * USART0 output is collected line by line; "cycles," lines are printed, and the run ends at "done", when the CPU sleeps with interrupts off, or
+ * after RUN_LIMIT_S simulated seconds.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <simavr/sim_avr.h>
+#include <simavr/sim_elf.h>
+#include <simavr/sim_irq.h>
+#include <simavr/avr_uart.h>
+
+#define FREQUENCY 16000000
+// Longest run before giving up, simulated seconds
+#define RUN_LIMIT_S 60
+
+static char line[128];
+static int line_len = 0;
+static int done = 0;
+
+/// A byte out of USART0
+static void uart_out(struct avr_irq_t* irq, uint32_t value, void* param) {
+	(void) irq;
+	(void) param;
+	if (value == '\r') {
+		return;
+	}
+	if (value != '\n') {
+		if (line_len < (int) sizeof(line) - 1) {
+			line[line_len++] = value;
+		}
+		return;
+	}
+	line[line_len] = '\0';
+	line_len = 0;
+	if (!strncmp(line, "cycles,", 7)) {
+		puts(line);
+	} else if (!strcmp(line, "done")) {
+		done = 1;
+	}
+}
+
+int main(int argc, char** argv) {
+	if (argc != 2) {
+		fprintf(stderr, "usage: %s bench.elf\n", argv[0]);
+		return 2;
+	}
+	elf_firmware_t firmware;
+	memset(&firmware, 0, sizeof(firmware));
+	if (elf_read_firmware(argv[1], &firmware)) {
+		fprintf(stderr, "%s: cannot read\n", argv[1]);
+		return 2;
+	}
+	avr_t* avr = avr_make_mcu_by_name("atmega128");
+	if (!avr) {
+		fprintf(stderr, "simavr has no atmega128\n");
+		return 2;
+	}
+	avr_init(avr);
+	firmware.frequency = FREQUENCY;
+	avr_load_firmware(avr, &firmware);
+
+	// Take the UART output here instead of simavr echoing it
+	uint32_t flags = 0;
+	avr_ioctl(avr, AVR_IOCTL_UART_GET_FLAGS('0'), &flags);
+	flags &= ~AVR_UART_FLAG_STDIO;
+	avr_ioctl(avr, AVR_IOCTL_UART_SET_FLAGS('0'), &flags);
+	avr_irq_register_notify(avr_io_getirq(avr, AVR_IOCTL_UART_GETIRQ('0'), UART_IRQ_OUTPUT), uart_out, NULL);
+
+	int state = cpu_Running;
+	while (!done && state != cpu_Done && state != cpu_Crashed && avr->cycle < (avr_cycle_count_t) RUN_LIMIT_S * FREQUENCY) {
+		state = avr_run(avr);
+	}
+	if (!done) {
+		fprintf(stderr, "%s: the benchmarks did not finish (%s after %.1f s)\n", argv[1],
+			state == cpu_Crashed ? "crashed" : state == cpu_Done ? "stopped" : "still running", (double) avr->cycle / FREQUENCY);
+		return 1;
+	}
+	return 0;
+}
@@ -5,41 +5,149 @@
  *  Author: jmay
  */ 
 
-#include <avr/interrupt.h>
+#include <util/atomic.h>
+#include <avr/pgmspace.h>
 #include <string.h>
 #include "bluetooth.h"
 #include "ui.h"
+#include "lib/util.h"
+#include "lib/hal.h"
+#include "capture.h"
 
 int in_buffer_len(void);
+static char out_put(char c);
 
-#define OUT_BUFFER_SIZE 100
+#define OUT_BUFFER_MASK (OUT_BUFFER_SIZE - 1)
 static char out_buffer[OUT_BUFFER_SIZE];
-static char* out_ptr = out_buffer;
-static volatile int out_buffer_empty = 1;
+static volatile uint8_t out_head = 0;
+static volatile uint8_t out_tail = 0;
+static uint8_t out_peak = 0;
 
-#define IN_BUFFER_SIZE 10
 static char in_buffer[IN_BUFFER_SIZE];
 static char* in_ptr = in_buffer;
 static volatile int in_buffer_ready = 0;
 
+static volatile char stop_flag = 0;
+static volatile uint32_t stop_stamp;
+// Where the line being received stands against the stop line: 0 at its start, 1 after a lone s, 2 anything else
+static uint8_t stop_match = 0;
+
 /// Puts a message in the UART sending buffer
 /**
- * Queues a message for sending through UART.  If the buffer is full, it blocks until the buffer is empty.  It is limited at OUT_BUFFER_SIZE and will truncate any larger chunks.
+ * Queues a message for sending through UART.  The message is copied into the OUT_BUFFER_SIZE ring one character at a time.  If the ring is full, it blocks until the
+ * UDRE interrupt has drained enough room for the rest of the message, so messages of any length are sent whole.
+ * Must not be called from an ISR; use try_send_msg() there.
  * @param msg the message string to send
  */
 void send_msg(char* msg) {
-	// Wait for a previous message to exit the buffer.
-	while (!out_buffer_empty)
-		;
-	// Fill the output buffer
-	out_buffer_empty = 0;
-	strncpy(out_buffer, msg, OUT_BUFFER_SIZE - 1);
-	out_ptr = out_buffer;
-	// Wait for output register to be empty
-	while ((UCSR0A & _BV(UDRE)) == 0)
-		;
-	// Send first character to start the interrupt handling of the rest of the string
-	UDR0 = *(out_ptr++);
+	while (*msg) {
+		send_char(*(msg++));
+	}
+}
+
+/// Puts a message from program memory in the UART sending buffer
+/**
+ * Same as send_msg() but streams the characters straight out of flash, so constant text never takes up SRAM.  Use with PSTR("...").
+ * @param msg the message string to send, in program memory
+ */
+void send_msg_P(const char* msg) {
+	char c;
+	while ((c = pgm_read_byte(msg++))) {
+		send_char(c);
+	}
+}
+
+/// Puts one character in the UART sending buffer
+/**
+ * Blocks until there is room in the ring.  This is the sink used by send_fmt().
+ * @param c the character to send
+ */
+void send_char(char c) {
+	// Spin with interrupts enabled so the UDRE interrupt can make room
+	while (!out_put(c))
+		hal_idle();
+}
+
+/// Puts a message in the UART sending buffer only if it fits right now
+/**
+ * Queues the whole message if the ring has room for all of it, otherwise queues nothing.  Never blocks, so it is safe to call from an ISR or from code
+ * that would rather drop a message than stall on a saturated link.
+ * @param msg the message string to send
+ * @return 1 if the message was queued, 0 if it was dropped
+ */
+char try_send_msg(char* msg) {
+	char queued = 0;
+	int len = strlen(msg);
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		if (len <= out_buffer_free()) {
+			while (*msg) {
+				out_put(*(msg++));
+			}
+			queued = 1;
+		}
+	}
+	return queued;
+}
+
+/// Puts raw bytes in the UART sending buffer only if they all fit right now
+/**
+ * Same as try_send_msg() for binary data, which may contain zeros.
+ * @param data the bytes to send
+ * @param len how many
+ * @return 1 if the bytes were queued, 0 if they were dropped
+ */
+char try_send_bytes(const uint8_t* data, uint8_t len) {
+	char queued = 0;
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		if (len <= out_buffer_free()) {
+			while (len--) {
+				out_put(*(data++));
+			}
+			queued = 1;
+		}
+	}
+	return queued;
+}
+
+/// The free space in the UART sending buffer
+/**
+ * The number of characters that can be queued without blocking.
+ * @return the number of free characters in the output ring
+ */
+int out_buffer_free(void) {
+	return OUT_BUFFER_MASK - ((uint8_t) (out_head - out_tail) & OUT_BUFFER_MASK);
+}
+
+/// The most characters that have been waiting in the output ring at once
+/**
+ * @return the high-water mark of the output ring
+ */
+int out_buffer_peak(void) {
+	return out_peak;
+}
+
+/// Adds one character to the output ring
+/**
+ * Stores the character and enables the UDRE interrupt to send it.  The head is updated with interrupts disabled because both the main loop and the
+ * receive ISR (echo and bell) queue characters.
+ * @param c the character to queue
+ * @return 1 if the character was queued, 0 if the ring is full
+ */
+static char out_put(char c) {
+	char queued = 0;
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		uint8_t next = (out_head + 1) & OUT_BUFFER_MASK;
+		if (next != out_tail) {
+			out_buffer[out_head] = c;
+			out_head = next;
+			if ((uint8_t) ((next - out_tail) & OUT_BUFFER_MASK) > out_peak) {
+				out_peak = (next - out_tail) & OUT_BUFFER_MASK;
+			}
+			hal_bt_tx_start();
+			queued = 1;
+		}
+	}
+	return queued;
 }
 
 /// Reads a line or full buffer from UART
@@ -51,7 +159,7 @@ void send_msg(char* msg) {
  */
 int read_line(char* msg, int max_len) {
 	while (!in_buffer_ready) 
-		;
+		hal_idle();
 	int len = max_len < IN_BUFFER_SIZE - 1 ? max_len : IN_BUFFER_SIZE;
 	strncpy(msg, in_buffer, len);
 	// Restore a possible missing null character that strncpy did not place.
@@ -63,6 +171,40 @@ int read_line(char* msg, int max_len) {
 	return len;
 }
 
+/// Checks if a line is waiting to be read
+/**
+ * Lets callers do other work instead of blocking in read_line().
+ * @return 1 if read_line() would return immediately, 0 otherwise
+ */
+char line_ready(void) {
+	// Callers poll this when they have nothing else to do
+	hal_idle();
+	return in_buffer_ready;
+}
+
+/// Checks if the program UI has asked the robot to stop
+/**
+ * The stop command is caught by the receive ISR, so the flag is set even while the main loop is busy.  Long running actions poll this and end early.
+ * @return 1 if a stop is pending, 0 otherwise
+ */
+char stop_requested(void) {
+	return stop_flag;
+}
+
+/// Time since the stop command arrived
+/**
+ * Only meaningful while a stop is pending.
+ * @return the number of us since the stop command was received
+ */
+uint32_t stop_latency_us(void) {
+	return micros() - stop_stamp;
+}
+
+/// Acknowledges a stop request
+void clear_stop(void) {
+	stop_flag = 0;
+}
+
 /// The size of the current data in the buffer
 /**
  * The size of the data currently in the input buffer.
@@ -74,14 +216,32 @@ int in_buffer_len(void) {
 
 /// The ISR on USAR received data
 /**
- * Reads the available character from USART and stores it into the input buffer if possible.  The character is echoed back to the user if the value is stored in the buffer.
+ * Stores the character from USART into the input buffer if possible.  The character is echoed back to the user if the value is stored in the buffer.
  * If the buffer is full, a bell character is sent back to the user to alert them that their input was rejected.  If the user enters a backspace, the previous character is deleted from the input buffer.
+ * A line of just "s" in the program UI sets the stop flag instead, whether or not the buffer is free.
+ * @param user_input the received character
  */
-ISR (USART0_RX_vect) {
-	char user_input = UDR0;
+void bt_rx_isr(uint8_t user_input) {
+	capture_byte(CAPTURE_BT_RX, user_input);
+	// Stop is handled here, even while an earlier line is still waiting to be read, so it is never queued behind a long running command
+	if (user_input == '\r') {
+		char is_stop = stop_match == 1;
+		stop_match = 0;
+		if (in_program_ui && is_stop) {
+			stop_stamp = micros();
+			stop_flag = 1;
+			if (!in_buffer_ready) {
+				// Drop the s, which is not a command
+				in_ptr = in_buffer;
+			}
+			return;
+		}
+	} else {
+		stop_match = stop_match == 0 && user_input == 's' ? 1 : 2;
+	}
 	if (in_buffer_ready) {
 		// Tell the user that the buffer is full with a bell
-		send_msg("\a");
+		out_put('\a');
 	} else {
 		if (user_input == '\r') {
 			// Replace \n with \0 to terminate the string.
@@ -91,7 +251,7 @@ ISR (USART0_RX_vect) {
 			return;
 		}
 		// Echo the user's input back to the console
-		UDR0 = user_input;
+		out_put(user_input);
 		// Avoid overflowing the in_buffer
 		if (in_buffer_len() < IN_BUFFER_SIZE - 1) {
 			if (user_input == 127) {
@@ -101,7 +261,7 @@ ISR (USART0_RX_vect) {
 					in_ptr--;
 				} else {
 					// The cursor is at the start of the buffer, backspace is not allowed
-					send_msg("\a");
+					out_put('\a');
 				}
 			} else {
 				*(in_ptr++) = user_input;				
@@ -113,16 +273,16 @@ ISR (USART0_RX_vect) {
 	}
 }
 
-/// UART sending interrupt
+/// UART data register empty interrupt
 /**
- * Sends one byte of the output buffer until the buffer is empty.  When the buffer is empty, the buffer empty flag is set.
+ * Takes the next byte of the output ring.  When the ring is empty, the interrupt disables itself until out_put() queues more data.
+ * @return the byte to send, or -1 if the ring is empty
  */
-ISR (USART0_TX_vect) {
-	if (!out_buffer_empty) {
-		if (*out_ptr != '\0') {
-			UDR0 = *(out_ptr++);
-		} else {
-			out_buffer_empty = 1;
-		}
+int16_t bt_tx_isr(void) {
+	if (out_tail == out_head) {
+		return -1;
 	}
+	uint8_t value = out_buffer[out_tail];
+	out_tail = (out_tail + 1) & OUT_BUFFER_MASK;
+	return value;
 }
\ No newline at end of file
@@ -9,9 +9,32 @@
 #ifndef BLUETOOTH_H_
 #define BLUETOOTH_H_
 
+#include <stdint.h>
+#include "lib/fmt.h"
 
+
+// Size of the output ring; must be a power of two so the ring indexes can wrap with a mask
+#define OUT_BUFFER_SIZE 128
+#define IN_BUFFER_SIZE 10
+
+/// Formats a message straight into the UART sending buffer
+/**
+ * Takes a literal printf style format (see lib/fmt.h), which is kept in program memory.  Blocks like send_msg() when the ring is full.
+ */
+#define send_fmt(format, ...) fmt_P(send_char, PSTR(format), ##__VA_ARGS__)
+
+void send_char(char c);
 void send_msg(char* msg);
+void send_msg_P(const char* msg);
+char try_send_msg(char* msg);
+char try_send_bytes(const uint8_t* data, uint8_t len);
+int out_buffer_free(void);
+int out_buffer_peak(void);
 int read_line(char* msg, int max_len);
+char line_ready(void);
+char stop_requested(void);
+uint32_t stop_latency_us(void);
+void clear_stop(void);
 
 
 #endif /* BLUETOOTH_H_ */
\ No newline at end of file
@@ -0,0 +1,119 @@
+#include <avr/pgmspace.h>
+#include "boot.h"
+#include "io.h"
+#include "task.h"
+#include "scan.h"
+#include "sound.h"
+#include "calib.h"
+#include "safety.h"
+#include "lib/lcd.h"
+#include "lib/util.h"
+
+static task_t boot_state;
+static char done = 0;
+static uint16_t ready_ms = 0;
+static uint32_t oi_deadline;
+static boot_time_t times[BOOT_STEP_COUNT];
+
+static const char names[BOOT_STEP_COUNT][6] PROGMEM = {"oi", "lcd", "servo", "songs"};
+
+static oi_t sensor_data;
+
+static char boot_task(task_t* t);
+
+/// Starts bringing up the hardware
+/**
+ * Call once at power on, after clock_init() and init_UART().  The steps run from boot_poll(), so the UART is usable right away and the menu
+ * can be shown while the rest of the hardware comes up.
+ * @return the sensor data structure, valid once boot_done()
+ */
+oi_t* boot_start(void) {
+	TASK_INIT(&boot_state);
+	done = 0;
+	boot_poll();
+	return &sensor_data;
+}
+
+/// Advances the boot sequence
+/**
+ * Never waits on a delay; it only blocks for the short register and UART work of the current step.
+ * @return 1 while the boot sequence is still running
+ */
+char boot_poll(void) {
+	if (!done && boot_task(&boot_state) == TASK_DONE) {
+		done = 1;
+	}
+	return !done;
+}
+
+/// Waits for the boot sequence to finish
+void boot_finish(void) {
+	while (boot_poll())
+		;
+}
+
+/// Checks if all the hardware is up
+char boot_done(void) {
+	return done;
+}
+
+/// Time from reset until all the hardware was up
+/**
+ * @return the time in ms, 0 if still booting
+ */
+uint16_t boot_ready_ms(void) {
+	return ready_ms;
+}
+
+/// When a boot step ran
+const boot_time_t* boot_time(boot_step step) {
+	return &times[step];
+}
+
+/// The display name of a boot step
+/**
+ * @return the name, in program memory
+ */
+const char* boot_step_name(boot_step step) {
+	return names[step];
+}
+
+/// The boot sequence
+/**
+ * The Create needs OI_BAUD_SWITCH_MS after the baud command and the servo needs most of a second to swing to 90, so both are started first and
+ * the IR and LCD setup happen while they wait.  The songs are uploaded one slot per call once the Create is in full mode, and the servo is
+ * waited out last.
+ */
+static char boot_task(task_t* t) {
+	TASK_BEGIN(t);
+	calib_load();
+	times[BOOT_OI].start = millis();
+	oi_init_begin();
+	oi_deadline = deadline_in(OI_BAUD_SWITCH_MS);
+
+	times[BOOT_SERVO].start = millis();
+	init_servo();
+	init_ir();
+
+	times[BOOT_LCD].start = millis();
+	lcd_init();
+	lprintf_P(PSTR("Welcome to\nBlastOffToMars.c!"));
+	times[BOOT_LCD].end = millis();
+
+	TASK_WAIT_UNTIL(t, deadline_passed(oi_deadline));
+	oi_init_end(&sensor_data);
+	safety_init();
+	times[BOOT_OI].end = millis();
+
+	times[BOOT_SONGS].start = millis();
+	while (songs_load_step()) {
+		TASK_YIELD(t);
+	}
+	times[BOOT_SONGS].end = millis();
+
+	TASK_WAIT_UNTIL(t, servo_settled());
+	times[BOOT_SERVO].end = millis();
+
+	ready_ms = millis();
+	TASK_END(t);
+}
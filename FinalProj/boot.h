@@ -0,0 +1,32 @@
+#ifndef BOOT_H_
+#define BOOT_H_
+
+#include <stdint.h>
+#include "lib/open_interface.h"
+
+/**
+ * Hardware brought up by the boot sequencer.  The steps overlap, so each one has its own start and end time.
+ */
+typedef enum {
+	BOOT_OI,		// SCI start, baud switch, full mode, first sensor read
+	BOOT_LCD,
+	BOOT_SERVO,		// PWM on and the servo at 90 degrees
+	BOOT_SONGS,		// song upload into the Create's slots
+	BOOT_STEP_COUNT
+} boot_step;
+
+/// When a boot step ran, in ms since reset
+typedef struct {
+	uint16_t start;
+	uint16_t end;
+} boot_time_t;
+
+oi_t* boot_start(void);
+char boot_poll(void);
+void boot_finish(void);
+char boot_done(void);
+uint16_t boot_ready_ms(void);
+const boot_time_t* boot_time(boot_step step);
+const char* boot_step_name(boot_step step);
+
+#endif /* BOOT_H_ */
@@ -0,0 +1,122 @@
+#include <stddef.h>
+#include <avr/eeprom.h>
+#include <avr/pgmspace.h>
+#include <util/crc16.h>
+#include "calib.h"
+
+calib_t calib;
+
+static calib_t EEMEM calib_eeprom;
+static char from_eeprom = 0;
+
+// Values measured on our robot when the firmware was written
+static const calib_t calib_defaults PROGMEM = {
+	.version = CALIB_VERSION,
+	.size = sizeof(calib_t),
+	// 800 + 3400 * deg / 180
+	.servo_ocr = {800, 1650, 2500, 3350, 4200},
+	.servo_measured = 0,
+	// Fit from samples in Mathematica
+	.ir_coeff = {133.987, -0.69158, 0.00176938, -2.25827e-6, 1.14087e-9, 1.59493e-13, -2.46348e-16},
+	.cliff_baseline = {0, 0, 0, 0},
+	.rotate_overshoot_cw = 0,
+	.rotate_overshoot_ccw = 0,
+};
+
+static uint16_t calib_crc(const calib_t* c);
+static int16_t line_at(uint8_t p0, uint8_t p1, uint8_t point);
+
+/// Loads the calibration from EEPROM
+/**
+ * Falls back to the defaults if the record is blank, from another firmware version, or corrupt.  Call at boot before anything uses calib.
+ * @return 1 if the record in EEPROM was used
+ */
+char calib_load(void) {
+	eeprom_read_block(&calib, &calib_eeprom, sizeof(calib_t));
+	from_eeprom = calib.version == CALIB_VERSION && calib.size == sizeof(calib_t) && calib.crc == calib_crc(&calib);
+	if (!from_eeprom) {
+		memcpy_P(&calib, &calib_defaults, sizeof(calib_t));
+	}
+	return from_eeprom;
+}
+
+/// Writes the calibration in use to EEPROM
+/**
+ * Only bytes that changed are written, so saving an unchanged record costs no EEPROM wear.  Blocks ~3.4 ms per changed byte.
+ */
+void calib_save(void) {
+	calib.version = CALIB_VERSION;
+	calib.size = sizeof(calib_t);
+	calib.crc = calib_crc(&calib);
+	eeprom_update_block(&calib, &calib_eeprom, sizeof(calib_t));
+	from_eeprom = 1;
+}
+
+/// Goes back to the defaults and invalidates the record in EEPROM
+void calib_clear(void) {
+	eeprom_update_byte(&calib_eeprom.version, 0xFF);
+	memcpy_P(&calib, &calib_defaults, sizeof(calib_t));
+	from_eeprom = 0;
+}
+
+/// Checks where the calibration in use came from
+/**
+ * @return 1 if it was loaded from or saved to EEPROM, 0 if it is the defaults
+ */
+char calib_from_eeprom(void) {
+	return from_eeprom;
+}
+
+/// Stores a measured servo calibration point and refits the others
+/**
+ * Points that have not been measured are fit from the ones that have: with one measurement the default line is shifted to pass through it, with
+ * more each unmeasured point is interpolated between its measured neighbors, or extrapolated from the two nearest ones at the ends.
+ * @param point which calibration angle, 0 to SERVO_CAL_POINTS - 1
+ * @param ocr the OCR ticks measured at that angle
+ */
+void calib_servo_point(uint8_t point, uint16_t ocr) {
+	uint8_t measured[SERVO_CAL_POINTS];
+	uint8_t count = 0;
+
+	calib.servo_ocr[point] = ocr;
+	calib.servo_measured |= 1 << point;
+	for (uint8_t i = 0; i < SERVO_CAL_POINTS; i++) {
+		if (calib.servo_measured & (1 << i)) {
+			measured[count++] = i;
+		}
+	}
+
+	for (uint8_t i = 0; i < SERVO_CAL_POINTS; i++) {
+		if (calib.servo_measured & (1 << i)) {
+			continue;
+		}
+		if (count == 1) {
+			int16_t shift = calib.servo_ocr[point] - pgm_read_word(&calib_defaults.servo_ocr[point]);
+			calib.servo_ocr[i] = pgm_read_word(&calib_defaults.servo_ocr[i]) + shift;
+		} else {
+			// Use the measured points around i, or the two nearest ones if i is past the ends
+			uint8_t k = 1;
+			while (k < count - 1 && measured[k] < i) {
+				k++;
+			}
+			calib.servo_ocr[i] = line_at(measured[k - 1], measured[k], i);
+		}
+	}
+}
+
+/// The line through two calibration points, evaluated at a third
+static int16_t line_at(uint8_t p0, uint8_t p1, uint8_t point) {
+	int16_t ocr0 = calib.servo_ocr[p0];
+	int16_t ocr1 = calib.servo_ocr[p1];
+	return ocr0 + (int32_t) (ocr1 - ocr0) * (point - p0) / (p1 - p0);
+}
+
+/// CRC-16 of a record, not counting the crc field itself
+static uint16_t calib_crc(const calib_t* c) {
+	uint16_t crc = 0xFFFF;
+	const uint8_t* p = (const uint8_t*) c;
+	for (uint8_t i = 0; i < offsetof(calib_t, crc); i++) {
+		crc = _crc16_update(crc, p[i]);
+	}
+	return crc;
+}
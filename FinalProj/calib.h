@@ -0,0 +1,40 @@
+#ifndef CALIB_H_
+#define CALIB_H_
+
+#include <stdint.h>
+
+// Bump when calib_t changes so an old record is not read with the new layout
+#define CALIB_VERSION 2
+
+#define IR_COEFFS 7
+
+// The servo is calibrated at 0, 45, 90, 135 and 180 degrees
+#define SERVO_CAL_POINTS 5
+#define SERVO_CAL_STEP 45
+
+/**
+ * Calibration values that differ from robot to robot.  Loaded from EEPROM at boot when a valid record is there, otherwise the defaults in calib.c
+ * are used.
+ */
+typedef struct {
+	uint8_t version;
+	uint8_t size;					// sizeof(calib_t), a second guard against layout changes
+	uint16_t servo_ocr[SERVO_CAL_POINTS];	// timer 3 OCR ticks for the servo at each calibration angle
+	uint8_t servo_measured;			// bit i is set if servo_ocr[i] was measured; the others are fit from the measured ones
+	float ir_coeff[IR_COEFFS];		// IR ADC reading to cm polynomial, constant term first
+	uint16_t cliff_baseline[4];		// cliff signal over normal floor: left, front left, front right, right; 0 if not learned
+	int8_t rotate_overshoot_cw;		// degrees the robot keeps turning after the wheels stop
+	int8_t rotate_overshoot_ccw;
+	uint16_t crc;					// CRC-16 of everything above
+} calib_t;
+
+/// The calibration in use
+extern calib_t calib;
+
+char calib_load(void);
+void calib_save(void);
+void calib_clear(void);
+void calib_servo_point(uint8_t point, uint16_t ocr);
+char calib_from_eeprom(void);
+
+#endif /* CALIB_H_ */
@@ -0,0 +1,141 @@
+/**
+ * capture.c: records the robot's I/O into the Bluetooth stream for replay
+ *
+ * Bytes are gathered into one open record until another channel records something, the record is full, or the poll timer finds it quiet for
+ * CAPTURE_GAP_US.  A finished record goes into the Bluetooth output ring whole or not at all: capture never waits for the link, it counts the
+ * records it had to drop and sends the count in a CAPTURE_LOST record as soon as there is room again.  See capture.h for the format.
+ */
+
+#include <string.h>
+#include <util/atomic.h>
+#include "capture.h"
+#include "bluetooth.h"
+#include "lib/util.h"
+#include "lib/hal.h"
+
+#if CAPTURE
+
+// Escape, header, and up to 5 bytes of time
+#define CAPTURE_HEADER_MAX 7
+
+volatile char capture_on = 0;
+
+// The open record; empty when payload_len is 0
+static uint8_t payload[CAPTURE_MAX_PAYLOAD];
+static uint8_t payload_len = 0;
+static uint8_t channel_open;
+static uint32_t first_us;		// micros() of its first byte
+static uint32_t last_us;		// micros() of its last byte
+
+static uint32_t sent_us;		// time of the last record sent, rounded to the 4 us it was sent with
+static uint8_t lost = 0;
+static soft_timer_t gap_timer;
+
+static void flush(void);
+static char send_record(uint8_t channel, uint32_t time, const uint8_t* data, uint8_t len);
+static void gap_tick(void);
+
+/// Starts recording
+/**
+ * Sends the CAPTURE_START record, waiting for room in the output ring if it has to, then turns on the hooks.
+ */
+void capture_start(void) {
+	uint32_t now = millis();
+	uint8_t start[5] = {CAPTURE_VERSION, now, now >> 8, now >> 16, now >> 24};
+	capture_stop();
+	lost = 0;
+	sent_us = micros();
+	while (!send_record(CAPTURE_START, sent_us, start, sizeof(start)))
+		hal_idle();
+	capture_on = 1;
+	timer_start(&gap_timer, 1, 1, gap_tick);
+}
+
+/// Stops recording
+/**
+ * Sends the open record, if there is room for it.
+ */
+void capture_stop(void) {
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		capture_on = 0;
+		flush();
+	}
+	timer_stop(&gap_timer);
+}
+
+/// Adds bytes to the open record
+/**
+ * Closes the open record first if it is of another channel, has no room for the bytes, or has been quiet for CAPTURE_GAP_US.  Safe in an ISR.
+ * @param channel what the bytes are
+ * @param data the bytes
+ * @param len how many, at most CAPTURE_MAX_PAYLOAD
+ */
+void capture_record(capture_channel channel, const uint8_t* data, uint8_t len) {
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		uint32_t now = micros();
+		if (payload_len && (channel != channel_open || payload_len + len > CAPTURE_MAX_PAYLOAD || now - last_us > CAPTURE_GAP_US)) {
+			flush();
+		}
+		if (!payload_len) {
+			channel_open = channel;
+			first_us = now;
+		}
+		memcpy(&payload[payload_len], data, len);
+		payload_len += len;
+		last_us = now;
+	}
+}
+
+/// Sends the open record; interrupts must be disabled
+static void flush(void) {
+	if (!payload_len) {
+		return;
+	}
+	if (lost && send_record(CAPTURE_LOST, first_us, &lost, 1)) {
+		lost = 0;
+	}
+	if (lost || !send_record(channel_open, first_us, payload, payload_len)) {
+		if (lost < 255) {
+			lost++;
+		}
+	}
+	payload_len = 0;
+}
+
+/// Frames one record and queues it if it fits
+/**
+ * @param channel the record's channel
+ * @param time micros() of its first byte
+ * @param data the payload
+ * @param len the payload length, 1 to CAPTURE_MAX_PAYLOAD
+ * @return 1 if it was queued
+ */
+static char send_record(uint8_t channel, uint32_t time, const uint8_t* data, uint8_t len) {
+	uint8_t frame[CAPTURE_HEADER_MAX + CAPTURE_MAX_PAYLOAD];
+	uint8_t n = 0;
+	uint32_t ticks = (time - sent_us) / 4;
+	uint32_t rest = ticks;
+	frame[n++] = CAPTURE_ESC;
+	frame[n++] = channel << 5 | (len - 1);
+	while (rest >= 0x80) {
+		frame[n++] = rest | 0x80;
+		rest >>= 7;
+	}
+	frame[n++] = rest;
+	memcpy(&frame[n], data, len);
+	if (!try_send_bytes(frame, n + len)) {
+		// The next record's time still counts from the last one that was sent
+		return 0;
+	}
+	sent_us += ticks * 4;
+	return 1;
+}
+
+/// Gap timer callback; runs in the timer interrupt
+static void gap_tick(void) {
+	if (payload_len && micros() - last_us > CAPTURE_GAP_US) {
+		flush();
+	}
+}
+
+#endif
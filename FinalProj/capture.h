@@ -0,0 +1,76 @@
+/**
+ * capture.h: records the robot's I/O into the Bluetooth stream for replay
+ *
+ * While capture is on, every byte received over Bluetooth, every byte sent to and received from the Create, every IR reading, and every servo pulse is
+ * framed into a compact binary record and sent out with the normal Bluetooth output.  A record is
+ *   CAPTURE_ESC, header, time, payload
+ * where the header is the channel in its top 3 bits and the payload length - 1 in the low 5, and the time is the number of 4 us ticks since the
+ * previous record, as a little endian base 128 number (7 bits per byte, high bit set on all but the last).  Text never contains CAPTURE_ESC, so a
+ * logger can keep the whole stream and the replayer (sim -R) picks the records out of it.  Consecutive bytes of one channel share a record; a byte
+ * after the first is on the link right behind the one before it.
+ *
+ * Bluetooth output itself is not recorded since it carries the capture.  Build with CAPTURE defined to 0 to remove the hooks.
+ */
+
+#ifndef CAPTURE_H_
+#define CAPTURE_H_
+
+#include <stdint.h>
+
+#ifndef CAPTURE
+#define CAPTURE 1
+#endif
+
+// Starts every record; the ASCII escape, which the program UI never sends
+#define CAPTURE_ESC 0x1B
+// Format of the records, sent in the CAPTURE_START record
+#define CAPTURE_VERSION 1
+// Longest payload of one record
+#define CAPTURE_MAX_PAYLOAD 32
+// An open record is sent once its channel has been quiet this long, us
+#define CAPTURE_GAP_US 1000
+
+/**
+ * Record channels.
+ */
+typedef enum {
+	CAPTURE_START,	// CAPTURE_VERSION, then millis() as 4 bytes, little endian
+	CAPTURE_BT_RX,	// bytes from Bluetooth
+	CAPTURE_OI_TX,	// bytes to the Create, as they enter USART1
+	CAPTURE_OI_RX,	// bytes from the Create
+	CAPTURE_ADC,	// IR readings, 2 bytes each, little endian
+	CAPTURE_SERVO,	// servo pulse widths in timer 3 ticks, 2 bytes each, little endian
+	CAPTURE_LOST	// records dropped since the last one sent, at most 255
+} capture_channel;
+
+#if CAPTURE
+
+extern volatile char capture_on;
+
+void capture_start(void);
+void capture_stop(void);
+void capture_record(capture_channel channel, const uint8_t* data, uint8_t len);
+
+/// Records one byte if capture is on; safe in an ISR
+static inline void capture_byte(capture_channel channel, uint8_t value) {
+	if (capture_on) {
+		capture_record(channel, &value, 1);
+	}
+}
+
+/// Records a 16 bit value if capture is on; safe in an ISR
+static inline void capture_word(capture_channel channel, uint16_t value) {
+	if (capture_on) {
+		uint8_t bytes[2] = {value, value >> 8};
+		capture_record(channel, bytes, 2);
+	}
+}
+
+#else
+
+#define capture_byte(channel, value)
+#define capture_word(channel, value)
+
+#endif
+
+#endif /* CAPTURE_H_ */
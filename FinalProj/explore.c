@@ -0,0 +1,92 @@
+/**
+ * explore.c: frontier exploration
+ *
+ * Scores a fixed set of headings around the robot on the occupancy grid.  Each heading gets the longest leg the scans have seen to be clear, and
+ * the leg is worth the unknown cells a scan at its end would see, less the time it takes to turn and drive there.  Areas that have already been
+ * scanned have no unknown cells left, so the robot keeps moving toward the edge of what it knows instead of wandering.  Legs never run into
+ * unknown floor, which may end in a drop the IR can not see, and cells behind walls and marked edges are not counted, since no scan would see
+ * them.
+ */
+
+#include <stdlib.h>
+#include "explore.h"
+#include "grid.h"
+#include "pose.h"
+#include "radar.h"
+#include "lib/trig.h"
+
+// Where the floor edge is after a stop: the robot's radius plus the 10 cm backup
+#define EDGE_AHEAD_MM 270
+
+static uint16_t unknown_around(int32_t x, int32_t y);
+
+/// Picks the next leg
+/**
+ * @param plan (return) the best leg
+ * @return 1 if a leg was found, 0 if no heading has a clear leg with anything left to see
+ */
+char explore_plan(explore_plan_t* plan)
+{
+	const pose_t* p = pose_get();
+	int32_t best = 0;
+
+	for (uint8_t i = 0; i < EXPLORE_HEADINGS; i++) {
+		// Straight ahead first, then alternating left and right, so ties go to the smaller turn
+		int turn = (i + 1) / 2 * (360 / EXPLORE_HEADINGS);
+		if (i % 2 == 0) {
+			turn = -turn;
+		}
+		int16_t heading = wrap_deg(p->heading + turn);
+		int leg = grid_clear_length(heading, RADAR_CORRIDOR_MM, EXPLORE_MAX_LEG + RADAR_CLEARANCE_MM) - RADAR_CLEARANCE_MM;
+		if (leg < EXPLORE_MIN_LEG) {
+			continue;
+		}
+		int32_t x = p->x + (((int32_t) leg * cos_q14(heading)) >> TRIG_SHIFT);
+		int32_t y = p->y + (((int32_t) leg * sin_q14(heading)) >> TRIG_SHIFT);
+		uint16_t cells = unknown_around(x, y);
+		int32_t score = (int32_t) cells * EXPLORE_MS_PER_CELL - (int32_t) abs(turn) * EXPLORE_MS_PER_DEG - (int32_t) leg * EXPLORE_MS_PER_MM;
+		if (score > best) {
+			best = score;
+			plan->turn = turn;
+			plan->leg = leg;
+			plan->cells = cells;
+		}
+	}
+	return best > 0;
+}
+
+/// Puts a floor edge in front of the robot on the map
+/**
+ * Call after a move stopped at a cliff or a colored edge and backed up.  The IR can not see those, so without this the planner would send the
+ * robot right back.
+ */
+void explore_mark_edge(void)
+{
+	int32_t x, y;
+	for (int angle = 60; angle <= 120; angle += 15) {
+		// A reading at EDGE_AHEAD_MM straight ahead and a little to the sides
+		pose_project(angle, EDGE_AHEAD_MM / 10, &x, &y);
+		grid_mark_blocked(x, y);
+	}
+}
+
+/// Counts the unknown cells around a point that a scan from it could see
+static uint16_t unknown_around(int32_t x, int32_t y)
+{
+	uint8_t col, row;
+	uint16_t cells = 0;
+	if (!grid_locate(x, y, &col, &row)) {
+		return 0;
+	}
+	for (int8_t dr = -EXPLORE_VIEW_CELLS; dr <= EXPLORE_VIEW_CELLS; dr++) {
+		for (int8_t dc = -EXPLORE_VIEW_CELLS; dc <= EXPLORE_VIEW_CELLS; dc++) {
+			int c = col + dc;
+			int r = row + dr;
+			if (c >= 0 && r >= 0 && c < GRID_SIZE && r < GRID_SIZE && grid_get(c, r) == GRID_UNKNOWN &&
+					grid_visible(col, row, c, r)) {
+				cells++;
+			}
+		}
+	}
+	return cells;
+}
@@ -0,0 +1,39 @@
+#ifndef EXPLORE_H_
+#define EXPLORE_H_
+
+#include <stdint.h>
+
+/**
+ * How autonomous() picks where to go when it has not found the goal.
+ */
+typedef enum {
+	EXPLORE_STRAIGHT,	// drive ahead unless the path is blocked, turn away from edges
+	EXPLORE_FRONTIER	// drive toward the most unknown map cells for the least travel time
+} explore_strategy;
+
+// Candidate headings, evenly spaced around the robot
+#define EXPLORE_HEADINGS 12
+// Longest and shortest leg worth driving, in mm
+#define EXPLORE_MAX_LEG 1000
+#define EXPLORE_MIN_LEG 200
+// Travel time at the speed of the motion functions: 200 mm/s, and ~90 deg/s turning in place
+#define EXPLORE_MS_PER_MM 5
+#define EXPLORE_MS_PER_DEG 11
+// What seeing one unknown cell is worth in travel time
+#define EXPLORE_MS_PER_CELL 400
+// Cells either side of the end of a leg that a scan there would see (GRID_RANGE_CM)
+#define EXPLORE_VIEW_CELLS 6
+
+/**
+ * The next leg: turn, then drive.
+ */
+typedef struct {
+	int turn;		// degrees, counterclockwise is positive
+	int leg;		// mm
+	uint16_t cells;	// unknown cells expected to be seen at the end
+} explore_plan_t;
+
+char explore_plan(explore_plan_t* plan);
+void explore_mark_edge(void);
+
+#endif /* EXPLORE_H_ */
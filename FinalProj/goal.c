@@ -0,0 +1,191 @@
+/**
+ * goal.c: goal post tracker
+ *
+ * Every pair of narrow objects in a scan is scored by how close their separation is to the real goal's and how narrow they are.  Pairs are
+ * kept as hypotheses in the pose frame, so sightings from different places line up, and a hypothesis gains confidence each time a scan sees it
+ * again and loses some each time one does not.  The robot only drives to a goal once a hypothesis is past GOAL_CONFIDENT.
+ */
+
+#include <stdlib.h>
+#include "goal.h"
+#include "pose.h"
+#include "trace.h"
+#include "lib/trig.h"
+
+static goal_t goals[GOAL_HYPOTHESES];
+
+static uint8_t pair_score(int32_t sep, int width1, int width2);
+static void sighting(int32_t x1, int32_t y1, int32_t x2, int32_t y2, uint8_t score);
+static int32_t dist2(int32_t x1, int32_t y1, int32_t x2, int32_t y2);
+
+/// Adds the post pairs of a scan to the hypotheses
+/**
+ * Call once after every scan, from where the scan was taken.
+ * @param objects the objects from the scan
+ * @param count the number of objects
+ */
+void goal_update(obj_t* objects, int count)
+{
+	for (uint8_t k = 0; k < GOAL_HYPOTHESES; k++) {
+		goals[k].seen = 0;
+	}
+	for (int i = 0; i < count; i++) {
+		if (obj_width(&objects[i]) >= GOAL_POST_WIDTH) {
+			continue;
+		}
+		int32_t x1, y1;
+		pose_project(obj_angle(&objects[i]), objects[i].dist, &x1, &y1);
+		for (int j = i + 1; j < count; j++) {
+			if (obj_width(&objects[j]) >= GOAL_POST_WIDTH) {
+				continue;
+			}
+			int32_t x2, y2;
+			pose_project(obj_angle(&objects[j]), objects[j].dist, &x2, &y2);
+			int32_t sep = isqrt32(dist2(x1, y1, x2, y2));
+			if (sep > GOAL_SEP_MIN_MM && sep < GOAL_SEP_MAX_MM) {
+				sighting(x1, y1, x2, y2, pair_score(sep, obj_width(&objects[i]), obj_width(&objects[j])));
+			}
+		}
+	}
+	for (uint8_t k = 0; k < GOAL_HYPOTHESES; k++) {
+		if (goals[k].confidence && !goals[k].seen) {
+			goals[k].confidence = goals[k].confidence > GOAL_DECAY ? goals[k].confidence - GOAL_DECAY : 0;
+		}
+	}
+}
+
+/// The most likely goal
+/**
+ * @param min_confidence the least confidence to accept; GOAL_CONFIDENT for a goal worth driving through
+ * @return the most confident hypothesis with at least min_confidence that has not been rejected, or NULL if there is none
+ */
+const goal_t* goal_best(uint8_t min_confidence)
+{
+	const goal_t* best = NULL;
+	for (uint8_t k = 0; k < GOAL_HYPOTHESES; k++) {
+		if (goals[k].confidence && !goals[k].rejected && goals[k].confidence >= min_confidence && (best == NULL || goals[k].confidence > best->confidence)) {
+			best = &goals[k];
+		}
+	}
+	return best;
+}
+
+/// Works out how to drive through a goal from where the robot is
+/**
+ * Turn by angle - 90, drive dist, turn by final_angle, and the robot is in the middle of the goal facing straight through it.
+ * @param goal a hypothesis
+ * @param angle (return) the direction of the middle of the goal in servo degrees (90 is straight ahead)
+ * @param dist (return) the distance to the middle of the goal in cm
+ * @param final_angle (return) the turn from facing the middle of the goal to facing through it, counterclockwise in degrees
+ */
+void goal_aim(const goal_t* goal, int* angle, int* dist, int* final_angle)
+{
+	int32_t cx = (goal->x1 + goal->x2) / 2;
+	int32_t cy = (goal->y1 + goal->y2) / 2;
+	int32_t ahead, left;
+	pose_to_robot(cx, cy, &ahead, &left);
+	int16_t bearing = atan2_deg(left, ahead);
+	*angle = 90 + bearing;
+	*dist = isqrt32(ahead * ahead + left * left) / 10;
+
+	// Of the two directions square to the line between the posts, the one leading away from the robot
+	int32_t nx = -(goal->y2 - goal->y1);
+	int32_t ny = goal->x2 - goal->x1;
+	const pose_t* p = pose_get();
+	if (nx * (cx - p->x) + ny * (cy - p->y) < 0) {
+		nx = -nx;
+		ny = -ny;
+	}
+	int16_t turn = wrap_deg(atan2_deg(ny, nx) - p->heading - bearing);
+	*final_angle = turn > 180 ? turn - 360 : turn;
+}
+
+/// Marks a hypothesis as not the goal
+/**
+ * Call after driving through it without finding the goal.  It keeps absorbing sightings so the same pair does not come back as a new hypothesis.
+ * @param goal a hypothesis from goal_best()
+ */
+void goal_reject(const goal_t* goal)
+{
+	goals[goal - goals].rejected = 1;
+}
+
+/// Forgets all hypotheses
+void goal_clear(void)
+{
+	for (uint8_t k = 0; k < GOAL_HYPOTHESES; k++) {
+		goals[k].confidence = 0;
+		goals[k].sightings = 0;
+		goals[k].rejected = 0;
+	}
+}
+
+/// All the hypothesis slots
+/**
+ * @return GOAL_HYPOTHESES slots; empty ones have a confidence of 0
+ */
+const goal_t* goal_hypotheses(void)
+{
+	return goals;
+}
+
+/// How much a post pair looks like the goal, 0 to 100
+static uint8_t pair_score(int32_t sep, int width1, int width2)
+{
+	int16_t score = 100 - abs(sep - GOAL_SEP_MM) / 4 - (width1 + width2) * 5;
+	return score > 0 ? score : 0;
+}
+
+/// Adds one post pair to the hypotheses
+/**
+ * A pair near a hypothesis moves its posts halfway toward the new sighting and adds the score to its confidence, once per scan.  Any other
+ * pair takes the least confident slot if it scores better than that slot's confidence.
+ */
+static void sighting(int32_t x1, int32_t y1, int32_t x2, int32_t y2, uint8_t score)
+{
+	int32_t cx = (x1 + x2) / 2;
+	int32_t cy = (y1 + y2) / 2;
+	goal_t* weakest = &goals[0];
+
+	for (uint8_t k = 0; k < GOAL_HYPOTHESES; k++) {
+		goal_t* g = &goals[k];
+		if (g->confidence && dist2(cx, cy, (g->x1 + g->x2) / 2, (g->y1 + g->y2) / 2) < (int32_t) GOAL_GATE_MM * GOAL_GATE_MM) {
+			if (g->seen) {
+				return;
+			}
+			// The posts can come in either order
+			if (dist2(x1, y1, g->x1, g->y1) > dist2(x1, y1, g->x2, g->y2)) {
+				int32_t t = x1; x1 = x2; x2 = t;
+				t = y1; y1 = y2; y2 = t;
+			}
+			g->x1 += (x1 - g->x1) / 2;
+			g->y1 += (y1 - g->y1) / 2;
+			g->x2 += (x2 - g->x2) / 2;
+			g->y2 += (y2 - g->y2) / 2;
+			g->confidence = g->confidence + score > 255 ? 255 : g->confidence + score;
+			g->sightings++;
+			g->seen = 1;
+			return;
+		}
+		if (g->confidence < weakest->confidence) {
+			weakest = g;
+		}
+	}
+	if (score > weakest->confidence) {
+		weakest->x1 = x1;
+		weakest->y1 = y1;
+		weakest->x2 = x2;
+		weakest->y2 = y2;
+		weakest->confidence = score;
+		weakest->sightings = 1;
+		weakest->rejected = 0;
+		weakest->seen = 1;
+		trace(TRACE_GOAL_NEW, weakest - goals, score);
+	}
+}
+
+/// Squared distance between two points
+static int32_t dist2(int32_t x1, int32_t y1, int32_t x2, int32_t y2)
+{
+	return (x2 - x1) * (x2 - x1) + (y2 - y1) * (y2 - y1);
+}
@@ -0,0 +1,42 @@
+#ifndef GOAL_H_
+#define GOAL_H_
+
+#include <stdint.h>
+#include "scan.h"
+
+// Objects narrower than this (cm) can be goal posts
+#define GOAL_POST_WIDTH 3
+// Distance between the posts: nominal, and the range accepted, in mm
+#define GOAL_SEP_MM 600
+#define GOAL_SEP_MIN_MM 400
+#define GOAL_SEP_MAX_MM 800
+// Most hypotheses kept at once
+#define GOAL_HYPOTHESES 4
+// A pair this close (mm) to a hypothesis's center is taken as another sighting of it
+#define GOAL_GATE_MM 150
+// Confidence lost by a hypothesis on every scan that does not see it, and the confidence needed to drive to it
+#define GOAL_DECAY 30
+#define GOAL_CONFIDENT 150
+// Farthest to drive toward a hypothesis that is not confident yet before scanning it again, in mm
+#define GOAL_CONFIRM_MM 300
+
+/**
+ * A possible goal: two posts in the pose frame and how sure we are of them.
+ */
+typedef struct {
+	int32_t x1, y1;		// mm
+	int32_t x2, y2;
+	uint8_t confidence;	// 0 is an empty slot
+	uint8_t sightings;
+	char rejected;		// driven through once without finding the goal
+	char seen;			// sighted in the current scan
+} goal_t;
+
+void goal_update(obj_t* objects, int count);
+const goal_t* goal_best(uint8_t min_confidence);
+void goal_aim(const goal_t* goal, int* angle, int* dist, int* final_angle);
+void goal_reject(const goal_t* goal);
+void goal_clear(void);
+const goal_t* goal_hypotheses(void);
+
+#endif /* GOAL_H_ */
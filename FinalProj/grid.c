@@ -0,0 +1,280 @@
+/**
+ * grid.c: occupancy grid of the arena
+ *
+ * Every IR reading is traced from the robot to where it ended, with the odometry of the moment it was taken, so the map builds up over all the
+ * scans and sweeps of a run.  Everything is integer math: the reading is projected with the fixed point pose code and walked cell by cell with
+ * Bresenham's line algorithm.
+ */
+
+#include <stdlib.h>
+#include "grid.h"
+#include "pose.h"
+#include "lib/trig.h"
+
+#define CELLS_PER_BYTE (8 / GRID_BITS)
+#define CELL_MASK ((1 << GRID_BITS) - 1)
+// Distance from the map's corner to the origin of the pose frame
+#define GRID_HALF_MM ((int32_t) GRID_SIZE * GRID_CELL_MM / 2)
+// Step of the corridor search; half a cell so a lane can not slip between two samples
+#define SEARCH_STEP_MM (GRID_CELL_MM / 2)
+
+static uint8_t grid[GRID_BYTES];
+// Cells marked by grid_mark_blocked(), one bit each; readings never clear them
+static uint8_t edges[GRID_SIZE * GRID_SIZE / 8];
+
+static void set_cell(uint8_t col, uint8_t row, uint8_t value);
+static char is_edge(uint8_t col, uint8_t row);
+static void trace_ray(uint8_t col0, uint8_t row0, uint8_t col1, uint8_t row1, char hit);
+static char blocked_at(int32_t x, int32_t y);
+static int lane_length(int16_t heading, int half_width, int max, char known);
+
+/// Forgets the whole map
+void grid_clear(void)
+{
+	for (int i = 0; i < GRID_BYTES; i++) {
+		grid[i] = 0;
+	}
+	for (int i = 0; i < (int) sizeof(edges); i++) {
+		edges[i] = 0;
+	}
+}
+
+/// Adds an IR reading to the map
+/**
+ * The cells between the robot and the reading become more likely free, and the cell the reading ended in more likely occupied.  A reading past
+ * GRID_RANGE_CM only clears the cells up to that range.  Parts of the ray outside the map are dropped.
+ * @param angle the servo angle of the reading in degrees
+ * @param dist the IR distance in cm
+ */
+void grid_ir_sample(int angle, int dist)
+{
+	uint8_t col0, row0, col1, row1;
+	int32_t x, y;
+	char hit = 1;
+
+	if (dist <= 0) {
+		return;
+	}
+	if (dist > GRID_RANGE_CM) {
+		dist = GRID_RANGE_CM;
+		hit = 0;
+	}
+	const pose_t* p = pose_get();
+	if (!grid_locate(p->x, p->y, &col0, &row0)) {
+		return;
+	}
+	pose_project(angle, dist, &x, &y);
+	if (!grid_locate(x, y, &col1, &row1)) {
+		// Clear up to the edge of the map; the range is a few cells, so clamping barely bends the ray
+		hit = 0;
+		x = x < -GRID_HALF_MM ? -GRID_HALF_MM : x >= GRID_HALF_MM ? GRID_HALF_MM - 1 : x;
+		y = y < -GRID_HALF_MM ? -GRID_HALF_MM : y >= GRID_HALF_MM ? GRID_HALF_MM - 1 : y;
+		grid_locate(x, y, &col1, &row1);
+	}
+	trace_ray(col0, row0, col1, row1, hit);
+}
+
+/// What the map knows about a cell
+/**
+ * @param col the column, 0 to GRID_SIZE - 1; x grows with the column
+ * @param row the row, 0 to GRID_SIZE - 1; y grows with the row
+ * @return a grid_cell
+ */
+uint8_t grid_get(uint8_t col, uint8_t row)
+{
+	uint16_t i = (uint16_t) row * GRID_SIZE + col;
+	return (grid[i / CELLS_PER_BYTE] >> ((i % CELLS_PER_BYTE) * GRID_BITS)) & CELL_MASK;
+}
+
+/// Marks the cell at a point as occupied for good
+/**
+ * For obstacles the IR can not see, like floor edges.  The IR rays pass over them, so the cell stays GRID_OCCUPIED whatever later readings say,
+ * until grid_clear().  Points off the map are ignored.
+ * @param x the point in mm
+ * @param y the point in mm
+ */
+void grid_mark_blocked(int32_t x, int32_t y)
+{
+	uint8_t col, row;
+	if (grid_locate(x, y, &col, &row)) {
+		uint16_t i = (uint16_t) row * GRID_SIZE + col;
+		edges[i / 8] |= 1 << (i % 8);
+		set_cell(col, row, GRID_OCCUPIED);
+	}
+}
+
+/// Finds the cell a point of the pose frame is in
+/**
+ * @param x the point in mm
+ * @param y the point in mm
+ * @param col (return) the column
+ * @param row (return) the row
+ * @return 1 if the point is on the map, 0 else
+ */
+char grid_locate(int32_t x, int32_t y, uint8_t* col, uint8_t* row)
+{
+	x += GRID_HALF_MM;
+	y += GRID_HALF_MM;
+	if (x < 0 || y < 0 || x >= 2 * GRID_HALF_MM || y >= 2 * GRID_HALF_MM) {
+		return 0;
+	}
+	*col = x / GRID_CELL_MM;
+	*row = y / GRID_CELL_MM;
+	return 1;
+}
+
+/// Checks if the IR could see from one cell to another
+/**
+ * @return 1 if no cell strictly between the two may be occupied, 0 else
+ */
+char grid_visible(uint8_t col0, uint8_t row0, uint8_t col1, uint8_t row1)
+{
+	int dc = abs(col1 - col0);
+	int dr = -abs(row1 - row0);
+	int8_t sc = col0 < col1 ? 1 : -1;
+	int8_t sr = row0 < row1 ? 1 : -1;
+	int err = dc + dr;
+	uint8_t col = col0;
+	uint8_t row = row0;
+
+	while (col != col1 || row != row1) {
+		int e2 = 2 * err;
+		if (e2 >= dr) {
+			err += dr;
+			col += sc;
+		}
+		if (e2 <= dc) {
+			err += dc;
+			row += sr;
+		}
+		if ((col != col1 || row != row1) && grid_get(col, row) >= GRID_MAYBE) {
+			return 0;
+		}
+	}
+	return 1;
+}
+
+/// How far the robot could drive along a heading without reaching a cell that may be occupied
+/**
+ * Searches a lane half_width to either side of the line from the robot along the heading.  Unknown cells and cells off the map count as free.
+ * @param heading the direction in the pose frame in degrees
+ * @param half_width half the width of the lane in mm, 0 for a single ray
+ * @param max how far to search in mm
+ * @return the distance in mm to the first blocked point in the lane, or max if there is none
+ */
+int grid_free_length(int16_t heading, int half_width, int max)
+{
+	return lane_length(heading, half_width, max, 0);
+}
+
+/// How far the lane along a heading is known to be free
+/**
+ * Like grid_free_length(), but unknown cells and cells off the map end the lane too, so the result is only as far as the scans have looked.
+ * @param heading the direction in the pose frame in degrees
+ * @param half_width half the width of the lane in mm, 0 for a single ray
+ * @param max how far to search in mm
+ * @return the distance in mm to the first point in the lane not known to be free, or max if there is none
+ */
+int grid_clear_length(int16_t heading, int half_width, int max)
+{
+	return lane_length(heading, half_width, max, 1);
+}
+
+/// Distance to the nearest cell that may be occupied in a direction
+/**
+ * @param heading the direction in the pose frame in degrees
+ * @param max how far to search in mm
+ * @return the distance in mm, or max if nothing was found
+ */
+int grid_obstacle_dist(int16_t heading, int max)
+{
+	return grid_free_length(heading, 0, max);
+}
+
+/// Checks if a point is in a cell that may be occupied
+static char blocked_at(int32_t x, int32_t y)
+{
+	uint8_t col, row;
+	return grid_locate(x, y, &col, &row) && grid_get(col, row) >= GRID_MAYBE;
+}
+
+/// Searches a lane along a heading from the robot for the first point that stops it
+/**
+ * @param known 1 to stop at cells that are not known to be free, 0 to stop only at cells that may be occupied
+ */
+static int lane_length(int16_t heading, int half_width, int max, char known)
+{
+	const pose_t* p = pose_get();
+	int16_t c = cos_q14(heading);
+	int16_t s = sin_q14(heading);
+	uint8_t col, row;
+
+	// The robot's own cell can not be occupied, whatever a stray reading put there
+	for (int ahead = SEARCH_STEP_MM; ahead < max; ahead += SEARCH_STEP_MM) {
+		for (int left = -half_width; left <= half_width; left += SEARCH_STEP_MM) {
+			int32_t x = p->x + (((int32_t) ahead * c - (int32_t) left * s) >> TRIG_SHIFT);
+			int32_t y = p->y + (((int32_t) ahead * s + (int32_t) left * c) >> TRIG_SHIFT);
+			if (known ? !grid_locate(x, y, &col, &row) || grid_get(col, row) != GRID_FREE : blocked_at(x, y)) {
+				return ahead;
+			}
+		}
+	}
+	return max;
+}
+
+/// Stores a cell
+static void set_cell(uint8_t col, uint8_t row, uint8_t value)
+{
+	uint16_t i = (uint16_t) row * GRID_SIZE + col;
+	uint8_t shift = (i % CELLS_PER_BYTE) * GRID_BITS;
+	grid[i / CELLS_PER_BYTE] = (grid[i / CELLS_PER_BYTE] & ~(CELL_MASK << shift)) | (value << shift);
+}
+
+/// Checks if a cell was marked by grid_mark_blocked()
+static char is_edge(uint8_t col, uint8_t row)
+{
+	uint16_t i = (uint16_t) row * GRID_SIZE + col;
+	return (edges[i / 8] >> (i % 8)) & 1;
+}
+
+/// Walks a reading from the robot's cell to where it ended
+/**
+ * Every cell before the last one moves a step toward free.  The last one moves a step toward occupied if the reading hit something there, or
+ * toward free if not.  Edge cells keep their mark.
+ * @param hit 1 if the reading ended on something
+ */
+static void trace_ray(uint8_t col0, uint8_t row0, uint8_t col1, uint8_t row1, char hit)
+{
+	int dc = abs(col1 - col0);
+	int dr = -abs(row1 - row0);
+	int8_t sc = col0 < col1 ? 1 : -1;
+	int8_t sr = row0 < row1 ? 1 : -1;
+	int err = dc + dr;
+	uint8_t col = col0;
+	uint8_t row = row0;
+
+	while (col != col1 || row != row1) {
+		uint8_t cell = grid_get(col, row);
+		if (cell != GRID_FREE && !is_edge(col, row)) {
+			set_cell(col, row, cell == GRID_OCCUPIED ? GRID_MAYBE : GRID_FREE);
+		}
+		int e2 = 2 * err;
+		if (e2 >= dr) {
+			err += dr;
+			col += sc;
+		}
+		if (e2 <= dc) {
+			err += dc;
+			row += sr;
+		}
+	}
+	uint8_t cell = grid_get(col, row);
+	if (is_edge(col, row)) {
+		return;
+	}
+	if (hit) {
+		set_cell(col, row, cell <= GRID_FREE ? GRID_MAYBE : GRID_OCCUPIED);
+	} else if (cell != GRID_FREE) {
+		set_cell(col, row, cell == GRID_OCCUPIED ? GRID_MAYBE : GRID_FREE);
+	}
+}
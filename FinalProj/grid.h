@@ -0,0 +1,36 @@
+#ifndef GRID_H_
+#define GRID_H_
+
+#include <stdint.h>
+
+// Cells per side and the size of a cell; the map is centered on the origin of the pose frame
+#define GRID_SIZE 48
+#define GRID_CELL_MM 100
+// Readings past this are taken as nothing there, and only clear the cells up to it (same threshold as the object detection in scan.c)
+#define GRID_RANGE_CM 60
+// Bits per cell; four cells share a byte
+#define GRID_BITS 2
+#define GRID_BYTES (GRID_SIZE * GRID_SIZE * GRID_BITS / 8)
+
+/**
+ * What the map knows about a cell.  A reading ending in a cell moves it one step toward GRID_OCCUPIED, a reading passing through it one step
+ * toward GRID_FREE.
+ */
+typedef enum {
+	GRID_UNKNOWN = 0,
+	GRID_FREE = 1,
+	GRID_MAYBE = 2,		// seen once, or seen occupied and later clear
+	GRID_OCCUPIED = 3
+} grid_cell;
+
+void grid_clear(void);
+void grid_ir_sample(int angle, int dist);
+uint8_t grid_get(uint8_t col, uint8_t row);
+void grid_mark_blocked(int32_t x, int32_t y);
+char grid_locate(int32_t x, int32_t y, uint8_t* col, uint8_t* row);
+char grid_visible(uint8_t col0, uint8_t row0, uint8_t col1, uint8_t row1);
+int grid_free_length(int16_t heading, int half_width, int max);
+int grid_clear_length(int16_t heading, int half_width, int max);
+int grid_obstacle_dist(int16_t heading, int max);
+
+#endif /* GRID_H_ */
@@ -4,7 +4,6 @@
 #include "lib/open_interface.h"
 
 void init_UART(void);
-oi_t* init_iRobot(void);
 void init_servo(void);
 void init_ir(void);
 
@@ -0,0 +1,257 @@
+/**
+ * fmt.c: small integer-only formatter
+ *
+ * Numbers are converted with 16 bit division whenever the value fits, which is most of them; 32 bit division is only used for the high digits of
+ * larger values.
+ */
+
+#include <string.h>
+#include "fmt.h"
+
+// Longest field: 10 digits of a uint32_t in decimal, plus a sign
+#define FMT_DIGITS 11
+
+static void pad_to(fmt_sink_t out, uint8_t len, uint8_t width, char pad);
+static uint8_t to_digits(char* end, uint32_t val, uint8_t base);
+
+/// Formats a string from RAM
+/**
+ * @param out where to send the characters
+ * @param format printf style format string, see fmt.h for what is supported
+ */
+void fmt(fmt_sink_t out, const char* format, ...) {
+	va_list args;
+	va_start(args, format);
+	vfmt(out, format, 0, args);
+	va_end(args);
+}
+
+/// Formats a string from program memory
+/**
+ * Use with PSTR("...") so the format never takes up SRAM.
+ * @param out where to send the characters
+ * @param format printf style format string in program memory
+ */
+void fmt_P(fmt_sink_t out, const char* format, ...) {
+	va_list args;
+	va_start(args, format);
+	vfmt(out, format, 1, args);
+	va_end(args);
+}
+
+/// The formatter behind fmt() and fmt_P()
+/**
+ * @param out where to send the characters
+ * @param format printf style format string
+ * @param in_flash 1 if format is in program memory
+ * @param args the values for the conversions in format
+ */
+void vfmt(fmt_sink_t out, const char* format, char in_flash, va_list args) {
+	char c;
+	while ((c = in_flash ? pgm_read_byte(format) : *format)) {
+		format++;
+		if (c != '%') {
+			out(c);
+			continue;
+		}
+
+		char left = 0;
+		char pad = ' ';
+		char is_long = 0;
+		uint8_t width = 0;
+		c = in_flash ? pgm_read_byte(format++) : *(format++);
+		if (c == '-') {
+			left = 1;
+			c = in_flash ? pgm_read_byte(format++) : *(format++);
+		} else if (c == '0') {
+			pad = '0';
+			c = in_flash ? pgm_read_byte(format++) : *(format++);
+		}
+		while (c >= '0' && c <= '9') {
+			width = width * 10 + c - '0';
+			c = in_flash ? pgm_read_byte(format++) : *(format++);
+		}
+		if (c == 'l') {
+			is_long = 1;
+			c = in_flash ? pgm_read_byte(format++) : *(format++);
+		}
+
+		char digits[FMT_DIGITS];
+		const char* s = digits;
+		uint8_t len;
+		char s_in_flash = 0;
+		switch (c) {
+		case 'd': {
+			int32_t val = is_long ? va_arg(args, long) : va_arg(args, int);
+			uint32_t mag = val < 0 ? -(uint32_t) val : (uint32_t) val;
+			len = to_digits(digits + FMT_DIGITS, mag, 10);
+			s = digits + FMT_DIGITS - len;
+			if (val < 0) {
+				if (pad == '0') {
+					// The sign goes before the zeros
+					out('-');
+					width = width ? width - 1 : 0;
+				} else {
+					*(char*) (--s) = '-';
+					len++;
+				}
+			}
+			break;
+		}
+		case 'u':
+		case 'x':
+			len = to_digits(digits + FMT_DIGITS, is_long ? va_arg(args, unsigned long) : va_arg(args, unsigned int), c == 'x' ? 16 : 10);
+			s = digits + FMT_DIGITS - len;
+			break;
+		case 'c':
+			digits[0] = va_arg(args, int);
+			len = 1;
+			break;
+		case 's':
+			s = va_arg(args, const char*);
+			len = strlen(s);
+			break;
+		case 'S':
+			s = va_arg(args, const char*);
+			len = strlen_P(s);
+			s_in_flash = 1;
+			break;
+		case '\0':
+			// Format ends in the middle of a conversion
+			return;
+		default:
+			// %% and anything not understood is printed as is
+			digits[0] = c;
+			len = 1;
+			break;
+		}
+
+		if (!left) {
+			pad_to(out, len, width, pad);
+		}
+		for (uint8_t i = 0; i < len; i++) {
+			out(s_in_flash ? pgm_read_byte(s + i) : s[i]);
+		}
+		if (left) {
+			pad_to(out, len, width, ' ');
+		}
+	}
+}
+
+/// Sends a string from RAM
+void fmt_str(fmt_sink_t out, const char* s) {
+	while (*s) {
+		out(*(s++));
+	}
+}
+
+/// Sends a string from program memory
+void fmt_str_P(fmt_sink_t out, const char* s) {
+	char c;
+	while ((c = pgm_read_byte(s++))) {
+		out(c);
+	}
+}
+
+/// Sends an unsigned number in decimal
+/**
+ * @param out where to send the characters
+ * @param val the number
+ * @param width the minimum number of characters to send
+ * @param pad the character to fill up to width with, ' ' or '0'
+ */
+void fmt_uint(fmt_sink_t out, uint32_t val, uint8_t width, char pad) {
+	char digits[FMT_DIGITS];
+	uint8_t len = to_digits(digits + FMT_DIGITS, val, 10);
+	pad_to(out, len, width, pad);
+	for (char* d = digits + FMT_DIGITS - len; d < digits + FMT_DIGITS; d++) {
+		out(*d);
+	}
+}
+
+/// Sends a signed number in decimal
+/**
+ * @param out where to send the characters
+ * @param val the number
+ * @param width the minimum number of characters to send, including the sign
+ * @param pad the character to fill up to width with, ' ' or '0'
+ */
+void fmt_int(fmt_sink_t out, int32_t val, uint8_t width, char pad) {
+	if (val >= 0) {
+		fmt_uint(out, val, width, pad);
+		return;
+	}
+	char digits[FMT_DIGITS];
+	uint8_t len = to_digits(digits + FMT_DIGITS, -(uint32_t) val, 10) + 1;
+	if (pad == '0') {
+		out('-');
+		pad_to(out, len, width, pad);
+	} else {
+		pad_to(out, len, width, pad);
+		out('-');
+	}
+	for (char* d = digits + FMT_DIGITS - len + 1; d < digits + FMT_DIGITS; d++) {
+		out(*d);
+	}
+}
+
+/// Sends a fixed point number in decimal
+/**
+ * Prints val / 2^frac_bits with a fixed number of decimals, truncated toward zero.  For example a heading in 1/256 degree units is
+ * fmt_fixed(out, heading, 8, 1).
+ * @param out where to send the characters
+ * @param val the fixed point value
+ * @param frac_bits the number of fraction bits in val, at most 27
+ * @param decimals the number of digits to print after the decimal point
+ */
+void fmt_fixed(fmt_sink_t out, int32_t val, uint8_t frac_bits, uint8_t decimals) {
+	uint32_t mag = val;
+	if (val < 0) {
+		out('-');
+		mag = -(uint32_t) val;
+	}
+	fmt_uint(out, mag >> frac_bits, 0, ' ');
+	if (!decimals) {
+		return;
+	}
+	out('.');
+	uint32_t mask = ((uint32_t) 1 << frac_bits) - 1;
+	uint32_t frac = mag & mask;
+	while (decimals--) {
+		frac *= 10;
+		out('0' + (frac >> frac_bits));
+		frac &= mask;
+	}
+}
+
+/// Sends pad characters until a field of len characters is width wide
+static void pad_to(fmt_sink_t out, uint8_t len, uint8_t width, char pad) {
+	while (len++ < width) {
+		out(pad);
+	}
+}
+
+/// Converts a number to digits
+/**
+ * Writes backwards from end so no reversing is needed.  Switches to 16 bit division as soon as the value fits; on the AVR that is several times
+ * faster than 32 bit division.
+ * @param end one past where the last digit goes
+ * @param val the number
+ * @param base 10 or 16
+ * @return the number of digits written
+ */
+static uint8_t to_digits(char* end, uint32_t val, uint8_t base) {
+	char* d = end;
+	while (val > 0xFFFF) {
+		uint8_t digit = val % base;
+		val /= base;
+		*(--d) = digit < 10 ? '0' + digit : 'a' + digit - 10;
+	}
+	uint16_t small = val;
+	do {
+		uint8_t digit = small % base;
+		small /= base;
+		*(--d) = digit < 10 ? '0' + digit : 'a' + digit - 10;
+	} while (small);
+	return end - d;
+}
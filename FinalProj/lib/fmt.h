@@ -0,0 +1,30 @@
+/**
+ * fmt.h: small integer-only formatter
+ *
+ * A replacement for the sprintf family that writes each character straight to a sink (the Bluetooth output ring, the LCD framebuffer, ...) instead
+ * of into a buffer.  Understands the subset of printf the firmware uses:
+ *   %d %u %x %c %s %%, %ld %lu %lx for 32 bit values, %S for a string in program memory,
+ *   an optional '-' (left justify) or '0' (zero pad) flag and a field width.
+ * There is no floating point; use fmt_fixed() for fixed point values.
+ */
+
+#ifndef FMT_H_
+#define FMT_H_
+
+#include <stdint.h>
+#include <stdarg.h>
+#include <avr/pgmspace.h>
+
+/// Receives one formatted character
+typedef void (*fmt_sink_t)(char c);
+
+void fmt(fmt_sink_t out, const char* format, ...);
+void fmt_P(fmt_sink_t out, const char* format, ...);
+void vfmt(fmt_sink_t out, const char* format, char in_flash, va_list args);
+void fmt_str(fmt_sink_t out, const char* s);
+void fmt_str_P(fmt_sink_t out, const char* s);
+void fmt_uint(fmt_sink_t out, uint32_t val, uint8_t width, char pad);
+void fmt_int(fmt_sink_t out, int32_t val, uint8_t width, char pad);
+void fmt_fixed(fmt_sink_t out, int32_t val, uint8_t frac_bits, uint8_t decimals);
+
+#endif /* FMT_H_ */
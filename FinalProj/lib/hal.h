@@ -0,0 +1,65 @@
+/**
+ * hal.h: hardware abstraction layer
+ *
+ * Everything that touches the peripheral registers: the Bluetooth USART, the Create USART, the 1 ms tick, the servo PWM, the IR ADC, the LCD
+ * port and the dock pin.  hal_avr.c implements it for the ATmega128, interrupt vectors included; a vector only moves the byte or flag and calls
+ * the handler declared at the bottom, which lives with the driver that owns the data.  sim/hal_sim.c implements it on top of a simulated
+ * Create for the native build, which defines HAL_HOST.
+ *
+ * The profiler (prof.c) and the SRAM report (memory.c) stay AVR only; the native build leaves them out.
+ */
+
+#ifndef HAL_H_
+#define HAL_H_
+
+#include <stdint.h>
+
+#ifdef HAL_HOST
+/// Lets simulated time pass; see sim/hal_sim.c
+void hal_idle(void);
+#else
+/// Called wherever the firmware waits for an interrupt or the clock.  Time passes by itself on the robot, so this is nothing.
+static inline void hal_idle(void) {}
+#endif
+
+// USART0, Bluetooth at 57.6k
+void hal_bt_init(void);
+void hal_bt_tx_start(void);
+
+// USART1, the Create
+void hal_oi_init(uint32_t baud);
+void hal_oi_baud(uint32_t baud);
+void hal_oi_tx_start(void);
+char hal_oi_tx_empty(void);
+
+// Timer 2, the 1 ms system tick
+void hal_clock_init(void);
+uint8_t hal_clock_ticks(void);
+char hal_clock_pending(void);
+
+// Timer 3, the servo PWM
+void hal_servo_start(void);
+void hal_servo_set(uint16_t ticks);
+
+// The IR sensor on ADC input 2
+void hal_adc_init(void);
+uint16_t hal_adc_read(void);
+
+// The LCD, on all of port A
+void hal_lcd_init(void);
+void hal_lcd_write(uint8_t value);
+void hal_lcd_set(uint8_t bits);
+void hal_lcd_clear(uint8_t bits);
+
+// The dock sense line, port B pin 7
+void hal_dock_init(void);
+char hal_docked(void);
+
+// Interrupt handlers, called with interrupts disabled
+void bt_rx_isr(uint8_t value);
+int16_t bt_tx_isr(void);
+void oi_rx_isr(uint8_t value);
+int16_t oi_tx_isr(void);
+void clock_tick_isr(void);
+
+#endif /* HAL_H_ */
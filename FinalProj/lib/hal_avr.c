@@ -0,0 +1,198 @@
+/**
+ * hal_avr.c: the hardware abstraction layer on the ATmega128
+ *
+ * Register setup and the interrupt vectors of the peripherals in hal.h.  See page 111 and 133-137 of the Atmel Mega128 User Guide for the
+ * timers and chapter 19 for the USARTs.
+ */
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include "hal.h"
+#include "open_interface.h"
+#include "../definitions.h"
+
+/// Initializes USART0 for two-way serial communication with interrupts
+/**
+ * Uses the values specified in definitions.h.  Interrupts are enabled.
+ */
+void hal_bt_init(void) {
+	// Set the double transmit speed
+	UCSR0A = _BV(U2X) * USART_DOUBLE_TRANSMIT;
+	// RX interrupt and communication enabled.  The UDRE interrupt is enabled by hal_bt_tx_start() while data is queued.
+	UCSR0B = _BV(RXCIE) | _BV(RXEN) | _BV(TXEN);
+	// Mode select, Parity, Stop Bits, and character size
+	UCSR0C = (_BV(UMSEL) * USART_SYNCHRONOUS) | (USART_PARITY << UPM0) | (USART_STOP_BITS << USBS) | (USART_DATA_BITS << UCSZ0);
+
+	// Set BAUD rate
+	UBRR0H = USART_UBRR_BAUD >> 8;
+	UBRR0L = USART_UBRR_BAUD & 0xFF;
+
+	sei();  // enable interrupts
+}
+
+/// Enables the UDRE interrupt, which sends the Bluetooth output ring until bt_tx_isr() says it is empty
+void hal_bt_tx_start(void) {
+	UCSR0B |= _BV(UDRIE);
+}
+
+/// Initializes USART1 for the Create, 8N1
+/**
+ * Received bytes are taken by the RX interrupt; the UDRE interrupt is enabled by hal_oi_tx_start() while data is queued.
+ * @param baud the baud rate to start at
+ */
+void hal_oi_init(uint32_t baud) {
+	hal_oi_baud(baud);
+	UCSR1B = (1 << RXCIE) | (1 << RXEN) | (1 << TXEN);
+	UCSR1C = (3 << UCSZ10);
+	sei();
+}
+
+/// Changes the baud rate of USART1
+void hal_oi_baud(uint32_t baud) {
+	UBRR1L = FOSC / 16 / baud - 1;
+}
+
+/// Enables the UDRE interrupt, which sends the Create transmit ring until oi_tx_isr() says it is empty
+void hal_oi_tx_start(void) {
+	UCSR1B |= (1 << UDRIE);
+}
+
+/// Checks if USART1 can take another byte
+char hal_oi_tx_empty(void) {
+	return (UCSR1A & (1 << UDRE)) != 0;
+}
+
+/// Starts timer 2 as the 1 ms system tick
+/**
+ * CTC mode with a compare interrupt every 1 ms.
+ */
+void hal_clock_init(void) {
+	OCR2 = 250 - 1;			//Clock is 16 MHz. At a prescaler of 64, 250 timer ticks = 1ms.
+	TCCR2 = 0b00001011;		//WGM:CTC, COM:OC2 disconnected,pre_scaler = 64
+	TIMSK |= _BV(OCIE2);	//Enabling O.C. Interrupt for Timer2
+	sei();
+}
+
+/// Timer 2 ticks since the last 1 ms tick; each is 4 us
+uint8_t hal_clock_ticks(void) {
+	return TCNT2;
+}
+
+/// Checks if timer 2 has wrapped but its interrupt has not run yet
+char hal_clock_pending(void) {
+	return (TIFR & _BV(OCF2)) != 0;
+}
+
+/// Starts the servo PWM
+/**
+ * Initializes Port E pin 4 for output of the PWM signal, and sets the TOP value to a value that is compatible with the calculations in
+ * scan.c.  Set the first position with hal_servo_set() before starting.
+ */
+void hal_servo_start(void) {
+	DDRE |= _BV(4);		// Set port E pin 4 as an output
+	OCR3A = 43000 - 1;	// TOP - number of cycles in the interval
+	TCCR3A = 0x23;		// set COM and WGM (bits 3 and 2)
+	TCCR3B = 0x1A;		// set WGM (bits 1 and 0) and CS
+}
+
+/// Sets the high time of the servo pulse
+/**
+ * @param ticks timer 3 ticks the signal is high
+ */
+void hal_servo_set(uint16_t ticks) {
+	OCR3B = ticks;
+}
+
+/// Initializes the ADC for reading values
+/**
+ * Initializes the ADC for a reference voltage of 2.56 V, using input 2, and a prescaler of /128
+ */
+void hal_adc_init(void) {
+	// Reference voltage is 2.56 V and the MUX to 2
+	ADMUX = _BV(REFS1) | _BV(REFS0) | 2; // 0xC2;
+	// Enables the ADC and sets the prescaler to /128
+	ADCSRA = _BV(ADEN) | _BV(ADPS2) | _BV(ADPS1) | _BV(ADPS0); // 0x87;
+}
+
+/// Gets a reading from the ADC
+/**
+ * Starts an ADC conversion, waits for it to complete, then returns the raw value.
+ * @return the raw value from the ADC
+ */
+uint16_t hal_adc_read(void) {
+	// Start the ADC conversion
+	ADCSRA |= _BV(ADSC);
+	// Wait for the result
+	while (!(ADCSRA & _BV(ADIF)))
+		{}
+	return ADC;
+}
+
+/// Makes port A, which is dedicated to the LCD, an output
+void hal_lcd_init(void) {
+	DDRA = 0xFF;
+}
+
+/// Sets the whole LCD port
+void hal_lcd_write(uint8_t value) {
+	PORTA = value;
+}
+
+/// Sets bits of the LCD port
+void hal_lcd_set(uint8_t bits) {
+	PORTA |= bits;
+}
+
+/// Clears bits of the LCD port
+void hal_lcd_clear(uint8_t bits) {
+	PORTA &= ~bits;
+}
+
+/// Makes the dock sense line an input with a pullup
+void hal_dock_init(void) {
+	DDRB &= ~0x80; //Setting pin7 to input
+	PORTB |= 0x80; //Setting pullup on pin7
+}
+
+/// Checks the dock sense line
+/**
+ * @return 1 once the Create is on its dock
+ */
+char hal_docked(void) {
+	return PINB >> 7;
+}
+
+// The 1 ms tick
+ISR (TIMER2_COMP_vect) {
+	clock_tick_isr();
+}
+
+// A byte from Bluetooth
+ISR (USART0_RX_vect) {
+	bt_rx_isr(UDR0);
+}
+
+// Room for the next Bluetooth byte; the interrupt disables itself when the ring is empty
+ISR (USART0_UDRE_vect) {
+	int16_t value = bt_tx_isr();
+	if (value < 0) {
+		UCSR0B &= ~_BV(UDRIE);
+	} else {
+		UDR0 = value;
+	}
+}
+
+// A byte from the Create
+ISR (USART1_RX_vect) {
+	oi_rx_isr(UDR1);
+}
+
+// Room for the next byte to the Create; the interrupt disables itself when the ring is empty
+ISR (USART1_UDRE_vect) {
+	int16_t value = oi_tx_isr();
+	if (value < 0) {
+		UCSR1B &= ~(1 << UDRIE);
+	} else {
+		UDR1 = value;
+	}
+}
@@ -4,12 +4,13 @@
  * @date 06/26/2012
  */
 
-#include <avr/io.h>
 #include <stdlib.h>
-#include <stdio.h>
 #include <string.h>
 #include "util.h"
 #include "lcd.h"
+#include "prof.h"
+#include "fmt.h"
+#include "hal.h"
 
 
 #define HD_LCD_CLEAR 0x01
@@ -38,41 +39,41 @@ void lcd_init(void) {
 	const char rs=0x10;		//PA4 is tied to Register Select
 	//Assumes Port A is dedicated to the LCD
 	//Seven Pins needed, but will assume all 8 are used
-	DDRA=0xFF; //Setting Port A for OutPut
+	hal_lcd_init(); //Setting Port A for OutPut
 	 //Preparing to put HD44780 into 4-bit Mod
-	PORTA=0x03;
+	hal_lcd_write(0x03);
 
-	PORTA|=enable;
+	hal_lcd_set(enable);
 	wait_ms(1);
-	PORTA&=~enable;
+	hal_lcd_clear(enable);
 	wait_ms(5);
-	PORTA|=enable;
+	hal_lcd_set(enable);
 	wait_ms(1);
-	PORTA&=~enable;
-	PORTA|=enable;
+	hal_lcd_clear(enable);
+	hal_lcd_set(enable);
 	wait_ms(1);
-	PORTA&=~enable;
+	hal_lcd_clear(enable);
 
-	PORTA=0x02;	//setting controller to 4 bit mode
+	hal_lcd_write(0x02);	//setting controller to 4 bit mode
 				//Need to set for 2 lines
 	lcd_toggle_clear(1);
 
-	PORTA|=0x00;  //setting disp on, cursor on, blink off
+	hal_lcd_set(0x00);  //setting disp on, cursor on, blink off
 	lcd_toggle_clear(1);
-	PORTA|=0x0E;
+	hal_lcd_set(0x0E);
 	lcd_toggle_clear(1);
 
-	PORTA|=0x00; //increment cursor, no display shift
+	hal_lcd_set(0x00); //increment cursor, no display shift
 	lcd_toggle_clear(1);
-	PORTA|=0x06;
+	hal_lcd_set(0x06);
 	lcd_toggle_clear(1);
 	
-	PORTA|=0x00; //clear LCD
+	hal_lcd_set(0x00); //clear LCD
 	lcd_toggle_clear(1);
-	PORTA|=0x01;
+	hal_lcd_set(0x01);
 	lcd_toggle_clear(1);
 
-	PORTA|=rs;	//Setting Register select high to enable character mode
+	hal_lcd_set(rs);	//Setting Register select high to enable character mode
 	lcd_home_line1();
 }
 
@@ -82,22 +83,22 @@ void lcd_init(void) {
 void lcd_toggle_clear(char delay) {
 	const char enable=0x40; //PA6 is tied to Enable
 
-	PORTA|=enable;
+	hal_lcd_set(enable);
 	wait_ms(delay);
-	PORTA&=~enable;
-	PORTA&=0xF0;	
+	hal_lcd_clear(enable);
+	hal_lcd_clear(0x0F);	
 }
 
 
 /// Submits command to LCD controller
 void lcd_command(char data) {
 	const char rs=0x10;		//PA4 is tied to Register Select
-	PORTA&=~rs;  //Setting register select low for command mode
-	PORTA|=(data>>4);
+	hal_lcd_clear(rs);  //Setting register select low for command mode
+	hal_lcd_set(data>>4);
 	lcd_toggle_clear(2);
-	PORTA|=(data & 0x0F);
+	hal_lcd_set(data & 0x0F);
 	lcd_toggle_clear(2);
-	PORTA|=rs;	//Setting register select high for character mode
+	hal_lcd_set(rs);	//Setting register select high for character mode
 }
 
 
@@ -169,37 +170,76 @@ void lcd_puts(char * string) {
 
 /// Prints one character at the current cursor position
 void lcd_putc(char data) {
-	PORTA|=(data>>4);
+	hal_lcd_set(data>>4);
 	lcd_toggle_clear(1);
-	PORTA|=(data & 0x0F);
+	hal_lcd_set(data & 0x0F);
 	lcd_toggle_clear(1);
 }
 
+// What is on the screen, as last sent by lprintf
+static char screen[LCD_TOTAL_CHARS + 1];
+static uint8_t screen_pos;
+static char screen_changed;
+
+static void lcd_show(const char *format, char in_flash, va_list arglist);
+
+/// Formatter sink that writes into the screen copy
+static void screen_put(char c) {
+	if (screen_pos < LCD_TOTAL_CHARS) {
+		if (screen[screen_pos] != c) {
+			screen[screen_pos] = c;
+			screen_changed = 1;
+		}
+		screen_pos++;
+	}
+}
+
 /// Print a formatted string to the LCD screen
 /**
- * Mimics the C library function printf for writing to the LCD screen.  The function is buffered; i.e. if you call
+ * Mimics the C library function printf for writing to the LCD screen, with the conversions supported by lib/fmt.h.  The function is buffered; i.e. if you call
  * lprintf twice with the same string, it will only update the LCD the first time.
  *
- * Google "printf" for documentation on the formatter string.
- *
- * Code from this site was also used: http://www.ozzu.com/cpp-tutorials/tutorial-writing-custom-printf-wrapper-function-t89166.html
+ * The text is formatted straight into a copy of the screen, so there is no second buffer to compare against.
  * @author Kerrick Staley & Chad Nelson
  * @date 05/16/2012
  */
 void lprintf(const char *format, ...) {
-	static char lastbuffer[LCD_TOTAL_CHARS + 1];
+	va_list arglist;
+	va_start(arglist, format);
+	lcd_show(format, 0, arglist);
+	va_end(arglist);
+}
 
-	char buffer[LCD_TOTAL_CHARS + 1];
+/// Print a formatted string to the LCD screen, with the format string in program memory
+/**
+ * Same as lprintf.  Use with PSTR("...") so the text never takes up SRAM.
+ */
+void lprintf_P(const char *format, ...) {
 	va_list arglist;
 	va_start(arglist, format);
-	vsnprintf(buffer, LCD_TOTAL_CHARS + 1, format, arglist);
+	lcd_show(format, 1, arglist);
+	va_end(arglist);
+}
+
+/// Formats into the screen copy and redraws the LCD if anything changed
+static void lcd_show(const char *format, char in_flash, va_list arglist) {
+	PROF_BEGIN(PROF_LPRINTF);
+	screen_pos = 0;
+	screen_changed = 0;
+	vfmt(screen_put, format, in_flash, arglist);
+	if (screen[screen_pos]) {
+		// The new text is shorter than what is on the screen
+		screen[screen_pos] = '\0';
+		screen_changed = 1;
+	}
 	
-	if (!strcmp(lastbuffer, buffer))
+	if (!screen_changed) {
+		PROF_END(PROF_LPRINTF);
 		return;
+	}
 	
-	strcpy(lastbuffer, buffer);
 	lcd_clear();
-	char *str = buffer;
+	char *str = screen;
 	int charnum = 0;
 	while (*str && charnum < LCD_TOTAL_CHARS) {
 		if (*str == '\n') {
@@ -236,5 +276,5 @@ void lprintf(const char *format, ...) {
 			}
 		}
 	}
-	va_end(arglist);
+	PROF_END(PROF_LPRINTF);
 }
@@ -10,6 +10,9 @@ void lcd_home_line4(void);
 /// Prints a string to the lcd; Google "printf" for documentation.
 void lprintf(const char *formatter, ...);
 
+/// Same as lprintf, with the format string in program memory
+void lprintf_P(const char *formatter, ...);
+
 /// Prints a string of characters starting at the current cursor position
 void lcd_puts(char *data);
 
@@ -1,85 +1,294 @@
-#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+#include <avr/pgmspace.h>
+#include <util/atomic.h>
 #include "util.h"
+#include "hal.h"
 #include "open_interface.h"
-
-/// Allocate memory for a the sensor data
-oi_t* oi_alloc() {
-	return calloc(1, sizeof(oi_t));
-}
-
-/// Free memory from a pointer to the sensor data struct
-void oi_free(oi_t *self) {
-	free(self);
-}
+#include "prof.h"
+#include "../capture.h"
+
+// Kinds of sensor packets
+#define OI_UNSIGNED 0	// stored as is (big endian on the wire)
+#define OI_SIGNED 1		// stored as is; documents that the field is two's complement
+#define OI_FLAGS 2		// each bit in mask goes to its own uint8_t field, lowest bit first
+#define OI_SKIP 3		// unused packet, bytes are dropped
+
+#define OI_FIRST_PACKET 7
+#define OI_LAST_PACKET 42
+
+/// How to decode one sensor packet
+typedef struct {
+	uint8_t size;	// bytes on the wire
+	uint8_t kind;
+	uint8_t offset;	// offsetof the (first) destination field in oi_t
+	uint8_t mask;	// OI_FLAGS only
+} oi_packet_desc_t;
+
+#define OI_FIELD(kind, size, field) {size, kind, offsetof(oi_t, field), 0}
+#define OI_BITS(mask, field) {1, OI_FLAGS, offsetof(oi_t, field), mask}
+
+/// Descriptors of packets 7 - 42, indexed by packet ID - OI_FIRST_PACKET
+static const oi_packet_desc_t packet_table[] PROGMEM = {
+	OI_BITS(0x1F, bumper_right),					// 7 bumps and wheel drops
+	OI_FIELD(OI_UNSIGNED, 1, wall),					// 8
+	OI_FIELD(OI_UNSIGNED, 1, cliff_left),			// 9
+	OI_FIELD(OI_UNSIGNED, 1, cliff_frontleft),		// 10
+	OI_FIELD(OI_UNSIGNED, 1, cliff_frontright),		// 11
+	OI_FIELD(OI_UNSIGNED, 1, cliff_right),			// 12
+	OI_FIELD(OI_UNSIGNED, 1, virtual_wall),			// 13
+	OI_BITS(0x1F, overcurrent_ld1),					// 14 low side driver and wheel overcurrents
+	{1, OI_SKIP, 0, 0},								// 15 unused
+	{1, OI_SKIP, 0, 0},								// 16 unused
+	OI_FIELD(OI_UNSIGNED, 1, infrared_byte),		// 17
+	OI_BITS(0x05, button_play),						// 18 buttons (play = bit 0, advance = bit 2)
+	OI_FIELD(OI_SIGNED, 2, distance),				// 19
+	OI_FIELD(OI_SIGNED, 2, angle),					// 20
+	OI_FIELD(OI_UNSIGNED, 1, charging_state),		// 21
+	OI_FIELD(OI_UNSIGNED, 2, voltage),				// 22
+	OI_FIELD(OI_SIGNED, 2, current),				// 23
+	OI_FIELD(OI_SIGNED, 1, temperature),			// 24
+	OI_FIELD(OI_UNSIGNED, 2, charge),				// 25
+	OI_FIELD(OI_UNSIGNED, 2, capacity),				// 26
+	OI_FIELD(OI_UNSIGNED, 2, wall_signal),			// 27
+	OI_FIELD(OI_UNSIGNED, 2, cliff_left_signal),	// 28
+	OI_FIELD(OI_UNSIGNED, 2, cliff_frontleft_signal),	// 29
+	OI_FIELD(OI_UNSIGNED, 2, cliff_frontright_signal),	// 30
+	OI_FIELD(OI_UNSIGNED, 2, cliff_right_signal),	// 31
+	OI_BITS(0x1F, cargo_bay_io0),					// 32 cargo bay digital inputs
+	OI_FIELD(OI_UNSIGNED, 2, cargo_bay_voltage),	// 33
+	OI_BITS(0x03, internal_charger_on),				// 34 charging sources available
+	OI_FIELD(OI_UNSIGNED, 1, oi_mode),				// 35
+	OI_FIELD(OI_UNSIGNED, 1, song_number),			// 36
+	OI_FIELD(OI_UNSIGNED, 1, song_playing),			// 37
+	OI_FIELD(OI_UNSIGNED, 1, number_packets),		// 38
+	OI_FIELD(OI_SIGNED, 2, requested_velocity),		// 39
+	OI_FIELD(OI_SIGNED, 2, requested_radius),		// 40
+	OI_FIELD(OI_SIGNED, 2, requested_right_velocity),	// 41
+	OI_FIELD(OI_SIGNED, 2, requested_left_velocity)	// 42
+};
+
+/// First and last packet ID of packet groups 0 - 6
+static const uint8_t group_table[][2] PROGMEM = {{7, 26}, {7, 16}, {17, 20}, {21, 26}, {27, 34}, {35, 42}, {7, 42}};
+
+static void decode_next(oi_decoder_t *decoder);
+static void oi_rx_flush(void);
+
+// USART1 rings; sizes must be powers of two.  The receive ring holds a whole group 6 response.
+#define OI_TX_SIZE 32
+#define OI_TX_MASK (OI_TX_SIZE - 1)
+#define OI_RX_SIZE 64
+#define OI_RX_MASK (OI_RX_SIZE - 1)
+static volatile uint8_t tx_buffer[OI_TX_SIZE];
+static volatile uint8_t tx_head = 0;
+static volatile uint8_t tx_tail = 0;
+static volatile uint8_t rx_buffer[OI_RX_SIZE];
+static volatile uint8_t rx_head = 0;
+static volatile uint8_t rx_tail = 0;
+
+// Depth of oi_begin() calls; nonzero while a command or query is being sent
+static volatile uint8_t link_busy = 0;
+
+volatile oi_rx_hook_t oi_rx_hook = 0;
+volatile oi_idle_hook_t oi_idle_hook = 0;
 
 /// Initialize the Create
 void oi_init(oi_t *self) {
+	oi_init_begin();
+	wait_ms(OI_BAUD_SWITCH_MS);
+	oi_init_end(self);
+}
+
+/// Starts the SCI and asks the Create to switch baud rates
+/**
+ * Returns right away so other hardware can be set up while the Create switches.
+ */
+void oi_init_begin(void) {
 	// Setup USART1 to communicate to the iRobot Create using serial (baud = 57600)
-	UBRR1L = 16; // UBRR = (FOSC/16/BAUD-1);
-	UCSR1B = (1 << RXEN) | (1 << TXEN);
-	UCSR1C = (3 << UCSZ10);
+	hal_oi_init(57600);
 
 	// Starts the SCI. Must be sent first
+	oi_begin();
 	oi_byte_tx(OI_OPCODE_START);
 	oi_byte_tx(OI_OPCODE_BAUD);
 
 	oi_byte_tx(8); // baud code for 28800
-	wait_ms(100);
-	
+	oi_end();
+}
+
+/// Finishes oi_init once the Create has switched baud rates
+void oi_init_end(oi_t *self) {
 	// Set the baud rate on the Cerebot II to match the Create's baud
-	UBRR1L = 33; // UBRR = (FOSC/16/BAUD-1);
+	while (tx_head != tx_tail || !hal_oi_tx_empty())
+		hal_idle();
+	hal_oi_baud(28800);
 
 	// Use Full mode, unrestricted control
+	oi_begin();
 	oi_byte_tx(OI_OPCODE_FULL);
+	oi_end();
 	oi_set_leds(1, 1, 7, 255);
 	
 	oi_update(self);
-	oi_update(self); // call twice to clear distance/angle
+	// The first reading holds everything since the Create powered up; drop it instead of spending a second query
+	self->distance = 0;
+	self->angle = 0;
 }
 
 
 
 /// Update the Create. This will update all the sensor data and store it in the oi_t struct.
 void oi_update(oi_t *self) {
-	int i;
+	oi_decoder_t decoder;
+	PROF_BEGIN(PROF_OI_UPDATE);
+	oi_begin();
 
 	// Clear the receive buffer
-	while (UCSR1A & (1 << RXC))
-	i = UDR1;
+	oi_rx_flush();
 
 	// Query a list of sensor values
 	oi_byte_tx(OI_OPCODE_SENSORS);
 	// Send the sensor packet ID
 	oi_byte_tx(OI_SENSOR_PACKET_GROUP6);
 
-	// Read all the sensor data
-	char *sensor = (char *) self;
-	for (i = 0; i < 52; i++) {
-		// read each sensor byte
-		*(sensor++) = oi_byte_rx();
-	}
-	
-	sensor = (char *) self;
-	
-	// Fix byte ordering for multi-byte members of the struct
-	self->distance                 = (sensor[12] << 8) + sensor[13];
-	self->angle                    = (sensor[14] << 8) + sensor[15];
-	self->voltage                  = (sensor[17] << 8) + sensor[18];
-	self->current                  = (sensor[19] << 8) + sensor[20];
-	self->charge                   = (sensor[22] << 8) + sensor[23];
-	self->capacity                 = (sensor[24] << 8) + sensor[25];
-	self->wall_signal              = (sensor[26] << 8) + sensor[27];
-	self->cliff_left_signal        = (sensor[28] << 8) + sensor[29];
-	self->cliff_frontleft_signal   = (sensor[30] << 8) + sensor[31];
-	self->cliff_frontright_signal  = (sensor[32] << 8) + sensor[33];
-	self->cliff_right_signal       = (sensor[34] << 8) + sensor[35];
-	self->cargo_bay_voltage        = (sensor[41] << 8) + sensor[42];
-	self->requested_velocity       = (sensor[48] << 8) + sensor[42];
-	self->requested_radius         = (sensor[50] << 8) + sensor[51];
-	self->requested_right_velocity = (sensor[52] << 8) + sensor[53];
-	self->requested_left_velocity  = (sensor[54] << 8) + sensor[55];
+	// Decode each byte into its field as it arrives
+	oi_decode_group(&decoder, OI_SENSOR_PACKET_GROUP6);
+	while (!oi_decode_byte(&decoder, self, oi_byte_rx()))
+		;
+	oi_end();
 	
-	wait_ms(10); // reduces USART errors that occur when continuously transmitting/receiving
+	// reduces USART errors that occur when continuously transmitting/receiving.  The link is idle here, so interrupt driven queries
+	// (see oi_rx_hook) can use it.
+	wait_ms(10);
+	PROF_END(PROF_OI_UPDATE);
+}
+
+
+/// Update only the listed sensor packets
+/**
+ * Sends a query list and decodes the response.  Fields of packets that are not listed keep their old values.
+ * @param self the sensor data to update
+ * @param ids the packet IDs to query (7 - 42)
+ * @param count the number of IDs
+ */
+void oi_query(oi_t *self, const uint8_t *ids, uint8_t count) {
+	oi_decoder_t decoder;
+	uint8_t i;
+
+	if (count == 0) {
+		return;
+	}
+	oi_begin();
+	oi_rx_flush();
+
+	oi_byte_tx(OI_OPCODE_QUERY_LIST);
+	oi_byte_tx(count);
+	for (i = 0; i < count; i++) {
+		oi_byte_tx(ids[i]);
+	}
+
+	oi_decode_list(&decoder, ids, count);
+	while (!oi_decode_byte(&decoder, self, oi_byte_rx()))
+		;
+	oi_end();
+}
+
+
+/// Size on the wire of a sensor packet
+/**
+ * @param id the packet ID
+ * @return the number of bytes, or 0 for packets outside 7 - 42
+ */
+uint8_t oi_packet_size(uint8_t id) {
+	if (id < OI_FIRST_PACKET || id > OI_LAST_PACKET) {
+		return 0;
+	}
+	return pgm_read_byte(&packet_table[id - OI_FIRST_PACKET].size);
+}
+
+
+/// Start decoding the response to a packet group request
+/**
+ * @param decoder the decoder to set up
+ * @param group the packet group (0 - 6) that was requested
+ */
+void oi_decode_group(oi_decoder_t *decoder, uint8_t group) {
+	uint8_t first = pgm_read_byte(&group_table[group][0]);
+	uint8_t last = pgm_read_byte(&group_table[group][1]);
+	decoder->list = NULL;
+	decoder->id = first;
+	decoder->remaining = last - first;
+	decoder->byte = 0;
+}
+
+
+/// Start decoding the response to a query list
+/**
+ * @param decoder the decoder to set up
+ * @param ids the packet IDs in the order they were requested; must stay valid until decoding is done
+ * @param count the number of IDs (at least 1)
+ */
+void oi_decode_list(oi_decoder_t *decoder, const uint8_t *ids, uint8_t count) {
+	decoder->list = ids + 1;
+	decoder->id = ids[0];
+	decoder->remaining = count - 1;
+	decoder->byte = 0;
+}
+
+
+/// Decode one received byte into its field
+/**
+ * Looks up the packet being received in the descriptor table and stores the byte straight into the matching oi_t field.  Two byte packets are
+ * assembled big endian; flag packets are split into one uint8_t per bit.  Unknown packet IDs are treated as one unused byte.
+ * @param decoder the decoder state from oi_decode_group() or oi_decode_list()
+ * @param self the sensor data to fill in
+ * @param value the received byte
+ * @return 1 if this was the last byte of the response, 0 otherwise
+ */
+char oi_decode_byte(oi_decoder_t *decoder, oi_t *self, uint8_t value) {
+	oi_packet_desc_t desc = {1, OI_SKIP, 0, 0};
+	if (decoder->id >= OI_FIRST_PACKET && decoder->id <= OI_LAST_PACKET) {
+		memcpy_P(&desc, &packet_table[decoder->id - OI_FIRST_PACKET], sizeof(desc));
+	}
+	uint8_t *dest = (uint8_t *) self + desc.offset;
+
+	if (desc.kind == OI_FLAGS) {
+		for (uint8_t bit = 1; bit; bit <<= 1) {
+			if (desc.mask & bit) {
+				*(dest++) = (value & bit) != 0;
+			}
+		}
+	} else if (desc.kind != OI_SKIP) {
+		if (desc.size == 1) {
+			*dest = value;
+		} else if (decoder->byte == 0) {
+			decoder->high = value;
+		} else {
+			uint16_t word = ((uint16_t) decoder->high << 8) | value;
+			memcpy(dest, &word, sizeof(word));
+		}
+	}
+
+	if (++decoder->byte < desc.size) {
+		return 0;
+	}
+	if (decoder->remaining == 0) {
+		return 1;
+	}
+	decode_next(decoder);
+	return 0;
+}
+
+
+/// Moves the decoder on to the next packet of the response
+static void decode_next(oi_decoder_t *decoder) {
+	decoder->byte = 0;
+	decoder->remaining--;
+	if (decoder->list) {
+		decoder->id = *(decoder->list++);
+	} else {
+		decoder->id++;
+	}
 }
 
 
@@ -94,6 +303,7 @@ void oi_update(oi_t *self) {
 */
 void oi_set_leds(uint8_t play_led, uint8_t advance_led, uint8_t power_color, uint8_t power_intensity) {
 	// LED Opcode
+	oi_begin();
 	oi_byte_tx(OI_OPCODE_LEDS);
 
 	// Set the Play and Advance LEDs
@@ -104,23 +314,27 @@ void oi_set_leds(uint8_t play_led, uint8_t advance_led, uint8_t power_color, uin
 
 	// Set the power led intensity
 	oi_byte_tx(power_intensity);
+	oi_end();
 }
 
 
 
 /// Drive wheels directly; speeds are in mm / sec
 void oi_set_wheels(int16_t right_wheel, int16_t left_wheel) {
+	oi_begin();
 	oi_byte_tx(OI_OPCODE_DRIVE_WHEELS);
 	oi_byte_tx(right_wheel>>8);
 	oi_byte_tx(right_wheel & 0xff);
 	oi_byte_tx(left_wheel>>8);
 	oi_byte_tx(left_wheel& 0xff);
+	oi_end();
 }
 
 
 /// Loads a song onto the iRobot Create
 void oi_load_song(int song_index, int num_notes, unsigned char *notes, unsigned char *duration) {
 	int i;
+	oi_begin();
 	oi_byte_tx(OI_OPCODE_SONG);
 	oi_byte_tx(song_index);
 	oi_byte_tx(num_notes);
@@ -128,13 +342,31 @@ void oi_load_song(int song_index, int num_notes, unsigned char *notes, unsigned
 		oi_byte_tx(notes[i]);
 		oi_byte_tx(duration[i]);
 	}
+	oi_end();
+}
+
+
+/// Loads a song from program memory onto the iRobot Create
+void oi_load_song_P(int song_index, int num_notes, const unsigned char *notes, const unsigned char *duration) {
+	int i;
+	oi_begin();
+	oi_byte_tx(OI_OPCODE_SONG);
+	oi_byte_tx(song_index);
+	oi_byte_tx(num_notes);
+	for (i=0;i<num_notes;i++) {
+		oi_byte_tx(pgm_read_byte(notes + i));
+		oi_byte_tx(pgm_read_byte(duration + i));
+	}
+	oi_end();
 }
 
 
 /// Plays a given song; use oi_load_song(...) first
 void oi_play_song(int index){
+	oi_begin();
 	oi_byte_tx(OI_OPCODE_PLAY);
 	oi_byte_tx(index);
+	oi_end();
 }
 
 
@@ -143,34 +375,133 @@ void go_charge(void) {
 	char charging_state=0;
 	
 	//Calling demo that will cause Create to seek out home base
+	oi_begin();
 	oi_byte_tx(OI_OPCODE_MAX);
 	oi_byte_tx(0x01);
+	oi_end();
 	
 	//Control is returned immediately, so need to check for docking status
-	DDRB &= ~0x80; //Setting pin7 to input
-	PORTB |= 0x80; //Setting pullup on pin7
+	hal_dock_init();
 	
 	do {
-		charging_state = PINB >> 7;
+		hal_idle();
+		charging_state = hal_docked();
 	} while (charging_state == 0);
 }
 
 
 
+/// Marks the start of a command or query
+/**
+ * Every multi-byte command must be wrapped in oi_begin() / oi_end() so a query sent from an interrupt (see oi_link_idle()) can never land in the
+ * middle of it.  Calls may nest.
+ */
+void oi_begin(void) {
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		link_busy++;
+	}
+}
+
+/// Marks the end of a command or query
+/**
+ * Calls oi_idle_hook when the outermost command ends, so work that had to wait for the link (like an emergency stop) goes out right after it.
+ */
+void oi_end(void) {
+	char idle;
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		idle = --link_busy == 0;
+	}
+	if (idle && oi_idle_hook) {
+		oi_idle_hook();
+	}
+}
+
+/// Checks if the link to the Create is free for an interrupt driven query
+/**
+ * The transmit ring must be empty too, since an interrupt cannot wait for room in it.
+ * @return 1 if nothing is being sent and no response is expected
+ */
+char oi_link_idle(void) {
+	return link_busy == 0 && tx_head == tx_tail && oi_rx_hook == 0;
+}
+
+/// Checks if a command is being sent
+/**
+ * @return 1 between oi_begin() and oi_end()
+ */
+char oi_sending(void) {
+	return link_busy != 0;
+}
+
+/// The room left in the transmit ring
+/**
+ * An interrupt may only queue a command this short; oi_byte_tx() cannot wait for room with interrupts disabled.
+ * @return the number of bytes that can be queued without blocking
+ */
+uint8_t oi_tx_free(void) {
+	return OI_TX_MASK - ((tx_head - tx_tail) & OI_TX_MASK);
+}
+
 // Transmit a byte of data over the serial connection to the Create
+/**
+ * Queues the byte for the UDRE interrupt.  Blocks only if the ring is full.
+ */
 void oi_byte_tx(unsigned char value) {
-	// Wait until the transmit buffer is empty
-	while (!(UCSR1A & (1 << UDRE)));
-
-	UDR1 = value;
+	uint8_t next = (tx_head + 1) & OI_TX_MASK;
+	// Wait for the UDRE interrupt to make room
+	while (next == tx_tail)
+		hal_idle();
+	tx_buffer[tx_head] = value;
+	tx_head = next;
+	hal_oi_tx_start();
 }
 
 
 
 // Receive a byte of data from the Create serial connection. Blocks until a byte is received.
 unsigned char oi_byte_rx(void) {
-	// wait until a byte is received (Receive Complete flag, RXC, is set)
-	while (!(UCSR1A & (1 << RXC)));
+	// wait until the RX interrupt has stored a byte
+	while (rx_head == rx_tail)
+		hal_idle();
+	uint8_t value = rx_buffer[rx_tail];
+	rx_tail = (rx_tail + 1) & OI_RX_MASK;
+	return value;
+}
+
+/// Drops any received bytes that have not been read
+static void oi_rx_flush(void) {
+	// Let an interrupt driven query finish first so its response is not mistaken for ours
+	while (oi_rx_hook)
+		hal_idle();
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		rx_tail = rx_head;
+	}
+}
+
+/// Takes the next queued byte for the Create
+/**
+ * @return the byte to send, or -1 if the ring is empty and the UDRE interrupt should stop
+ */
+int16_t oi_tx_isr(void) {
+	if (tx_head == tx_tail) {
+		return -1;
+	}
+	uint8_t value = tx_buffer[tx_tail];
+	tx_tail = (tx_tail + 1) & OI_TX_MASK;
+	capture_byte(CAPTURE_OI_TX, value);
+	return value;
+}
 
-	return UDR1;
+/// Stores a byte from the Create, or hands it to oi_rx_hook if an interrupt driven query is waiting for a response
+void oi_rx_isr(uint8_t value) {
+	capture_byte(CAPTURE_OI_RX, value);
+	if (oi_rx_hook) {
+		oi_rx_hook(value);
+		return;
+	}
+	uint8_t next = (rx_head + 1) & OI_RX_MASK;
+	if (next != rx_tail) {
+		rx_buffer[rx_head] = value;
+		rx_head = next;
+	}
 }
@@ -2,13 +2,12 @@
  * Open Interface API - Provides a set of functions for controlling the Create 
  * Documentation: http://www.irobot.com/filelibrary/pdfs/hrd/create/create%20open%20interface_v2.pdf
  *
+ * static oi_t robot;
+ *
  * void main() {
- *    oi_sensors_t *robot = oi_alloc();
- *    oi_init(robot);
+ *    oi_init(&robot);
  *
  *    // ... your code ...
- *
- *    free(robot);
  * }
  * 
  * @author See "Robotics Primer Workbook" project hosted on SourceForge.Net; Edited for clarity by Chad Nelson
@@ -84,13 +83,17 @@
 #define PIN_7 0x80
 
 /// iRobot Create Sensor Data
+/**
+ * Filled in field by field by the packet decoder, so the member order does not have to match the wire format.  Bits of the flag packets (7, 14, 18,
+ * 32, 34) are stored one per uint8_t so each has an address the decoder table can point at; flags of one packet must stay consecutive.
+ */
 typedef struct {
 	// Sensor statuses (booleans)
-	uint8_t bumper_right : 1;
-	uint8_t bumper_left : 1;
-	uint8_t wheeldrop_right : 1;
-	uint8_t wheeldrop_left : 1;
-	uint8_t wheeldrop_caster : 1;
+	uint8_t bumper_right;
+	uint8_t bumper_left;
+	uint8_t wheeldrop_right;
+	uint8_t wheeldrop_left;
+	uint8_t wheeldrop_caster;
 	uint8_t wall; // not virtual wall
 	uint8_t cliff_left;
 	uint8_t cliff_frontleft;
@@ -99,17 +102,15 @@ typedef struct {
 	uint8_t virtual_wall; // omni-directional IR sensor
 	
 	// Over current information
-	uint8_t overcurrent_ld1 : 1;
-	uint8_t overcurrent_ld0 : 1;
-	uint8_t overcurrent_ld2 : 1;
-	uint8_t overcurrent_driveright : 1;
-	uint8_t overcurrent_driveleft : 1;
+	uint8_t overcurrent_ld1;
+	uint8_t overcurrent_ld0;
+	uint8_t overcurrent_ld2;
+	uint8_t overcurrent_driveright;
+	uint8_t overcurrent_driveleft;
 
-	uint16_t unused_bytes;
-	
 	uint8_t infrared_byte;
-	uint8_t button_play : 2;
-	uint8_t button_advance : 1;
+	uint8_t button_play;
+	uint8_t button_advance;
 
 	int16_t distance; // in millimeters
 	int16_t angle;    // in degrees; counterclockwise is positive; clockwise is negative
@@ -130,15 +131,15 @@ typedef struct {
 	uint16_t cliff_right_signal;
 	
 	// Cargo bay info
-	uint8_t cargo_bay_io0 : 1;
-	uint8_t cargo_bay_io1 : 1;
-	uint8_t cargo_bay_io2 : 1;
-	uint8_t cargo_bay_io3 : 1;
-	uint8_t cargo_bay_baud : 1;
+	uint8_t cargo_bay_io0;
+	uint8_t cargo_bay_io1;
+	uint8_t cargo_bay_io2;
+	uint8_t cargo_bay_io3;
+	uint8_t cargo_bay_baud;
 	uint16_t cargo_bay_voltage;
 	
-	uint8_t internal_charger_on : 1;
-	uint8_t home_base_charger_on : 1;
+	uint8_t internal_charger_on;
+	uint8_t home_base_charger_on;
 	
 	uint8_t oi_mode; // off, passive, safe, full
 	
@@ -154,17 +155,45 @@ typedef struct {
 
 typedef oi_t oi_sensors_t;
 
-/// Allocate memory for the oi_sensor_t struct 
-oi_t * oi_alloc();
+/// Streaming decoder state for one sensor response.  See oi_decode_byte().
+typedef struct {
+	const uint8_t* list;	// remaining packet IDs of a query list, or NULL for a packet group
+	uint8_t remaining;		// packets left after the current one
+	uint8_t id;				// packet being decoded
+	uint8_t byte;			// bytes of the current packet received so far
+	uint8_t high;			// first byte of a two byte packet
+} oi_decoder_t;
+
+// Time the Create needs to switch to the new baud rate
+#define OI_BAUD_SWITCH_MS 100
 
 /// Initialize the Create. This must be called first.
 void oi_init(oi_t *self);
 
-void oi_free(oi_t *self);
+/// First half of oi_init: starts the SCI and asks for the new baud rate.  Call oi_init_end() OI_BAUD_SWITCH_MS later.
+void oi_init_begin(void);
+
+/// Second half of oi_init: switches to the new baud rate, enters full mode, and reads the sensors.
+void oi_init_end(oi_t *self);
 
 /// Update the Create. This will update all the sensor data.
 void oi_update(oi_t *self);
 
+/// Update only the listed sensor packets
+void oi_query(oi_t *self, const uint8_t *ids, uint8_t count);
+
+/// Size on the wire of a sensor packet (7 - 42), or 0 for an unknown packet
+uint8_t oi_packet_size(uint8_t id);
+
+/// Start decoding the response to a packet group request
+void oi_decode_group(oi_decoder_t *decoder, uint8_t group);
+
+/// Start decoding the response to a query list
+void oi_decode_list(oi_decoder_t *decoder, const uint8_t *ids, uint8_t count);
+
+/// Decode one received byte into its field; returns 1 when the response is complete
+char oi_decode_byte(oi_decoder_t *decoder, oi_t *self, uint8_t value);
+
 /// \brief Set the LEDS on the Create
 /// \param play_led 0=off, 1=on
 /// \param advance_led 0=off, 1=on
@@ -177,6 +206,28 @@ void oi_set_leds(uint8_t play_led, uint8_t advance_led, uint8_t power_color, uin
 /// \param linear velocity in mm/s values range from -500 -> 500 of left wheel
 void oi_set_wheels(int16_t right_wheel, int16_t left_wheel);
 
+/// Receives each byte of a response to a query sent from interrupt context; runs in the USART1 RX interrupt
+typedef void (*oi_rx_hook_t)(uint8_t value);
+/// Runs when the outermost oi_begin() / oi_end() pair ends
+typedef void (*oi_idle_hook_t)(void);
+
+/// While set, received bytes go to the hook instead of oi_byte_rx().  The owner sets it when it sends its query and clears it when the response is in.
+extern volatile oi_rx_hook_t oi_rx_hook;
+extern volatile oi_idle_hook_t oi_idle_hook;
+
+/// Wrap every multi-byte command in these so interrupt driven queries cannot split it
+void oi_begin(void);
+void oi_end(void);
+
+/// 1 if nothing is being sent and no response is expected, so an interrupt may send a query
+char oi_link_idle(void);
+
+/// 1 between oi_begin() and oi_end()
+char oi_sending(void);
+
+/// Bytes that can be queued without blocking
+uint8_t oi_tx_free(void);
+
 /// \brief Transmit a byte of data over the serial connection to the Create 
 /// \param value 8-bit value to transmit to the Create
 void oi_byte_tx(unsigned char value);
@@ -193,6 +244,10 @@ unsigned char oi_byte_rx(void);
 /// \param A pointer to a sequence of durations that correspond to the notes
 void oi_load_song(int song_index, int num_notes, unsigned char  *notes, unsigned char  *duration);
 
+/// \brief Load song sequence from program memory
+/// \param Same as oi_load_song, but notes and duration point into program memory
+void oi_load_song_P(int song_index, int num_notes, const unsigned char *notes, const unsigned char *duration);
+
 /// \brief Play song
 /// \param An integer value from 0 - 15 that is a previously establish song index
 void oi_play_song(int index);
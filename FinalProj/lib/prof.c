@@ -0,0 +1,81 @@
+/**
+ * prof.c: hot path cycle profiler
+ *
+ * Uses timer 1 at prescaler 1 as a free running cycle counter.
+ */
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <avr/pgmspace.h>
+#include "prof.h"
+
+#if PROFILE
+
+volatile uint16_t prof_overflows = 0;
+uint32_t prof_start[PROF_REGION_COUNT];
+static prof_stats_t stats[PROF_REGION_COUNT];
+
+static const char names[PROF_REGION_COUNT][14] PROGMEM = {"oi_update", "ir_ADC_to_cm", "cliff_signals", "format", "lprintf", "servo_wait", "plan_spread"};
+
+/// Starts the cycle counter and clears the statistics
+void prof_init(void) {
+	prof_reset();
+	TCCR1A = 0;
+	TCCR1B = _BV(CS10);		// Normal mode, prescaler = 1
+	TIMSK |= _BV(TOIE1);
+	sei();
+}
+
+/// Adds one measurement to a region
+/**
+ * @param region the region that was measured
+ * @param cycles the length of the region in CPU cycles
+ */
+void prof_record(prof_region region, uint32_t cycles) {
+	prof_stats_t* s = &stats[region];
+	uint8_t bucket = 0;
+	uint32_t limit = (uint32_t) 1 << PROF_HIST_BASE;
+
+	if (s->count == 0 || cycles < s->min) {
+		s->min = cycles;
+	}
+	if (cycles > s->max) {
+		s->max = cycles;
+	}
+	s->total += cycles;
+	s->count++;
+
+	while (bucket < PROF_HIST_BUCKETS - 1 && cycles >= limit) {
+		limit <<= 2;
+		bucket++;
+	}
+	s->hist[bucket]++;
+}
+
+/// Clears the statistics of every region
+void prof_reset(void) {
+	uint8_t* p = (uint8_t*) stats;
+	for (unsigned int i = 0; i < sizeof(stats); i++) {
+		p[i] = 0;
+	}
+}
+
+/// The statistics of a region
+const prof_stats_t* prof_get(prof_region region) {
+	return &stats[region];
+}
+
+/// The display name of a region
+/**
+ * @return the name, in program memory
+ */
+const char* prof_name(prof_region region) {
+	return names[region];
+}
+
+// Extends timer 1 to 32 bits (runs every 4.096 ms)
+ISR (TIMER1_OVF_vect) {
+	prof_overflows++;
+}
+
+#endif
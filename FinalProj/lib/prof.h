@@ -0,0 +1,82 @@
+/**
+ * prof.h: hot path cycle profiler
+ *
+ * Wrap a region with PROF_BEGIN(id) / PROF_END(id) to collect its count, min, max, and total CPU cycles plus a log2 histogram.  Timer 1 runs free at
+ * the CPU clock and is extended to 32 bits by its overflow interrupt, so regions up to ~268 s are measured exactly.
+ * Build with PROFILE defined to 0 to remove the markers and the timer completely.
+ */
+
+#ifndef PROF_H_
+#define PROF_H_
+
+#include <stdint.h>
+#include <avr/io.h>
+#include <avr/interrupt.h>
+
+#ifndef PROFILE
+#define PROFILE 1
+#endif
+
+/// Profiled regions
+typedef enum {
+	PROF_OI_UPDATE,
+	PROF_IR_ADC_TO_CM,
+	PROF_CLIFF_SIGNALS,
+	PROF_FORMAT,
+	PROF_LPRINTF,
+	PROF_SERVO_WAIT,
+	PROF_PLAN_SPREAD,
+	PROF_REGION_COUNT
+} prof_region;
+
+// Histogram bucket b counts regions shorter than 2^(PROF_HIST_BASE + 2b) cycles; the last bucket counts everything longer
+#define PROF_HIST_BUCKETS 8
+#define PROF_HIST_BASE 8
+
+/// Statistics for one region, in CPU cycles
+typedef struct {
+	uint16_t count;
+	uint32_t min;
+	uint32_t max;
+	uint32_t total;
+	uint16_t hist[PROF_HIST_BUCKETS];
+} prof_stats_t;
+
+#if PROFILE
+
+extern volatile uint16_t prof_overflows;
+extern uint32_t prof_start[PROF_REGION_COUNT];
+
+/// Reads the 32 bit cycle counter
+static inline uint32_t prof_cycles(void) {
+	uint16_t low, high;
+	uint8_t sreg = SREG;
+	cli();
+	low = TCNT1;
+	high = prof_overflows;
+	// The counter has wrapped but the overflow interrupt has not run yet
+	if ((TIFR & _BV(TOV1)) && low < 0x8000) {
+		high++;
+	}
+	SREG = sreg;
+	return ((uint32_t) high << 16) | low;
+}
+
+#define PROF_BEGIN(region) (prof_start[region] = prof_cycles())
+#define PROF_END(region) prof_record(region, prof_cycles() - prof_start[region])
+
+void prof_init(void);
+void prof_record(prof_region region, uint32_t cycles);
+void prof_reset(void);
+const prof_stats_t* prof_get(prof_region region);
+const char* prof_name(prof_region region);
+
+#else
+
+#define PROF_BEGIN(region)
+#define PROF_END(region)
+#define prof_init()
+
+#endif
+
+#endif /* PROF_H_ */
@@ -0,0 +1,131 @@
+/**
+ * trig.c: table driven fixed point trigonometry
+ *
+ * One quarter wave of sines lives in program memory; the other quadrants are mirrored from it.
+ */
+
+#include <avr/pgmspace.h>
+#include "trig.h"
+
+// sin(deg) * TRIG_ONE for 0-90 degrees
+static const int16_t sine_table[91] PROGMEM = {
+	0, 286, 572, 857, 1143, 1428, 1713, 1997, 2280, 2563,
+	2845, 3126, 3406, 3686, 3964, 4240, 4516, 4790, 5063, 5334,
+	5604, 5872, 6138, 6402, 6664, 6924, 7182, 7438, 7692, 7943,
+	8192, 8438, 8682, 8923, 9162, 9397, 9630, 9860, 10087, 10311,
+	10531, 10749, 10963, 11174, 11381, 11585, 11786, 11982, 12176, 12365,
+	12551, 12733, 12911, 13085, 13255, 13421, 13583, 13741, 13894, 14044,
+	14189, 14330, 14466, 14598, 14726, 14849, 14968, 15082, 15191, 15296,
+	15396, 15491, 15582, 15668, 15749, 15826, 15897, 15964, 16026, 16083,
+	16135, 16182, 16225, 16262, 16294, 16322, 16344, 16362, 16374, 16382,
+	16384
+};
+
+/// Sine of a whole number of degrees
+/**
+ * @param deg the angle in degrees, any value
+ * @return the sine in Q14
+ */
+int16_t sin_q14(int16_t deg)
+{
+	deg = wrap_deg(deg);
+	if (deg <= 90) {
+		return pgm_read_word(&sine_table[deg]);
+	} else if (deg <= 180) {
+		return pgm_read_word(&sine_table[180 - deg]);
+	} else if (deg <= 270) {
+		return -pgm_read_word(&sine_table[deg - 180]);
+	}
+	return -pgm_read_word(&sine_table[360 - deg]);
+}
+
+/// Cosine of a whole number of degrees
+/**
+ * @param deg the angle in degrees, any value
+ * @return the cosine in Q14
+ */
+int16_t cos_q14(int16_t deg)
+{
+	return sin_q14(wrap_deg(deg) + 90);
+}
+
+/// Brings an angle into 0-359 degrees
+/**
+ * @param deg the angle in degrees, any value
+ * @return the same direction in 0-359 degrees
+ */
+int16_t wrap_deg(int16_t deg)
+{
+	deg %= 360;
+	if (deg < 0) {
+		deg += 360;
+	}
+	return deg;
+}
+
+/// Direction of a vector to the nearest degree
+/**
+ * Folds the vector into the first octant and binary searches the sine table for the angle whose tangent is y / x.
+ * @param y the y component
+ * @param x the x component; both components must be under 65536 in size so the products fit
+ * @return the angle from the x axis in degrees, -179 to 180; 0 for a zero vector
+ */
+int16_t atan2_deg(int32_t y, int32_t x)
+{
+	uint32_t ax = x < 0 ? -x : x;
+	uint32_t ay = y < 0 ? -y : y;
+	char swap = ay > ax;
+	if (swap) {
+		uint32_t t = ax;
+		ax = ay;
+		ay = t;
+	}
+	if (ax == 0) {
+		return 0;
+	}
+	// Smallest angle in 0-45 whose tangent is at least ay / ax
+	int16_t lo = 0, hi = 45;
+	while (lo < hi) {
+		int16_t mid = (lo + hi) / 2;
+		if (ax * pgm_read_word(&sine_table[mid]) >= ay * pgm_read_word(&sine_table[90 - mid])) {
+			hi = mid;
+		} else {
+			lo = mid + 1;
+		}
+	}
+	// The sum of the unit vectors at lo - 1 and lo points halfway between them; round down if the vector is below that
+	if (lo > 0 && ax * (uint32_t) (pgm_read_word(&sine_table[lo]) + pgm_read_word(&sine_table[lo - 1])) >
+			ay * (uint32_t) (pgm_read_word(&sine_table[90 - lo]) + pgm_read_word(&sine_table[91 - lo]))) {
+		lo--;
+	}
+	int16_t deg = swap ? 90 - lo : lo;
+	if (x < 0) {
+		deg = 180 - deg;
+	}
+	return y < 0 ? -deg : deg;
+}
+
+/// Integer square root
+/**
+ * Bit by bit, with no multiplies.
+ * @param val the value
+ * @return the square root rounded down
+ */
+uint16_t isqrt32(uint32_t val)
+{
+	uint32_t root = 0;
+	uint32_t bit = (uint32_t) 1 << 30;
+	while (bit > val) {
+		bit >>= 2;
+	}
+	while (bit) {
+		if (val >= root + bit) {
+			val -= root + bit;
+			root = (root >> 1) + bit;
+		} else {
+			root >>= 1;
+		}
+		bit >>= 2;
+	}
+	return root;
+}
@@ -0,0 +1,23 @@
+/**
+ * trig.h: table driven fixed point trigonometry
+ *
+ * Sines, cosines and arctangents of whole degrees as Q14 fractions (TRIG_ONE is 1.0), and an integer square root, for the odometry and map
+ * code that runs on every sensor update.
+ * Multiply by a value and shift right by TRIG_SHIFT to scale it.
+ */
+
+#ifndef TRIG_H_
+#define TRIG_H_
+
+#include <stdint.h>
+
+#define TRIG_SHIFT 14
+#define TRIG_ONE (1 << TRIG_SHIFT)
+
+int16_t sin_q14(int16_t deg);
+int16_t cos_q14(int16_t deg);
+int16_t wrap_deg(int16_t deg);
+int16_t atan2_deg(int32_t y, int32_t x);
+uint16_t isqrt32(uint32_t val);
+
+#endif /* TRIG_H_ */
@@ -4,58 +4,163 @@
  * For an overview of how timer based interrupts work, see
  * page 111 and 133-137 of the Atmel Mega128 User Guide
  *
+ * Timer 2 runs continuously as a 1 ms system tick.  Everything that needs to wait or timestamp uses millis()/micros() instead of taking over a
+ * hardware timer.  Both call hal_idle(), so simulated time moves on in the native build while the firmware polls the clock.
+ *
  * @author Zhao Zhang & Chad Nelson
  * @date 06/26/2012
  */
 
-#include <avr/io.h>
-#include <avr/interrupt.h>
+#include <util/atomic.h>
 #include "util.h"
+#include "hal.h"
 
 // Global used for interrupt driven delay functions
-volatile unsigned int timer2_tick;
-void timer2_start(char unit);
-void timer2_stop(void);
+static volatile uint32_t system_ms = 0;
+static soft_timer_t* timer_list = 0;
+
+
+/// Starts the 1 ms system tick
+/**
+ * Sets timer 2 to CTC mode with a compare interrupt every 1 ms.  Must be called before anything that waits.  Calling it again does not reset the clock.
+ */
+void clock_init(void) {
+	hal_clock_init();
+}
+
+
+/// Milliseconds since clock_init()
+/**
+ * @return the number of ms since the clock was started; wraps after 49 days
+ */
+uint32_t millis(void) {
+	uint32_t ms;
+	hal_idle();
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		ms = system_ms;
+	}
+	return ms;
+}
+
+
+/// Microseconds since clock_init()
+/**
+ * Combines the tick count with the timer 2 count, which advances every 4 us.
+ * @return the number of us since the clock was started; wraps after 71 minutes
+ */
+uint32_t micros(void) {
+	uint32_t ms;
+	uint8_t ticks;
+	hal_idle();
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		ms = system_ms;
+		ticks = hal_clock_ticks();
+		// The counter has wrapped but the interrupt has not run yet
+		if (hal_clock_pending() && ticks < 125) {
+			ms++;
+		}
+	}
+	return ms * 1000 + ticks * 4;
+}
+
+
+/// The millis() value time_ms from now
+/**
+ * @param time_ms the number of ms from now
+ * @return a deadline for deadline_passed()
+ */
+uint32_t deadline_in(unsigned int time_ms) {
+	return millis() + time_ms;
+}
+
+
+/// Checks if millis() has reached a deadline
+/**
+ * Safe across the millis() wrap as long as the deadline is less than 24 days away.
+ * @param deadline a value from deadline_in()
+ * @return 1 if the deadline has passed, 0 else
+ */
+char deadline_passed(uint32_t deadline) {
+	return (int32_t) (millis() - deadline) >= 0;
+}
 
 
 /// Blocks for a specified number of milliseconds
+/**
+ * Waits for at least time_val ms; the first tick can come anywhere up to 1 ms after the call, so the wait is rounded up by one tick.
+ * @param time_val the number of ms to wait
+ */
 void wait_ms(unsigned int time_val) {
-	//Seting OC value for time requested
-	OCR2=250; 				//Clock is 16 MHz. At a prescaler of 64, 250 timer ticks = 1ms.
-	timer2_tick=0;
-	timer2_start(0);
+	uint32_t start = millis();
 
 	//Waiting for time
-	while(timer2_tick < time_val);
-
-	timer2_stop();
+	while (millis() - start <= time_val);
 }
 
 
-// Start timer2
-void timer2_start(char unit) {
-	timer2_tick=0;
-	if ( unit == 0 ) { 		//unit = 0 is for slow 
-        TCCR2=0b00001011;	//WGM:CTC, COM:OC2 disconnected,pre_scaler = 64
-        TIMSK|=0b10000000;	//Enabling O.C. Interrupt for Timer2
-	}
-	if (unit == 1) { 		//unit = 1 is for fast
-        TCCR2=0b00001001;	//WGM:CTC, COM:OC2 disconnected,pre_scaler = 1
-        TIMSK|=0b10000000;	//Enabling O.C. Interrupt for Timer2
+/// Calls callback after delay_ms, then every period_ms
+/**
+ * The callback runs in the timer interrupt, so it must be short (set a flag, poke a register).  It may start or stop timers, including its own.
+ * Starting a timer that is already running restarts it with the new values.
+ * @param timer the timer to start; must stay in memory until it is stopped or has expired
+ * @param delay_ms the number of ms until the first call
+ * @param period_ms the number of ms between later calls, or 0 for a one-shot timer
+ * @param callback the function to call
+ */
+void timer_start(soft_timer_t* timer, unsigned int delay_ms, unsigned int period_ms, timer_callback_t callback) {
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		timer->deadline = system_ms + delay_ms;
+		timer->period = period_ms;
+		timer->callback = callback;
+		if (!timer->active) {
+			timer->next = timer_list;
+			timer_list = timer;
+			timer->active = 1;
+		}
 	}
-	sei();
 }
 
 
-// Stop timer2
-void timer2_stop(void) {
-	TIMSK&=~0b10000000;		//Disabling O.C. Interrupt for Timer2
-	TCCR2&=0b01111111;		//Clearing O.C. settings
+/// Cancels a software timer
+/**
+ * @param timer the timer to stop; stopping a timer that is not running does nothing
+ */
+void timer_stop(soft_timer_t* timer) {
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		soft_timer_t** link = &timer_list;
+		while (*link) {
+			if (*link == timer) {
+				*link = timer->next;
+				break;
+			}
+			link = &(*link)->next;
+		}
+		timer->active = 0;
+	}
 }
 
 
-// Interrupt handler (runs every 1 ms)
-ISR (TIMER2_COMP_vect) {
-	timer2_tick++;
+/// The 1 ms tick; runs in the timer 2 interrupt
+/**
+ * Advances the clock and calls the software timers that are due.
+ */
+void clock_tick_isr(void) {
+	soft_timer_t** link = &timer_list;
+	system_ms++;
+	while (*link) {
+		soft_timer_t* timer = *link;
+		if ((int32_t) (system_ms - timer->deadline) >= 0) {
+			if (timer->period) {
+				timer->deadline += timer->period;
+			} else {
+				*link = timer->next;
+				timer->active = 0;
+			}
+			timer->callback();
+		}
+		// Only step forward if the timer is still linked here; the callback or a one-shot expiry may have removed it
+		if (*link == timer) {
+			link = &timer->next;
+		}
+	}
 }
-
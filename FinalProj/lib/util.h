@@ -1,2 +1,42 @@
+#ifndef UTIL_H_
+#define UTIL_H_
+
+#include <stdint.h>
+
+/// Called by a software timer when it expires; runs in interrupt context
+typedef void (*timer_callback_t)(void);
+
+/// Software timer driven by the system tick
+typedef struct soft_timer {
+	uint32_t deadline;
+	unsigned int period;
+	timer_callback_t callback;
+	char active;
+	struct soft_timer* next;
+} soft_timer_t;
+
+/// Starts the 1 ms system tick
+void clock_init(void);
+
+/// Milliseconds since clock_init()
+uint32_t millis(void);
+
+/// Microseconds since clock_init(), with 4 us resolution
+uint32_t micros(void);
+
+/// The millis() value time_ms from now
+uint32_t deadline_in(unsigned int time_ms);
+
+/// Checks if millis() has reached a deadline
+char deadline_passed(uint32_t deadline);
+
 /// Blocks for a specified number of milliseconds
-void wait_ms(unsigned int time_val);
\ No newline at end of file
+void wait_ms(unsigned int time_val);
+
+/// Calls callback after delay_ms, then every period_ms (0 = only once)
+void timer_start(soft_timer_t* timer, unsigned int delay_ms, unsigned int period_ms, timer_callback_t callback);
+
+/// Cancels a software timer
+void timer_stop(soft_timer_t* timer);
+
+#endif /* UTIL_H_ */
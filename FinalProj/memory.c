@@ -0,0 +1,63 @@
+#include <avr/io.h>
+#include "memory.h"
+
+// Section boundaries from the avr-libc linker script
+extern uint8_t __data_start;
+extern uint8_t __data_end;
+extern uint8_t __bss_start;
+extern uint8_t __bss_end;
+extern uint8_t _end;
+extern uint8_t __stack;
+
+void stack_paint(void) __attribute__ ((naked)) __attribute__ ((section (".init1")));
+
+/// Paints the SRAM between the end of .bss and the top of the stack
+/**
+ * Runs from .init1, before the stack pointer is set up and before .data/.bss are initialized, so it must not call anything or use the stack.
+ * The firmware has no heap, so everything above _end is stack space; whatever is still STACK_CANARY later has never been touched.
+ */
+void stack_paint(void) {
+	uint8_t* p = &_end;
+	while (p <= &__stack) {
+		*(p++) = STACK_CANARY;
+	}
+}
+
+/// Size of the initialized data section, copied from flash at reset
+uint16_t data_size(void) {
+	return &__data_end - &__data_start;
+}
+
+/// Size of the zeroed data section
+uint16_t bss_size(void) {
+	return &__bss_end - &__bss_start;
+}
+
+/// Bytes of stack in use right now
+uint16_t stack_now(void) {
+	return &__stack - (uint8_t*) SP;
+}
+
+/// Most bytes of stack ever in use since reset
+/**
+ * Scans up from the end of .bss for the first byte the stack has overwritten.
+ */
+uint16_t stack_peak(void) {
+	return &__stack - &_end + 1 - sram_unused();
+}
+
+/// Bytes of SRAM never touched since reset
+uint16_t sram_unused(void) {
+	uint8_t* p = &_end;
+	uint16_t count = 0;
+	while (p <= &__stack && *p == STACK_CANARY) {
+		p++;
+		count++;
+	}
+	return count;
+}
+
+/// Bytes of SRAM between the end of .bss and the stack pointer right now
+uint16_t sram_free(void) {
+	return (uint8_t*) SP - &_end;
+}
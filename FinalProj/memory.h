@@ -0,0 +1,16 @@
+#ifndef MEMORY_H_
+#define MEMORY_H_
+
+#include <stdint.h>
+
+// Value painted over the free SRAM at reset
+#define STACK_CANARY 0xC5
+
+uint16_t data_size(void);
+uint16_t bss_size(void);
+uint16_t stack_now(void);
+uint16_t stack_peak(void);
+uint16_t sram_unused(void);
+uint16_t sram_free(void);
+
+#endif /* MEMORY_H_ */
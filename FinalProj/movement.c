@@ -1,46 +1,120 @@
 #include <avr/io.h>
+#include <avr/pgmspace.h>
 #include "lib/open_interface.h"
 #include "movement.h"
 #include "lib/lcd.h"
 #include "bluetooth.h"
+#include "telemetry.h"
+#include "lib/prof.h"
+#include "trace.h"
+#include "sound.h"
+#include "calib.h"
+#include "safety.h"
+#include "pose.h"
+#include "radar.h"
+#include "grid.h"
+#include "lib/trig.h"
+#include "lib/util.h"
 #include <stdlib.h>
-#include <stdio.h>
 
-const char* stop_reason_descrip[] = {"LeftBump", "RightBump", "CliffLeft", "CliffRight", "Color", "None"};
+const char stop_reason_descrip[][STOP_REASON_LEN] PROGMEM = {"LeftBump", "RightBump", "CliffLeft", "CliffRight", "Color", "None", "Stopped", "WheelDrop", "Obstacle"};
+
+static void after_update(oi_t* sensor_data);
+static char check_safety(stop_reason* reason);
+static void check_radar(move_t* m);
+static void update_clearance(move_t* m);
+static void govern_speed(move_t* m);
+static void record_leg(move_t* m);
+
+static speed_stats_t stats;
+
+// Running averages of the cliff signals, see check_cliff_signals()
+static char initialized = 0;
+static uint16_t average_left_signal=0;
+static uint16_t average_right_signal=0;
+static uint16_t average_fleft_signal=0;
+static uint16_t average_fright_signal=0;
+static void trace_anomalies(oi_t* sensor_data);
 
 ///Rotates the given number of degrees
 /**
  * Takes in an int specifying an angle in degrees and the robot will turn that many degrees.
  * Positive angles are counter clockwise; negative angles are clockwise.
+ * Returns early if a stop is requested from the program UI.
  * @param deg angle in degrees for the roboto to rotate
  * @param sensor_data the oi_t struct containing all the robots data
  */
 int rotate_deg(int deg, oi_t* sensor_data)
 {
-	int degree = 0;
-    if(deg < 0)
-    {
-        //For turning cw
-		oi_set_wheels(-200, 200);
-        while (degree > deg)
-        {
-            oi_update(sensor_data);
-            degree += sensor_data->angle;
+	rotate_t r;
+	rotate_init(&r, deg);
+	while (rotate_task(&r, sensor_data) == TASK_RUNNING) {
+		if (stop_requested()) {
+			rotate_cancel(&r);
+			break;
+		}
+	}
+	return deg;
+}
 
-        }
-    }
-    else{
-        //For turning ccw
+/// Sets up a non-blocking rotation
+/**
+ * @param r the rotation state to set up
+ * @param deg angle in degrees to rotate; positive is counter clockwise
+ */
+void rotate_init(rotate_t* r, int deg)
+{
+	TASK_INIT(&r->task);
+	r->deg = deg;
+	r->degree = 0;
+}
+
+/// Advances a rotation by one sensor update
+/**
+ * Cooperative version of rotate_deg().  Call until it returns TASK_DONE.
+ * @param r the rotation state from rotate_init()
+ * @param sensor_data the oi_t struct containing all the robots data
+ * @return TASK_RUNNING while the robot is still turning
+ */
+char rotate_task(rotate_t* r, oi_t* sensor_data)
+{
+	TASK_BEGIN(&r->task);
+	trace(TRACE_ROTATE_START, 0, r->deg);
+	// Turning in place never drives into anything, but it can put a wheel over an edge
+	safety_arm(SAFETY_CLIFF | SAFETY_WHEELDROP);
+	if (r->deg < 0) {
+		//For turning cw
+		oi_set_wheels(-200, 200);
+	} else {
+		//For turning ccw
 		oi_set_wheels(200, -200);
-        while (degree < deg)
-        {
-            oi_update(sensor_data);
-            degree += sensor_data->angle;
+	}
+	// The robot keeps turning a little after the wheels stop, so stop that much early
+	while (r->deg < 0 ? r->degree > r->deg + calib.rotate_overshoot_cw : r->degree < r->deg - calib.rotate_overshoot_ccw) {
+		oi_update(sensor_data);
+		after_update(sensor_data);
+		r->degree += sensor_data->angle;
+		if (safety_tripped()) {
+			break;
+		}
+		TASK_YIELD(&r->task);
+	}
+	safety_disarm();
+	oi_set_wheels(0, 0);
+	trace(TRACE_ROTATE_STOP, 0, r->degree);
+	TASK_END(&r->task);
+}
 
-        }
-    }
-    oi_set_wheels(0, 0);
-	return deg;
+/// Stops a rotation immediately
+/**
+ * @param r the rotation state to cancel
+ */
+void rotate_cancel(rotate_t* r)
+{
+	safety_disarm();
+	oi_set_wheels(0, 0);
+	trace(TRACE_ROTATE_STOP, 0, r->degree);
+	TASK_INIT(&r->task);
 }
 
 /**
@@ -48,6 +122,7 @@ int rotate_deg(int deg, oi_t* sensor_data)
  * the robot has moved. The units may need to be in time.  200 speed will probably not knock over any
  * obstacles, so it will be the default.  It will also optionally scan for color and the cliff/bump sensor can
  * be turned off.
+ * Returns early with STOPPED if a stop is requested from the program UI.
  * @param units distance in mm for the roboto to move
  * @param sensor_data the oi_t struct containing all the robots data
  * @param ignore_cliffbump 1 to ignore, 0 else
@@ -55,122 +130,442 @@ int rotate_deg(int deg, oi_t* sensor_data)
  */
 int move_result(int units, oi_t* sensor_data, char ignore_cliffbump, char ignore_color, stop_reason* reason)
 {
-	stop_reason dummy;
-	if (reason == NULL) {
-		reason = &dummy;
-	}
-    int16_t sum = 0;
-	int temp_result = 0;
-    if(units < 0)
-    {
-		units = -units;
-        oi_set_wheels(-200, -200);
-    }else{
-        oi_set_wheels(200, 200);
-    }
-	
-    while (abs(sum) < units) {
+	move_t m;
+	move_init(&m, units, ignore_cliffbump, ignore_color);
+	while (move_task(&m, sensor_data) == TASK_RUNNING) {
+		if (stop_requested()) {
+			move_cancel(&m);
+			break;
+		}
+	}
+	if (reason != NULL) {
+		*reason = m.reason;
+	}
+	return m.sum;
+}
+
+/// Measures how far a rotation overshoots
+/**
+ * Turns deg degrees without any overshoot correction, then keeps reading the angle for ROTATE_SETTLE_MS after the wheels stop.  The result is
+ * what calib.rotate_overshoot_cw (deg < 0) or calib.rotate_overshoot_ccw (deg > 0) should be.
+ * @param deg angle in degrees to rotate; positive is counter clockwise
+ * @param sensor_data the oi_t struct containing all the robots data
+ * @return the degrees turned past deg, or -1 if a stop or the safety reflex cut the turn short
+ */
+int rotate_overshoot(int deg, oi_t* sensor_data)
+{
+	int8_t cw = calib.rotate_overshoot_cw;
+	int8_t ccw = calib.rotate_overshoot_ccw;
+	rotate_t r;
+	char complete = 1;
+
+	calib.rotate_overshoot_cw = 0;
+	calib.rotate_overshoot_ccw = 0;
+	rotate_init(&r, deg);
+	while (rotate_task(&r, sensor_data) == TASK_RUNNING) {
+		if (stop_requested()) {
+			rotate_cancel(&r);
+			complete = 0;
+			break;
+		}
+	}
+	calib.rotate_overshoot_cw = cw;
+	calib.rotate_overshoot_ccw = ccw;
+	if (!complete || (deg < 0 ? r.degree > deg : r.degree < deg)) {
+		return -1;
+	}
+	// The wheels are stopped; add up what the robot still turns
+	uint32_t stopped = millis();
+	while (millis() - stopped < ROTATE_SETTLE_MS) {
 		oi_update(sensor_data);
-		if(!ignore_cliffbump) {
-			temp_result = read_cliffs(sensor_data, reason);
-			if(!temp_result) {
-				temp_result += read_bumps(sensor_data, reason);
-			}
-			if(temp_result) {
-				return sum + temp_result;
+		after_update(sensor_data);
+		r.degree += sensor_data->angle;
+	}
+	int past = deg < 0 ? deg - r.degree : r.degree - deg;
+	return past > 0 ? past : 0;
+}
+
+/// Sets up a non-blocking move
+/**
+ * @param m the move state to set up
+ * @param units distance in mm for the roboto to move
+ * @param ignore_cliffbump 1 to ignore, 0 else
+ * @param ignore_color 1 to ignore, 0 else
+ */
+void move_init(move_t* m, int units, char ignore_cliffbump, char ignore_color)
+{
+	TASK_INIT(&m->task);
+	m->units = units;
+	m->sum = 0;
+	m->backup = 0;
+	m->ignore_cliffbump = ignore_cliffbump;
+	m->ignore_color = ignore_color;
+	m->radar = 0;
+	m->reason = NONE;
+	m->clear = 0;
+	m->speed = 0;
+}
+
+/// Sweeps the IR over the lane ahead during a move
+/**
+ * Call after move_init() on a forward move.  The servo swings over the sector ahead while the robot drives, and the move ends
+ * RADAR_CLEARANCE_MM short of anything found in its lane, with the reason OBSTACLE and without backing up.  Ignored for backward moves.
+ * Nothing else may use the servo until the move is done.
+ * The speed is governed too: the robot speeds up where the map knows the lane is clear, see govern_speed().
+ * @param m the move state from move_init()
+ */
+void move_radar(move_t* m)
+{
+	m->radar = 1;
+}
+
+/// Moves forward while watching the lane ahead with the IR
+/**
+ * Blocking version of a move_radar() move.  Returns early with STOPPED if a stop is requested from the program UI.
+ * @param units distance in mm to move forward
+ * @param sensor_data the oi_t struct containing all the robots data
+ * @param reason (return) why the move ended, OBSTACLE if it was cut short by something in the lane
+ * @return the distance moved in mm
+ */
+int move_ahead(int units, oi_t* sensor_data, stop_reason* reason)
+{
+	move_t m;
+	move_init(&m, units, 0, 0);
+	move_radar(&m);
+	while (move_task(&m, sensor_data) == TASK_RUNNING) {
+		if (stop_requested()) {
+			move_cancel(&m);
+			break;
+		}
+	}
+	*reason = m.reason;
+	return m.sum;
+}
+
+/// Advances a move by one sensor update
+/**
+ * Cooperative version of move_result().  Call until it returns TASK_DONE, then read the distance moved from m->sum and the reason from m->reason.
+ * If a bump, cliff, or color is detected, the robot backs up 10 cm ignoring all sensors before the task finishes.
+ * @param m the move state from move_init()
+ * @param sensor_data the oi_t struct containing all the robots data
+ * @return TASK_RUNNING while the robot is still moving
+ */
+char move_task(move_t* m, oi_t* sensor_data)
+{
+	TASK_BEGIN(&m->task);
+	trace(TRACE_MOVE_START, 0, m->units);
+	safety_arm(m->ignore_cliffbump ? 0 : SAFETY_ALL);
+	if (m->units < 0) {
+		m->units = -m->units;
+		m->radar = 0;
+		oi_set_wheels(-200, -200);
+	} else {
+		oi_set_wheels(200, 200);
+		m->speed = 200;
+	}
+	if (m->radar) {
+		radar_start();
+		m->start_ms = millis();
+		update_clearance(m);
+	}
+
+	while (abs(m->sum) < m->units) {
+		oi_update(sensor_data);
+		after_update(sensor_data);
+		if (!m->ignore_cliffbump) {
+			// The reflex may have stopped the wheels between updates, after the sensor has cleared again
+			if (check_safety(&m->reason) || check_cliffs(sensor_data, &m->reason) || check_bumps(sensor_data, &m->reason)) {
+				break;
 			}
 		}
-        if(!ignore_color)
-        {
-			temp_result += read_cliff_signals(sensor_data);
-			if(temp_result) {
-				*reason = COLOR;
-				return sum + temp_result;
+		if (!m->ignore_color) {
+			PROF_BEGIN(PROF_CLIFF_SIGNALS);
+			char color = check_cliff_signals(sensor_data);
+			PROF_END(PROF_CLIFF_SIGNALS);
+			if (color) {
+				m->reason = COLOR;
+				break;
 			}
-        }
-        sum += sensor_data->distance;
-    }
-    oi_set_wheels(0, 0);
-	*reason = NONE;
-	return sum;
+		}
+		m->sum += sensor_data->distance;
+		if (m->radar) {
+			check_radar(m);
+			govern_speed(m);
+		}
+		TASK_YIELD(&m->task);
+	}
+
+	safety_disarm();
+	if (m->radar) {
+		radar_stop();
+		record_leg(m);
+	}
+	// A move cut short by the radar already stopped clear of the obstacle
+	if (m->reason != NONE && m->reason != OBSTACLE) {
+		// Back up ten centimeters without looking for color, bumps or cliffs
+		oi_set_wheels(-200, -200);
+		while (abs(m->backup) < 100) {
+			TASK_YIELD(&m->task);
+			oi_update(sensor_data);
+			after_update(sensor_data);
+			m->backup += sensor_data->distance;
+		}
+		m->sum += m->backup;
+	}
+	oi_set_wheels(0, 0);
+	trace(TRACE_MOVE_STOP, m->reason, m->sum);
+	TASK_END(&m->task);
+}
+
+/// Stops a move immediately
+/**
+ * Stops the wheels without backing up and sets the reason to STOPPED.
+ * @param m the move state to cancel
+ */
+void move_cancel(move_t* m)
+{
+	safety_disarm();
+	if (m->radar) {
+		radar_stop();
+	}
+	oi_set_wheels(0, 0);
+	m->reason = STOPPED;
+	trace(TRACE_MOVE_STOP, m->reason, m->sum);
+	TASK_INIT(&m->task);
+}
+
+/// Housekeeping after every OI update in a motion task
+/**
+ * Gives the safety reflex the full update first, then feeds the pose, telemetry and the trace, and lets a long song move on to its next segment while the
+ * OI link is free.
+ * @param sensor_data the freshly updated sensor data
+ */
+static void after_update(oi_t* sensor_data)
+{
+	safety_check(sensor_data);
+	pose_update(sensor_data);
+	telemetry_update(sensor_data);
+	trace_anomalies(sensor_data);
+	sound_poll();
+}
+
+/// Shortens a move when the radar sees something in the lane
+/**
+ * Takes the next radar reading if the servo is ready.  A reading in the lane moves the end of the move to RADAR_CLEARANCE_MM short of it, or to
+ * where the robot is now if it is already that close.
+ * @param m the running move
+ */
+static void check_radar(move_t* m)
+{
+	radar_sample_t sample;
+	int32_t ahead;
+	if (!radar_poll(&sample)) {
+		return;
+	}
+	// The reading is in the map now, and may have shown more of the lane to be clear
+	update_clearance(m);
+	if (!radar_in_corridor(&sample, &ahead)) {
+		return;
+	}
+	int32_t end = abs(m->sum) + ahead - RADAR_CLEARANCE_MM;
+	if (end < m->units) {
+		m->units = end > abs(m->sum) ? end : abs(m->sum);
+		m->reason = OBSTACLE;
+		trace(TRACE_RADAR_HIT, sample.angle, ahead);
+	}
+}
+
+/// Works out how far the lane ahead is known to be clear
+/**
+ * Looks in the map, which has the last scan and every radar reading since, for the first point in the robot's lane that is not known to be
+ * free, out to MOVE_SAFE_MM past the end of the move.
+ * @param m the running move
+ */
+static void update_clearance(move_t* m)
+{
+	int done = abs(m->sum);
+	m->clear = done + grid_clear_length(pose_get()->heading, RADAR_CORRIDOR_MM, m->units - done + MOVE_SAFE_MM);
+}
+
+/// Sets the wheel speed for the room left ahead
+/**
+ * The robot may go as fast as it can while still slowing to MOVE_SAFE_SPEED at MOVE_DECEL by the time it is MOVE_SAFE_MM from the end of the
+ * known clear lane, or MOVE_STOP_MM from the end of the move, v^2 = v0^2 + 2 a d, up to MOVE_MAX_SPEED.  The end of the move stays at the safe
+ * speed so it stops where it did before.
+ * @param m the running move
+ */
+static void govern_speed(move_t* m)
+{
+	int32_t done = abs(m->sum);
+	int32_t room = m->clear - MOVE_SAFE_MM - done;
+	if (m->units - MOVE_STOP_MM - done < room) {
+		room = m->units - MOVE_STOP_MM - done;
+	}
+	int16_t speed = MOVE_SAFE_SPEED;
+	if (room > 0) {
+		uint16_t v = isqrt32((uint32_t) MOVE_SAFE_SPEED * MOVE_SAFE_SPEED + 2UL * MOVE_DECEL * room);
+		speed = v < MOVE_MAX_SPEED ? v / MOVE_SPEED_STEP * MOVE_SPEED_STEP : MOVE_MAX_SPEED;
+	}
+	// Do not start the wheels again behind the reflex's back; the move loop sees the trip on the next update
+	if (speed != m->speed && !safety_tripped()) {
+		m->speed = speed;
+		oi_set_wheels(speed, speed);
+	}
+}
+
+/// Adds a finished governed move to the speed statistics
+/**
+ * The time saved is against driving the same distance at MOVE_SAFE_SPEED all the way, as every move did before the governor.
+ * @param m the move, before any backing up
+ */
+static void record_leg(move_t* m)
+{
+	uint32_t ms = millis() - m->start_ms;
+	uint16_t mm = abs(m->sum);
+	int32_t saved = (int32_t) mm * 1000 / MOVE_SAFE_SPEED - (int32_t) ms;
+
+	stats.legs++;
+	stats.mm += mm;
+	stats.ms += ms;
+	stats.saved_ms += saved;
+	trace(TRACE_LEG, ms ? (uint32_t) mm * 100 / ms : 0, saved);
+}
+
+/// The speed governor statistics
+const speed_stats_t* speed_stats(void)
+{
+	return &stats;
+}
+
+/// Clears the speed governor statistics
+void speed_reset_stats(void)
+{
+	stats = (speed_stats_t) {0};
 }
 
-///Reads the bumper sensors and backs up the robot.
+/// Logs sensor readings that should not happen
+/**
+ * Records wheel drops and distance or angle deltas that are too large for one update at our speeds (~10 mm / ~5 degrees per update), which
+ * usually means a corrupted OI frame.
+ * @param sensor_data the freshly updated sensor data
+ */
+static void trace_anomalies(oi_t* sensor_data)
+{
+	if (sensor_data->wheeldrop_left || sensor_data->wheeldrop_right || sensor_data->wheeldrop_caster) {
+		trace(TRACE_ANOMALY, ANOMALY_WHEEL_DROP, 0);
+	}
+	if (abs(sensor_data->distance) > 100) {
+		trace(TRACE_ANOMALY, ANOMALY_ODOMETRY, sensor_data->distance);
+	}
+	if (abs(sensor_data->angle) > 45) {
+		trace(TRACE_ANOMALY, ANOMALY_ODOMETRY, sensor_data->angle);
+	}
+}
+
+///Checks the bumper sensors
 /**
- * If something has been bumped into, the robot will stop and back up a little. When the robot is backing up, the robot
- * will not look for color, bumps or cliffs.
  * @param sensor_data the oi_t struct containing all the robots data
+ * @param reason (return) set to the bump side if a bump is found
+ * @return 1 if something has been bumped into, 0 else
  */
-int read_bumps(oi_t* sensor_data, stop_reason* reason)
+char check_bumps(oi_t* sensor_data, stop_reason* reason)
 {
     if (sensor_data->bumper_left) {
 		*reason = BUMP_L;
-        return move_result(-100,sensor_data,1,1,NULL); //should move ten centimeters.
+        return 1;
     }
     if (sensor_data->bumper_right) {
 		*reason = BUMP_R;
-        return move_result(-100,sensor_data,1,1,NULL); //should move ten centimeters.
+        return 1;
     }
     return 0;
 }
 
-///Reads the register values for the cliff sensors and backs up the robot if cliff
+/// Checks if the safety reflex stopped the wheels
 /**
- * When a cliff is sensed to the front right/left or the right/left, the robot will stop and back up a little. When the
- * robot is backing up, the robot will not look for color, bumps or cliffs.
- * @param sensor_data the oi_t struct containing all the robots data
+ * @param reason (return) set to what tripped the reflex
+ * @return 1 if the reflex tripped, 0 else
  */
-int read_cliffs(oi_t* sensor_data, stop_reason* reason)
+static char check_safety(stop_reason* reason)
 {
-    if (sensor_data->cliff_left) {
-		*reason = CLIFF_L;
-        return move_result(-100,sensor_data,1,1,NULL); //should move ten centimeters.
-    }
-    if (sensor_data->cliff_frontleft) {
+	uint8_t trips = safety_tripped();
+	if (!trips) {
+		return 0;
+	}
+	if (trips & SAFETY_CLIFF_L) {
 		*reason = CLIFF_L;
-        return move_result(-100,sensor_data,1,1,NULL); //should move ten centimeters.
-    }
-    if (sensor_data->cliff_right) {
+	} else if (trips & SAFETY_CLIFF_R) {
 		*reason = CLIFF_R;
-        return move_result(-100,sensor_data,1,1,NULL); //should move ten centimeters.
+	} else if (trips & SAFETY_BUMP_L) {
+		*reason = BUMP_L;
+	} else if (trips & SAFETY_BUMP_R) {
+		*reason = BUMP_R;
+	} else {
+		*reason = WHEEL_DROP;
+	}
+	return 1;
+}
+
+///Checks the register values for the cliff sensors
+/**
+ * A cliff to the front right/left or the right/left counts.
+ * @param sensor_data the oi_t struct containing all the robots data
+ * @param reason (return) set to the cliff side if a cliff is found
+ * @return 1 if a cliff has been found, 0 else
+ */
+char check_cliffs(oi_t* sensor_data, stop_reason* reason)
+{
+    if (sensor_data->cliff_left || sensor_data->cliff_frontleft) {
+		*reason = CLIFF_L;
+        return 1;
     }
-    if (sensor_data->cliff_frontright) {
+    if (sensor_data->cliff_right || sensor_data->cliff_frontright) {
 		*reason = CLIFF_R;
-        return move_result(-100,sensor_data,1,1,NULL); //should move ten centimeters.
+        return 1;
     }
     return 0;
 }
 
-///Reads the ground color.  If abnormal, backs up
+///Checks the ground color
 /**
- * When a color is sensed in the cliff signals, and the value is greater than 500, the robot stops and backs up,
- * ignoring color and cliffs and bumps.
+ * A color is detected when a cliff signal is more than twice its running average of the last five readings.  Must be called on every sensor
+ * update while color is being watched so the averages stay current.  The averages start from the baselines in the calibration record when it has
+ * them, so an edge can be found from the first reading; otherwise they start from the first reading.  Readings taken while
+ * a sensor's cliff flag is set are left out of its average.
  * @param sensor_data the oi_t struct containing all the robots data
+ * @return 1 if a color edge has been found, 0 else
  */
-int read_cliff_signals( oi_t* sensor_data)
+char check_cliff_signals(oi_t* sensor_data)
 {
-	int result = 0;
+	char result = 0;
 	static int i=0;
-	static char initialized = 0;
-	static uint16_t average_left_signal=0;
-	static uint16_t average_right_signal=0;
-	static uint16_t average_fleft_signal=0;
-	static uint16_t average_fright_signal=0;
 	static uint16_t last_left_signal[5];
 	static uint16_t last_fleft_signal[5];
 	static uint16_t last_fright_signal[5];
 	static uint16_t last_right_signal[5];
-	lprintf("%d, %d, %d, %d",average_left_signal,average_fleft_signal,average_right_signal,average_fright_signal);
+	lprintf_P(PSTR("%d, %d, %d, %d"),average_left_signal,average_fleft_signal,average_right_signal,average_fright_signal);
+
+	if (!initialized && calib.cliff_baseline[0]) {
+		average_left_signal = calib.cliff_baseline[0];
+		average_fleft_signal = calib.cliff_baseline[1];
+		average_fright_signal = calib.cliff_baseline[2];
+		average_right_signal = calib.cliff_baseline[3];
+		for(int k=0;k<5;k++)
+		{
+			last_left_signal[k]=average_left_signal;
+			last_fleft_signal[k]=average_fleft_signal;
+			last_right_signal[k]=average_right_signal;
+			last_fright_signal[k]=average_fright_signal;
+		}
+		initialized = 1;
+	}
 
 	if (initialized) {
-		if (sensor_data->cliff_left_signal > average_left_signal * 2) {
-			result = move_result(-100,sensor_data,1,1,NULL); //should move ten centimeters.
-			} else if (sensor_data->cliff_frontleft_signal > average_fleft_signal * 2) {
-			result = move_result(-100,sensor_data,1,1,NULL); //should move ten centimeters.
-			} else if (sensor_data->cliff_right_signal > average_right_signal * 2) {
-			result = move_result(-100,sensor_data,1,1,NULL); //should move ten centimeters.
-			} else if (sensor_data->cliff_frontright_signal > average_fright_signal * 2) {
-			result = move_result(-100,sensor_data,1,1,NULL); //should move ten centimeters.
+		if (sensor_data->cliff_left_signal > average_left_signal * 2 ||
+				sensor_data->cliff_frontleft_signal > average_fleft_signal * 2 ||
+				sensor_data->cliff_right_signal > average_right_signal * 2 ||
+				sensor_data->cliff_frontright_signal > average_fright_signal * 2) {
+			result = 1;
 		}
 	}
 	else
@@ -185,10 +580,20 @@ int read_cliff_signals( oi_t* sensor_data)
 		}
 		
 	}
-	last_left_signal[i] = sensor_data->cliff_left_signal;
-	last_fleft_signal[i] = sensor_data->cliff_frontleft_signal;
-	last_fright_signal[i] = sensor_data->cliff_frontright_signal;
-	last_right_signal[i] = sensor_data->cliff_right_signal;
+	// A sensor over a drop keeps its old reading so the drop does not drag its average down; the floor afterwards would then look like color.
+	// Any other reading goes in, however low, so the averages follow a darker floor than the calibrated one
+	if (!sensor_data->cliff_left) {
+		last_left_signal[i] = sensor_data->cliff_left_signal;
+	}
+	if (!sensor_data->cliff_frontleft) {
+		last_fleft_signal[i] = sensor_data->cliff_frontleft_signal;
+	}
+	if (!sensor_data->cliff_frontright) {
+		last_fright_signal[i] = sensor_data->cliff_frontright_signal;
+	}
+	if (!sensor_data->cliff_right) {
+		last_right_signal[i] = sensor_data->cliff_right_signal;
+	}
 	average_left_signal = 0;
 	average_fleft_signal = 0;
 	average_right_signal = 0;
@@ -208,3 +613,18 @@ int read_cliff_signals( oi_t* sensor_data)
 	initialized = 1;
 	return result;
 }
+
+/// The cliff signal averages check_cliff_signals() has learned
+/**
+ * Used to save the baselines to the calibration record.
+ * @param baseline where to put the averages: left, front left, front right, right
+ * @return 1 if the averages are valid, 0 if check_cliff_signals() has not run yet
+ */
+char cliff_baselines(uint16_t* baseline)
+{
+	baseline[0] = average_left_signal;
+	baseline[1] = average_fleft_signal;
+	baseline[2] = average_fright_signal;
+	baseline[3] = average_right_signal;
+	return initialized;
+}
@@ -1,5 +1,6 @@
 #include <avr/io.h>
 #include "lib/open_interface.h"
+#include "task.h"
 
 #ifndef MOVEMENT_H_
 #define MOVEMENT_H_
@@ -8,14 +9,76 @@
 /**
  * Enum describing why the robot stopped moving.
  */
-typedef enum {BUMP_L = 0, BUMP_R = 1, CLIFF_L = 2, CLIFF_R = 3, COLOR = 4, NONE = 5} stop_reason;
-extern const char* stop_reason_descrip[];
+typedef enum {BUMP_L = 0, BUMP_R = 1, CLIFF_L = 2, CLIFF_R = 3, COLOR = 4, NONE = 5, STOPPED = 6, WHEEL_DROP = 7, OBSTACLE = 8} stop_reason;
+// Room for the longest description, in program memory; print with %S
+#define STOP_REASON_LEN 11
+extern const char stop_reason_descrip[][STOP_REASON_LEN];
+
+// Speed governor for move_radar() moves, mm/s and mm.  The robot drives at MOVE_SAFE_SPEED within MOVE_SAFE_MM of anything the map does
+// not know to be clear, and within MOVE_STOP_MM of the end of the move, and may speed up to MOVE_MAX_SPEED where there is room to slow down
+// again at MOVE_DECEL mm/s^2.  Speeds are commanded in steps of MOVE_SPEED_STEP to keep the OI traffic down.
+#define MOVE_SAFE_SPEED 200
+#define MOVE_MAX_SPEED 400
+#define MOVE_DECEL 400
+#define MOVE_SAFE_MM 250
+#define MOVE_STOP_MM 100
+#define MOVE_SPEED_STEP 25
+
+// rotate_overshoot() turns this far, and waits this long after the wheels stop for the robot to settle
+#define ROTATE_CAL_DEG 90
+#define ROTATE_SETTLE_MS 500
+
+/**
+ * State of a non-blocking move.  See move_task().
+ */
+typedef struct {
+	task_t task;
+	int units;
+	int16_t sum;
+	int16_t backup;
+	char ignore_cliffbump;
+	char ignore_color;
+	char radar;
+	stop_reason reason;
+	int clear;			// mm from the start of the move known to be clear, when the speed is governed
+	int16_t speed;		// mm/s last commanded
+	uint32_t start_ms;
+} move_t;
+
+/// Speed governor statistics, over the governed moves since reset
+typedef struct {
+	uint16_t legs;
+	uint32_t mm;			// distance driven
+	uint32_t ms;			// time taken
+	int32_t saved_ms;		// time the same distance takes at MOVE_SAFE_SPEED, less the time taken
+} speed_stats_t;
+
+/**
+ * State of a non-blocking rotation.  See rotate_task().
+ */
+typedef struct {
+	task_t task;
+	int deg;
+	int degree;
+} rotate_t;
 
 int rotate_deg(int deg, oi_t* sensor_data);
+void rotate_init(rotate_t* r, int deg);
+char rotate_task(rotate_t* r, oi_t* sensor_data);
+void rotate_cancel(rotate_t* r);
+int rotate_overshoot(int deg, oi_t* sensor_data);
 int move_result(int units, oi_t* sensor_data, char ignore_cliffbump, char ignore_color, stop_reason* reason);
-int read_bumps(oi_t* sensor_data, stop_reason* reason);
-int read_cliffs(oi_t* sensor_data, stop_reason* reason);
-int read_cliff_signals( oi_t* sensor_data);
+void move_init(move_t* m, int units, char ignore_cliffbump, char ignore_color);
+void move_radar(move_t* m);
+int move_ahead(int units, oi_t* sensor_data, stop_reason* reason);
+char move_task(move_t* m, oi_t* sensor_data);
+void move_cancel(move_t* m);
+char check_bumps(oi_t* sensor_data, stop_reason* reason);
+char check_cliffs(oi_t* sensor_data, stop_reason* reason);
+char check_cliff_signals(oi_t* sensor_data);
+char cliff_baselines(uint16_t* baseline);
+const speed_stats_t* speed_stats(void);
+void speed_reset_stats(void);
 
 
 #endif /* MOVEMENT_H_ */
\ No newline at end of file
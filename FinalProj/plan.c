@@ -0,0 +1,215 @@
+/**
+ * plan.c: wavefront path planner
+ *
+ * Plans a way around the objects of one scan on a small grid centered on the robot.  Objects are grown by the robot's clearance, then a
+ * wavefront is spread out from the goal by repeated sweeps over the grid, which needs no queue, and the path follows the wavefront down from
+ * the robot.  The sweeps stop as soon as one leaves the robot's cell reached and unchanged, usually after a few passes instead of the
+ * PLAN_MAX_PASSES worst case (288k neighbor checks).  Straight runs of the path are merged, so the robot turns only where the path bends.
+ */
+
+#include <stdlib.h>
+#include "plan.h"
+#include "pose.h"
+#include "bluetooth.h"
+#include "lib/trig.h"
+#include "lib/prof.h"
+
+#define PLAN_HALF_MM (PLAN_SIZE * PLAN_CELL_MM / 2)
+#define BLOCKED 0xFF
+#define UNREACHED 0xFE
+// Cost of a step to a neighbor: 2 straight, 3 diagonal, close to the real 1 : 1.41
+#define STEP_COST(da, dl) ((da) && (dl) ? 3 : 2)
+
+// Wavefront distance of each cell from the goal, in half cells
+static uint8_t cost[PLAN_SIZE][PLAN_SIZE];
+
+static void block_object(const obj_t* obj, int32_t goal_ahead, int32_t goal_left);
+static char spread(void);
+static uint8_t cost_at(int a, int l);
+static void cell_center(uint8_t a, uint8_t l, int32_t* ahead, int32_t* left);
+
+/// Plans a path from the robot to the goal around the objects of a scan
+/**
+ * The cells of the grid are indexed by [ahead][left] in the robot's frame, with the robot at the middle.
+ * @param objects the objects from the scan
+ * @param count the number of objects
+ * @param goal_angle the servo angle of the goal in degrees
+ * @param goal_dist the distance to the goal in cm
+ * @param path (return) up to PLAN_MAX_WAYPOINTS points, the last one is the goal
+ * @return the number of waypoints, or 0 if there is no way to the goal on the grid
+ */
+uint8_t plan_path(obj_t* objects, int count, int goal_angle, int goal_dist, waypoint_t* path)
+{
+	int32_t goal_ahead = ((int32_t) goal_dist * 10 * sin_q14(goal_angle)) >> TRIG_SHIFT;
+	int32_t goal_left = -(((int32_t) goal_dist * 10 * cos_q14(goal_angle)) >> TRIG_SHIFT);
+	if (abs(goal_ahead) >= PLAN_HALF_MM || abs(goal_left) >= PLAN_HALF_MM) {
+		return 0;
+	}
+	for (uint8_t a = 0; a < PLAN_SIZE; a++) {
+		for (uint8_t l = 0; l < PLAN_SIZE; l++) {
+			cost[a][l] = UNREACHED;
+		}
+	}
+	for (int i = 0; i < count; i++) {
+		block_object(&objects[i], goal_ahead, goal_left);
+	}
+	uint8_t ga = (goal_ahead + PLAN_HALF_MM) / PLAN_CELL_MM;
+	uint8_t gl = (goal_left + PLAN_HALF_MM) / PLAN_CELL_MM;
+	// The robot is where it is, even if a clearance overlaps it
+	cost[PLAN_SIZE / 2][PLAN_SIZE / 2] = UNREACHED;
+	cost[ga][gl] = 0;
+
+	// Stop once a pass leaves the robot's cell reached and as it was.  A later pass could still shorten a winding detour, but any reached
+	// cell already has a neighbor closer to the goal, so the walk below always gets there.
+	uint8_t a = PLAN_SIZE / 2;
+	uint8_t l = PLAN_SIZE / 2;
+	PROF_BEGIN(PROF_PLAN_SPREAD);
+	for (uint8_t pass = 0; pass < PLAN_MAX_PASSES; pass++) {
+		uint8_t before = cost[a][l];
+		if (!spread() || (before < UNREACHED && cost[a][l] == before)) {
+			break;
+		}
+	}
+	PROF_END(PROF_PLAN_SPREAD);
+	if (cost[a][l] >= UNREACHED) {
+		return 0;
+	}
+
+	// Walk down the wavefront; a waypoint goes wherever the direction changes
+	uint8_t n = 0;
+	int8_t last_da = 0, last_dl = 0;
+	while (cost[a][l] != 0) {
+		// Every reached cell has a neighbor it was reached from; keep going straight if that one will do
+		uint8_t best = cost[a][l];
+		int8_t best_da = 0, best_dl = 0;
+		if ((last_da || last_dl) && cost_at(a + last_da, l + last_dl) + STEP_COST(last_da, last_dl) == best) {
+			best_da = last_da;
+			best_dl = last_dl;
+		} else {
+			for (int8_t da = -1; da <= 1; da++) {
+				for (int8_t dl = -1; dl <= 1; dl++) {
+					if ((da || dl) && cost_at(a + da, l + dl) + STEP_COST(da, dl) <= best) {
+						best = cost_at(a + da, l + dl) + STEP_COST(da, dl);
+						best_da = da;
+						best_dl = dl;
+					}
+				}
+			}
+		}
+		if ((best_da != last_da || best_dl != last_dl) && (last_da || last_dl)) {
+			if (n == PLAN_MAX_WAYPOINTS - 1) {
+				return 0;
+			}
+			int32_t ahead, left;
+			cell_center(a, l, &ahead, &left);
+			pose_from_robot(ahead, left, &path[n].x, &path[n].y);
+			n++;
+		}
+		last_da = best_da;
+		last_dl = best_dl;
+		a += best_da;
+		l += best_dl;
+	}
+	pose_from_robot(goal_ahead, goal_left, &path[n].x, &path[n].y);
+	return n + 1;
+}
+
+/// Drives along a path
+/**
+ * Turns toward each waypoint in turn and drives to it with the normal bump, cliff and color checks.  Returns early if a stop is requested.
+ * @param path the waypoints from plan_path()
+ * @param n the number of waypoints
+ * @param sensor_data the oi_t struct containing all the robots data
+ * @return why the last move stopped, NONE if the whole path was driven
+ */
+stop_reason plan_follow(const waypoint_t* path, uint8_t n, oi_t* sensor_data)
+{
+	stop_reason reason = NONE;
+	for (uint8_t i = 0; i < n && reason == NONE; i++) {
+		int32_t ahead, left;
+		pose_to_robot(path[i].x, path[i].y, &ahead, &left);
+		int16_t turn = atan2_deg(left, ahead);
+		rotate_deg(turn, sensor_data);
+		// Distance along the new heading, from where the robot ended up pointing
+		pose_to_robot(path[i].x, path[i].y, &ahead, &left);
+		if (ahead > 0) {
+			move_result(ahead, sensor_data, 0, 0, &reason);
+		}
+		if (stop_requested()) {
+			reason = STOPPED;
+		}
+	}
+	return reason;
+}
+
+/// Marks the cells closer than the clearance to an object as blocked
+/**
+ * The goal posts are left out, since the robot has to drive between them; the path ends in the middle.
+ */
+static void block_object(const obj_t* obj, int32_t goal_ahead, int32_t goal_left)
+{
+	int32_t ahead = ((int32_t) obj->dist * 10 * sin_q14(obj_angle(obj))) >> TRIG_SHIFT;
+	int32_t left = -(((int32_t) obj->dist * 10 * cos_q14(obj_angle(obj))) >> TRIG_SHIFT);
+	if ((ahead - goal_ahead) * (ahead - goal_ahead) + (left - goal_left) * (left - goal_left) < PLAN_POST_MM * PLAN_POST_MM) {
+		return;
+	}
+	int32_t radius = (((int32_t) obj->width_q4 * 5) >> OBJ_WIDTH_SHIFT) + PLAN_CLEARANCE_MM;
+	for (uint8_t a = 0; a < PLAN_SIZE; a++) {
+		for (uint8_t l = 0; l < PLAN_SIZE; l++) {
+			int32_t ca, cl;
+			cell_center(a, l, &ca, &cl);
+			if ((ca - ahead) * (ca - ahead) + (cl - left) * (cl - left) < radius * radius) {
+				cost[a][l] = BLOCKED;
+			}
+		}
+	}
+}
+
+/// One forward and one backward sweep of the wavefront
+/**
+ * @return 1 if any cell changed
+ */
+static char spread(void)
+{
+	char changed = 0;
+	for (uint8_t sweep = 0; sweep < 2; sweep++) {
+		for (uint16_t i = 0; i < PLAN_SIZE * PLAN_SIZE; i++) {
+			uint16_t k = sweep ? PLAN_SIZE * PLAN_SIZE - 1 - i : i;
+			uint8_t a = k / PLAN_SIZE;
+			uint8_t l = k % PLAN_SIZE;
+			if (cost[a][l] == BLOCKED) {
+				continue;
+			}
+			uint8_t best = cost[a][l];
+			for (int8_t da = -1; da <= 1; da++) {
+				for (int8_t dl = -1; dl <= 1; dl++) {
+					uint16_t via = cost_at(a + da, l + dl) + STEP_COST(da, dl);
+					if (via < best) {
+						best = via;
+					}
+				}
+			}
+			if (best != cost[a][l]) {
+				cost[a][l] = best;
+				changed = 1;
+			}
+		}
+	}
+	return changed;
+}
+
+/// The wavefront distance of a cell, BLOCKED off the grid
+static uint8_t cost_at(int a, int l)
+{
+	if (a < 0 || l < 0 || a >= PLAN_SIZE || l >= PLAN_SIZE) {
+		return BLOCKED;
+	}
+	return cost[a][l];
+}
+
+/// Middle of a cell in the robot's frame, in mm
+static void cell_center(uint8_t a, uint8_t l, int32_t* ahead, int32_t* left)
+{
+	*ahead = (int32_t) a * PLAN_CELL_MM + PLAN_CELL_MM / 2 - PLAN_HALF_MM;
+	*left = (int32_t) l * PLAN_CELL_MM + PLAN_CELL_MM / 2 - PLAN_HALF_MM;
+}
@@ -0,0 +1,30 @@
+#ifndef PLAN_H_
+#define PLAN_H_
+
+#include <stdint.h>
+#include "scan.h"
+#include "movement.h"
+
+// Cells per side of the planning grid and their size; the grid is centered on the robot
+#define PLAN_SIZE 20
+#define PLAN_CELL_MM 100
+// How far the robot's center has to stay from an object's edge: its radius plus a margin
+#define PLAN_CLEARANCE_MM 200
+// Objects this close to the goal are taken as its posts (goal.h accepts posts up to 80 cm apart)
+#define PLAN_POST_MM 420
+// Most waypoints in a path, and the most passes of the wavefront before giving up
+#define PLAN_MAX_WAYPOINTS 8
+#define PLAN_MAX_PASSES (2 * PLAN_SIZE)
+
+/**
+ * A point to drive to, in the pose frame.
+ */
+typedef struct {
+	int32_t x;	// mm
+	int32_t y;	// mm
+} waypoint_t;
+
+uint8_t plan_path(obj_t* objects, int count, int goal_angle, int goal_dist, waypoint_t* path);
+stop_reason plan_follow(const waypoint_t* path, uint8_t n, oi_t* sensor_data);
+
+#endif /* PLAN_H_ */
@@ -0,0 +1,100 @@
+/**
+ * pose.c: dead reckoning
+ *
+ * Integrates the distance and angle deltas of every OI update into a position in a fixed frame, so IR readings taken at different places can be
+ * put in one map.  The position is kept in 1/16 mm internally so the rounding of short updates does not add up.
+ */
+
+#include "pose.h"
+#include "lib/trig.h"
+
+// Fraction bits of the internal position
+#define POSE_FRAC 4
+
+static pose_t pose;
+static int32_t x_frac;
+static int32_t y_frac;
+
+/// Makes the current position the origin of the frame
+void pose_reset(void)
+{
+	pose.x = 0;
+	pose.y = 0;
+	pose.heading = 0;
+	x_frac = 0;
+	y_frac = 0;
+}
+
+/// Adds the odometry of an OI update to the pose
+/**
+ * Must be called after every oi_update() while the robot can move, or the pose drifts by whatever was missed.  The distance is applied along the
+ * heading halfway through the update's turn.
+ * @param sensor_data the freshly updated sensor data
+ */
+void pose_update(oi_t* sensor_data)
+{
+	int16_t mid = pose.heading + sensor_data->angle / 2;
+	x_frac += ((int32_t) sensor_data->distance * cos_q14(mid)) >> (TRIG_SHIFT - POSE_FRAC);
+	y_frac += ((int32_t) sensor_data->distance * sin_q14(mid)) >> (TRIG_SHIFT - POSE_FRAC);
+	pose.x = x_frac >> POSE_FRAC;
+	pose.y = y_frac >> POSE_FRAC;
+	pose.heading = wrap_deg(pose.heading + sensor_data->angle);
+}
+
+/// The current pose
+/**
+ * @return the pose; only changes in pose_update() and pose_reset()
+ */
+const pose_t* pose_get(void)
+{
+	return &pose;
+}
+
+/// Puts an IR reading into the pose frame
+/**
+ * The servo angle is 0 to the robot's right, 90 straight ahead and 180 to its left.  The reading is taken from the center of the robot, like
+ * the rest of the scan geometry.
+ * @param angle the servo angle of the reading in degrees
+ * @param dist the IR distance in cm
+ * @param x (return) where the reading hit, in mm
+ * @param y (return) where the reading hit, in mm
+ */
+void pose_project(int angle, int dist, int32_t* x, int32_t* y)
+{
+	int16_t bearing = pose.heading + angle - 90;
+	int32_t mm = (int32_t) dist * 10;
+	*x = pose.x + ((mm * cos_q14(bearing)) >> TRIG_SHIFT);
+	*y = pose.y + ((mm * sin_q14(bearing)) >> TRIG_SHIFT);
+}
+
+/// Puts a point of the pose frame into the robot's own frame
+/**
+ * @param x the point in mm
+ * @param y the point in mm
+ * @param ahead (return) how far the point is in front of the robot in mm, negative if behind it
+ * @param left (return) how far the point is to the robot's left in mm, negative if to its right
+ */
+void pose_to_robot(int32_t x, int32_t y, int32_t* ahead, int32_t* left)
+{
+	int32_t dx = x - pose.x;
+	int32_t dy = y - pose.y;
+	int16_t c = cos_q14(pose.heading);
+	int16_t s = sin_q14(pose.heading);
+	*ahead = (dx * c + dy * s) >> TRIG_SHIFT;
+	*left = (dy * c - dx * s) >> TRIG_SHIFT;
+}
+
+/// Puts a point of the robot's own frame into the pose frame
+/**
+ * @param ahead how far the point is in front of the robot in mm
+ * @param left how far the point is to the robot's left in mm
+ * @param x (return) the point in mm
+ * @param y (return) the point in mm
+ */
+void pose_from_robot(int32_t ahead, int32_t left, int32_t* x, int32_t* y)
+{
+	int16_t c = cos_q14(pose.heading);
+	int16_t s = sin_q14(pose.heading);
+	*x = pose.x + ((ahead * c - left * s) >> TRIG_SHIFT);
+	*y = pose.y + ((ahead * s + left * c) >> TRIG_SHIFT);
+}
@@ -0,0 +1,24 @@
+#ifndef POSE_H_
+#define POSE_H_
+
+#include <stdint.h>
+#include "lib/open_interface.h"
+
+/**
+ * Where the robot is, from odometry.  The frame is fixed where the robot was at reset (or the last pose_reset()): x points the way the robot was
+ * facing, y to its left, and the heading is counterclockwise from x.
+ */
+typedef struct {
+	int32_t x;			// mm
+	int32_t y;			// mm
+	int16_t heading;	// degrees, 0-359
+} pose_t;
+
+void pose_reset(void);
+void pose_update(oi_t* sensor_data);
+const pose_t* pose_get(void);
+void pose_project(int angle, int dist, int32_t* x, int32_t* y);
+void pose_to_robot(int32_t x, int32_t y, int32_t* ahead, int32_t* left);
+void pose_from_robot(int32_t ahead, int32_t left, int32_t* x, int32_t* y);
+
+#endif /* POSE_H_ */
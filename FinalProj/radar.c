@@ -0,0 +1,83 @@
+/**
+ * radar.c: IR sweep while driving
+ *
+ * Swings the servo back and forth over the sector ahead while a move is running and takes a reading whenever the servo has settled.  Each
+ * reading is projected into the pose frame with the odometry of the update it was taken in, so it still lines up with the robot after the robot
+ * has moved on.  The readings also go into the map.  Nothing here blocks; the move task calls radar_poll() after every sensor update.
+ */
+
+#include "radar.h"
+#include "scan.h"
+#include "pose.h"
+#include "grid.h"
+#include "telemetry.h"
+
+static char running = 0;
+static int8_t direction;
+static uint8_t angle;
+
+/// Starts sweeping
+/**
+ * The first reading is taken at RADAR_MIN_DEG once the servo has swung there.
+ */
+void radar_start(void)
+{
+	angle = RADAR_MIN_DEG;
+	direction = RADAR_STEP_DEG;
+	start_servo_pos(angle);
+	running = 1;
+}
+
+/// Takes a reading if the servo has settled and moves it on to the next angle
+/**
+ * @param sample (return) the reading, if one was taken
+ * @return 1 if a reading in range was taken, 0 else
+ */
+char radar_poll(radar_sample_t* sample)
+{
+	if (!running || !servo_settled()) {
+		return 0;
+	}
+	// The servo is already there; dist_at_angle() would wait SERVO_SETTLE_MS again
+	int dist = ir_distance_cm();
+	uint8_t taken = angle;
+	telemetry_ir_sample(taken, dist);
+	grid_ir_sample(taken, dist);
+
+	if (angle + direction > RADAR_MAX_DEG || angle + direction < RADAR_MIN_DEG) {
+		direction = -direction;
+	}
+	angle += direction;
+	start_servo_pos(angle);
+
+	if (dist <= 0 || dist > RADAR_RANGE_CM) {
+		return 0;
+	}
+	sample->angle = taken;
+	sample->dist = dist;
+	pose_project(taken, dist, &sample->x, &sample->y);
+	return 1;
+}
+
+/// Checks if a reading is in the lane ahead of the robot
+/**
+ * Works from the robot's current pose, so a reading from earlier in the sweep is checked against where the robot is now.
+ * @param sample a reading from radar_poll()
+ * @param ahead (return) how far ahead of the robot the reading is in mm, if it is in the lane
+ * @return 1 if the reading is ahead of the robot and less than RADAR_CORRIDOR_MM to either side, 0 else
+ */
+char radar_in_corridor(const radar_sample_t* sample, int32_t* ahead)
+{
+	int32_t left;
+	pose_to_robot(sample->x, sample->y, ahead, &left);
+	return *ahead > 0 && left < RADAR_CORRIDOR_MM && left > -RADAR_CORRIDOR_MM;
+}
+
+/// Stops sweeping
+/**
+ * The servo stays where it is.
+ */
+void radar_stop(void)
+{
+	running = 0;
+}
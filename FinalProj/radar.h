@@ -0,0 +1,32 @@
+#ifndef RADAR_H_
+#define RADAR_H_
+
+#include <stdint.h>
+
+// Sector the servo sweeps while driving, in servo degrees (90 is straight ahead), and the step between readings
+#define RADAR_MIN_DEG 45
+#define RADAR_MAX_DEG 135
+#define RADAR_STEP_DEG 5
+// Readings farther than this are ignored; the IR is too noisy past it
+#define RADAR_RANGE_CM 70
+// Half the width of the lane the robot drives through: its radius plus a margin
+#define RADAR_CORRIDOR_MM 200
+// How far short of an obstacle in the lane a move ends
+#define RADAR_CLEARANCE_MM 100
+
+/**
+ * One IR reading taken while driving, placed in the pose frame with the odometry of the moment it was taken.
+ */
+typedef struct {
+	int32_t x;		// mm
+	int32_t y;		// mm
+	uint8_t angle;	// servo degrees
+	uint8_t dist;	// cm
+} radar_sample_t;
+
+void radar_start(void);
+char radar_poll(radar_sample_t* sample);
+char radar_in_corridor(const radar_sample_t* sample, int32_t* ahead);
+void radar_stop(void);
+
+#endif /* RADAR_H_ */
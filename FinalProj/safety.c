@@ -0,0 +1,201 @@
+/**
+ * safety.c: bump and cliff reflex
+ *
+ * While armed, a software timer queries the bump and cliff packets every SAFETY_PERIOD_MS whenever the link to the Create is idle, and the
+ * response is decoded in the USART1 RX interrupt.  A trip stops the wheels right there, so the reaction time does not depend on what the main
+ * loop is doing.  Full sensor updates from the main loop are checked too (safety_check()).
+ */
+
+#include <util/atomic.h>
+#include "safety.h"
+#include "lib/util.h"
+
+// Bumps and wheel drops, then the four cliff sensors; one byte each
+static const uint8_t packets[] = {7, 9, 10, 11, 12};
+#define PACKET_COUNT sizeof(packets)
+
+static soft_timer_t poll_timer;
+static volatile uint8_t armed = 0;
+static volatile uint8_t tripped = 0;
+static volatile char stop_pending = 0;
+static volatile char in_flight = 0;
+static uint8_t response[PACKET_COUNT];
+static uint8_t received;
+static uint32_t query_ms;
+static uint32_t query_us;
+static uint32_t sample_us;
+static safety_stats_t stats;
+
+static void poll(void);
+static void receive(uint8_t value);
+static void on_idle(void);
+static void trip(uint8_t trips, uint32_t sampled);
+static void try_stop(void);
+
+// Size of the drive command that stops the wheels
+#define STOP_BYTES 5
+
+/// Starts the poll timer
+/**
+ * Call once the Create is in full mode.  Nothing is polled until safety_arm().
+ */
+void safety_init(void) {
+	oi_idle_hook = on_idle;
+	timer_start(&poll_timer, SAFETY_PERIOD_MS, SAFETY_PERIOD_MS, poll);
+}
+
+/// Arms the reflex
+/**
+ * Clears any earlier trip.  Call right before starting the wheels.
+ * @param trips the SAFETY_ bits that stop the wheels
+ */
+void safety_arm(uint8_t trips) {
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		tripped = 0;
+		armed = trips;
+	}
+}
+
+/// Disarms the reflex
+/**
+ * Call before moves that must not be stopped, like backing away from a bump.  The last trip is still reported by safety_tripped().
+ */
+void safety_disarm(void) {
+	armed = 0;
+}
+
+/// What stopped the wheels since safety_arm()
+/**
+ * @return the SAFETY_ bits that tripped, 0 if none
+ */
+uint8_t safety_tripped(void) {
+	return tripped;
+}
+
+/// Checks a full sensor update from the main loop
+/**
+ * Catches a trip as soon as oi_update() has it instead of waiting for the next poll.
+ * @param sensor_data the freshly updated sensor data
+ */
+void safety_check(oi_t* sensor_data) {
+	uint8_t trips = 0;
+	if (sensor_data->bumper_left) trips |= SAFETY_BUMP_L;
+	if (sensor_data->bumper_right) trips |= SAFETY_BUMP_R;
+	if (sensor_data->wheeldrop_left || sensor_data->wheeldrop_right || sensor_data->wheeldrop_caster) trips |= SAFETY_WHEELDROP;
+	if (sensor_data->cliff_left || sensor_data->cliff_frontleft) trips |= SAFETY_CLIFF_L;
+	if (sensor_data->cliff_right || sensor_data->cliff_frontright) trips |= SAFETY_CLIFF_R;
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		trip(trips, micros());
+	}
+}
+
+/// The reflex statistics
+const safety_stats_t* safety_stats(void) {
+	return &stats;
+}
+
+/// Clears the reflex statistics
+void safety_reset_stats(void) {
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		stats = (safety_stats_t) {0};
+	}
+}
+
+/// Poll timer callback; runs in the timer interrupt
+static void poll(void) {
+	if (stop_pending) {
+		try_stop();
+	}
+	if (in_flight) {
+		if (millis() - query_ms < SAFETY_TIMEOUT_MS) {
+			return;
+		}
+		// No answer; give the link back to the main loop
+		oi_rx_hook = 0;
+		in_flight = 0;
+		stats.timeouts++;
+	}
+	if (!armed) {
+		return;
+	}
+	if (!oi_link_idle()) {
+		stats.skipped++;
+		return;
+	}
+	received = 0;
+	in_flight = 1;
+	query_ms = millis();
+	query_us = micros();
+	oi_rx_hook = receive;
+	oi_begin();
+	oi_byte_tx(OI_OPCODE_QUERY_LIST);
+	oi_byte_tx(PACKET_COUNT);
+	for (uint8_t i = 0; i < PACKET_COUNT; i++) {
+		oi_byte_tx(packets[i]);
+	}
+	oi_end();
+}
+
+/// Collects the poll response; runs in the USART1 RX interrupt
+static void receive(uint8_t value) {
+	response[received++] = value;
+	if (received < PACKET_COUNT) {
+		return;
+	}
+	oi_rx_hook = 0;
+	in_flight = 0;
+	stats.polls++;
+
+	uint8_t trips = 0;
+	if (response[0] & 0x02) trips |= SAFETY_BUMP_L;
+	if (response[0] & 0x01) trips |= SAFETY_BUMP_R;
+	if (response[0] & 0x1C) trips |= SAFETY_WHEELDROP;
+	if (response[1] || response[2]) trips |= SAFETY_CLIFF_L;
+	if (response[3] || response[4]) trips |= SAFETY_CLIFF_R;
+	// The sensors were read by the Create right after the query went out
+	trip(trips, query_us);
+}
+
+/// Stops the wheels if an armed trip is seen; interrupts must be disabled
+/**
+ * @param trips the SAFETY_ bits that are active
+ * @param sampled when the sensors were read, for the latency statistics
+ */
+static void trip(uint8_t trips, uint32_t sampled) {
+	trips &= armed;
+	if (!trips) {
+		return;
+	}
+	tripped |= trips;
+	armed = 0;
+	stats.trips++;
+	sample_us = sampled;
+	try_stop();
+}
+
+/// Sends a stop that had to wait for a command to finish
+static void on_idle(void) {
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		if (stop_pending) {
+			try_stop();
+		}
+	}
+}
+
+/// Queues the stop command and records the latency; interrupts must be disabled
+/**
+ * If a command is half sent or the transmit ring is too full, the stop is left pending and goes out from on_idle() when the command ends, or
+ * from the next poll once the ring has drained.
+ */
+static void try_stop(void) {
+	if (oi_sending() || oi_tx_free() < STOP_BYTES) {
+		stop_pending = 1;
+		return;
+	}
+	stop_pending = 0;
+	oi_set_wheels(0, 0);
+	stats.last_us = micros() - sample_us;
+	if (stats.last_us > stats.worst_us) {
+		stats.worst_us = stats.last_us;
+	}
+}
@@ -0,0 +1,39 @@
+#ifndef SAFETY_H_
+#define SAFETY_H_
+
+#include <stdint.h>
+#include "lib/open_interface.h"
+
+// Trips the safety reflex can act on
+#define SAFETY_BUMP_L     0x01
+#define SAFETY_BUMP_R     0x02
+#define SAFETY_WHEELDROP  0x04
+#define SAFETY_CLIFF_L    0x08	// left or front left
+#define SAFETY_CLIFF_R    0x10	// right or front right
+#define SAFETY_BUMP       (SAFETY_BUMP_L | SAFETY_BUMP_R)
+#define SAFETY_CLIFF      (SAFETY_CLIFF_L | SAFETY_CLIFF_R)
+#define SAFETY_ALL        (SAFETY_BUMP | SAFETY_WHEELDROP | SAFETY_CLIFF)
+
+// How often the bump and cliff packets are polled while armed, and how long to wait for the answer
+#define SAFETY_PERIOD_MS 10
+#define SAFETY_TIMEOUT_MS 20
+
+/// Safety reflex statistics
+typedef struct {
+	uint16_t polls;			// queries answered
+	uint16_t skipped;		// polls skipped because the link was busy
+	uint16_t timeouts;		// queries the Create did not answer in time
+	uint16_t trips;			// times the reflex stopped the wheels
+	uint32_t last_us;		// time from the trip being sampled to the stop command being queued, for the last trip
+	uint32_t worst_us;
+} safety_stats_t;
+
+void safety_init(void);
+void safety_arm(uint8_t trips);
+void safety_disarm(void);
+uint8_t safety_tripped(void);
+void safety_check(oi_t* sensor_data);
+const safety_stats_t* safety_stats(void);
+void safety_reset_stats(void);
+
+#endif /* SAFETY_H_ */
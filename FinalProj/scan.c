@@ -1,75 +1,232 @@
 #include <math.h>
-#include <avr/io.h>
-#include <avr/interrupt.h>
+#include <stdlib.h>
 #include "lib/util.h"
+#include "lib/hal.h"
+#include "lib/trig.h"
 #include "scan.h"
+#include "telemetry.h"
+#include "bluetooth.h"
+#include "lib/prof.h"
+#include "trace.h"
+#include "capture.h"
+#include "sound.h"
+#include "calib.h"
+#include "grid.h"
+#include "track.h"
 
-static obj_t scanner[15];
+static obj_t scanner[MAX_OBJECTS];
+static int scanner_count;
+static uint8_t scan_dropped;	// objects found after the table was full
+static task_t scan_state;
+static int scan_angle;
+static char is_measuring;
+static char dropout;			// the last reading was clear but the object may go on
+// The object being measured
+static uint8_t obj_start;
+static uint8_t obj_min, obj_max, obj_samples;
+static uint8_t last_dist;
+static uint8_t median_buf[SCAN_MEDIAN_SAMPLES];
+static uint8_t median_count, median_stride, median_skip;
+static int servo_angle = -1;	// last commanded angle, -1 until the first command
+static uint32_t servo_ready;	// when the servo will have reached servo_angle
 void set_servo_OCR(int ticks);
-int calc_servo_OCR_ticks(float deg);
-int ir_distance_cm(void);
+int calc_servo_OCR_ticks(int deg);
 int ir_ADC_to_cm(int reading);
-int side_angle_side(int angle, int side_len);
+static void object_begin(uint8_t angle, int dist);
+static void object_sample(int dist);
+static void object_end(uint8_t end);
+static uint8_t median_dist(void);
 
 /// Scans the 180 degrees to find objects
 /**
  * Scans from 0 to 180 degrees looking for objects.  It returns an array of objects along with a count.
+ * Returns early with the objects found so far if a stop is requested from the program UI.
  * @param obj_count the number of objects in the array
  */
 obj_t* do_scan(int* obj_count)
 {
-	int ir_dist = 0, start_angle = 0, end_angle = 0;
-	char is_measuring = 0;
-	*obj_count = 0;
-	
-	set_servo_pos(0);
-	wait_ms(1000);
-	
-	for(int angle = 0; angle < 181 && *obj_count <= sizeof(scanner); angle += 1)
+	scan_init();
+	while (scan_task() == TASK_RUNNING && !stop_requested()) {
+		sound_poll();
+	}
+	return scan_objects(obj_count);
+}
+
+/// Sets up a non-blocking scan
+void scan_init(void)
+{
+	TASK_INIT(&scan_state);
+}
+
+/// Advances a scan by one servo step
+/**
+ * Cooperative version of do_scan().  The servo settle time is waited out with deadlines instead of wait_ms(), so a call never blocks; an IR reading
+ * is taken on the first call after the servo has settled.  Call until it returns TASK_DONE, then get the result from scan_objects().
+ * @return TASK_RUNNING while the scan is still sweeping
+ */
+char scan_task(void)
+{
+	int ir_dist;
+	TASK_BEGIN(&scan_state);
+	scanner_count = 0;
+	scan_dropped = 0;
+	is_measuring = 0;
+	trace(TRACE_SCAN_START, 0, 0);
+
+	start_servo_pos(0);
+	// Wait for the servo to swing back to 0; how long depends on where it was
+	TASK_WAIT_UNTIL(&scan_state, servo_settled());
+
+	for(scan_angle = 0; scan_angle < 181; scan_angle += 1)
 	{
-		ir_dist = dist_at_angle(angle);
-				
-		if(is_measuring == 0)
-		{
-			if(ir_dist < 60)
-			{
-				start_angle = angle;
-				is_measuring = 1;
-				scanner[*obj_count].dist = ir_dist;
-			}
+		start_servo_pos(scan_angle);
+		TASK_WAIT_UNTIL(&scan_state, servo_settled());
+		ir_dist = ir_distance_cm();
+		telemetry_ir_sample(scan_angle, ir_dist);
+		grid_ir_sample(scan_angle, ir_dist);
+		if (ir_dist < 0 || ir_dist > 200) {
+			trace(TRACE_ANOMALY, ANOMALY_IR_RANGE, ir_dist);
 		}
-		else
-		{
-			if(ir_dist > 60)
-			{
-				end_angle = angle;
-				is_measuring = 0;
-				scanner[*obj_count].angular_width = end_angle - start_angle;
-				if (scanner[*obj_count].angular_width > 1) {
-					scanner[*obj_count].width = side_angle_side(scanner[*obj_count].angular_width, scanner[*obj_count].dist);
-					scanner[*obj_count].angular_location = (start_angle + end_angle) / 2;
-					(*obj_count)++;
-				}
+
+		if (!is_measuring) {
+			if (ir_dist < SCAN_OBJECT_CM) {
+				object_begin(scan_angle, ir_dist);
 			}
-			else
-			{
-				scanner[*obj_count].dist = (scanner[*obj_count].dist + ir_dist) / 2;
+		} else if (ir_dist < SCAN_OBJECT_CM) {
+			if (dropout && abs(ir_dist - last_dist) > SCAN_MERGE_CM) {
+				// Something else showed up behind the gap: end the object at the gap
+				object_end(scan_angle - 1);
+				object_begin(scan_angle, ir_dist);
+			} else {
+				object_sample(ir_dist);
 			}
+		} else if (!dropout) {
+			dropout = 1;
+		} else {
+			// Two clear readings in a row: the object ended at the first
+			object_end(scan_angle - 1);
 		}
 	}
+	// An object running off the end of the sweep ends there
+	if (is_measuring) {
+		object_end(dropout ? 180 : 181);
+	}
+	trace(TRACE_SCAN_END, scanner_count, scan_dropped);
+	track_update(scanner, scanner_count);
+	TASK_END(&scan_state);
+}
+
+/// The objects found by the last scan
+/**
+ * @param obj_count (return) the number of objects in the array
+ * @return the array of objects
+ */
+obj_t* scan_objects(int* obj_count)
+{
+	*obj_count = scanner_count;
 	return scanner;
 }
 
-/// Side-angle-side calculation on a symmetric triangle to find the far side
+/// The number of objects the last scan found after the object table was full
 /**
- * Applies the side-angle-side formula to calculate the far side.  The two sides are assumed to have the same length.
- * @param angle the angle between the two given sides
- * @param side_len the length of both known sides
- * @return the length of the unknown side
+ * Those objects are not in scan_objects().  Counts up to 255.
  */
-int side_angle_side(int angle, int side_len) {
-	int a = side_len * side_len * 2 - 2 * side_len * side_len * cos(angle * M_PI / 180);
-	return sqrt(a);
+uint8_t scan_overflow(void)
+{
+	return scan_dropped;
+}
+
+/// Starts measuring an object at the current reading
+static void object_begin(uint8_t angle, int dist)
+{
+	is_measuring = 1;
+	obj_start = angle;
+	obj_min = 255;
+	obj_max = 0;
+	obj_samples = 0;
+	median_count = 0;
+	median_stride = 1;
+	median_skip = 0;
+	object_sample(dist);
+}
+
+/// Adds a reading to the object being measured
+/**
+ * Keeps the nearest and farthest reading, and up to SCAN_MEDIAN_SAMPLES readings for the median.  When the buffer fills, every second reading in
+ * it is dropped and from then on only every second reading is kept, so a wide object is still sampled evenly across its whole width.
+ * @param dist the reading in cm, under SCAN_OBJECT_CM
+ */
+static void object_sample(int dist)
+{
+	uint8_t cm = dist < 0 ? 0 : dist;
+
+	dropout = 0;
+	last_dist = cm;
+	obj_samples++;
+	if (cm < obj_min) {
+		obj_min = cm;
+	}
+	if (cm > obj_max) {
+		obj_max = cm;
+	}
+	if (++median_skip < median_stride) {
+		return;
+	}
+	median_skip = 0;
+	if (median_count == SCAN_MEDIAN_SAMPLES) {
+		for (uint8_t i = 0; i < SCAN_MEDIAN_SAMPLES / 2; i++) {
+			median_buf[i] = median_buf[i * 2];
+		}
+		median_count = SCAN_MEDIAN_SAMPLES / 2;
+		median_stride *= 2;
+	}
+	median_buf[median_count++] = cm;
+}
+
+/// Sorts the kept readings of the object being measured and returns the middle one
+static uint8_t median_dist(void)
+{
+	for (uint8_t i = 1; i < median_count; i++) {
+		uint8_t v = median_buf[i];
+		uint8_t j = i;
+		for (; j > 0 && median_buf[j - 1] > v; j--) {
+			median_buf[j] = median_buf[j - 1];
+		}
+		median_buf[j] = v;
+	}
+	return median_buf[median_count / 2];
+}
+
+/// Finishes the object being measured and adds it to the object table
+/**
+ * Objects less than two degrees wide are noise and are dropped.  So are objects past MAX_OBJECTS, which are counted in scan_dropped.  The width
+ * is the chord across the angular width at the median distance, 2 d sin(a / 2), worked out as sqrt(2 d^2 (1 - cos a)) in Q4.
+ * @param end the servo angle of the first reading past the object
+ */
+static void object_end(uint8_t end)
+{
+	is_measuring = 0;
+	dropout = 0;
+	if (end - obj_start <= 1) {
+		return;
+	}
+	if (scanner_count >= MAX_OBJECTS) {
+		if (scan_dropped < 255) {
+			scan_dropped++;
+		}
+		return;
+	}
+	obj_t* obj = &scanner[scanner_count++];
+	obj->start = obj_start;
+	obj->end = end;
+	obj->dist_min = obj_min;
+	obj->dist_max = obj_max;
+	obj->samples = obj_samples;
+	obj->dist = median_dist();
+	// 2 d^2 (1 - cos a) / TRIG_ONE cm^2, times 2^(2 * OBJ_WIDTH_SHIFT) for Q4
+	uint32_t sq = (uint32_t) obj->dist * obj->dist * (TRIG_ONE - cos_q14(end - obj_start));
+	obj->width_q4 = isqrt32(sq >> (TRIG_SHIFT - 1 - 2 * OBJ_WIDTH_SHIFT));
+	trace(TRACE_OBJECT, obj_angle(obj), obj->dist);
 }
 
 /// Side-angle-side calculation on a triangle of arbitrary shape
@@ -107,16 +264,45 @@ int side_side_side(int far_side, int adjascent_sides) {
 int dist_at_angle(int angle)
 {
 	set_servo_pos(angle);
-	return ir_distance_cm();
+	int dist = ir_distance_cm();
+	telemetry_ir_sample(angle, dist);
+	return dist;
 }
 
 /// Rotates the servo to the specified angle in degrees
 /**
- * Sets the servo to the specified angle in degrees.  It waits 100 ms after setting the output.
+ * Sets the servo to the specified angle in degrees.  It waits until the servo has had time to get there; see start_servo_pos().
  * @param deg the angle in degrees to rotate to
  */
 void set_servo_pos(int deg) {
+	start_servo_pos(deg);
+	PROF_BEGIN(PROF_SERVO_WAIT);
+	while (!servo_settled())
+		;
+	PROF_END(PROF_SERVO_WAIT);
+}
+
+/// Starts rotating the servo to the specified angle in degrees
+/**
+ * Sets the servo output without waiting for it to get there.  The caller must wait for servo_settled() before reading the IR sensor.  The travel
+ * time is worked out from how far the servo has to go, SERVO_MS_PER_DEG, and is never less than SERVO_SETTLE_MS.  The first move after reset
+ * assumes a full swing since the starting position is unknown.
+ * @param deg the angle in degrees to rotate to
+ */
+void start_servo_pos(int deg) {
+	int travel = servo_angle < 0 ? 180 : abs(deg - servo_angle);
+	uint16_t ms = travel * SERVO_MS_PER_DEG;
 	set_servo_OCR(calc_servo_OCR_ticks(deg));
+	servo_angle = deg;
+	servo_ready = deadline_in(ms > SERVO_SETTLE_MS ? ms : SERVO_SETTLE_MS);
+}
+
+/// Checks if the servo has reached the last commanded angle
+/**
+ * @return 1 once the travel time worked out by start_servo_pos() has passed
+ */
+char servo_settled(void) {
+	return deadline_passed(servo_ready);
 }
 
 /// Sets timer 3's OCR to the specified number of ticks for a PWM wave
@@ -127,21 +313,86 @@ void set_servo_pos(int deg) {
  */
 void set_servo_OCR(int ticks)
 {
-	OCR3B = ticks;
-	wait_ms(50);
+	capture_word(CAPTURE_SERVO, ticks);
+	hal_servo_set(ticks);
 }
 
 /// Calculates the number of ticks required to rotate the servo to the desired angle
 /**
- * Calculates the number of ticks required to rotate the servo to the desired angle.  The PWM
- * wave has a certain duty cycle to rotate the servo.  It has been calibrated to the servo, so the
- * values do not have much meaning outside of being calibrated.
- * @param deg the angle in degrees to rotate the servo to
+ * Interpolates linearly between the SERVO_CAL_POINTS points in calib.servo_ocr, so a change to the calibration takes effect on the next move.
+ * The PWM wave has a certain duty cycle to rotate the servo.  It has been calibrated to the servo, so the values do not have much meaning
+ * outside of being calibrated.
+ * @param deg the angle in degrees to rotate the servo to, clamped to 0-180
  */
-int calc_servo_OCR_ticks(float deg)
+int calc_servo_OCR_ticks(int deg)
 {
-	float percent = (float) deg / 180;
-	return 800 + 3400 * percent;
+	if (deg < 0) {
+		deg = 0;
+	} else if (deg > 180) {
+		deg = 180;
+	}
+	uint8_t p = deg / SERVO_CAL_STEP;
+	if (p >= SERVO_CAL_POINTS - 1) {
+		p = SERVO_CAL_POINTS - 2;
+	}
+	int16_t ocr0 = calib.servo_ocr[p];
+	int16_t ocr1 = calib.servo_ocr[p + 1];
+	return ocr0 + (int32_t) (ocr1 - ocr0) * (deg - p * SERVO_CAL_STEP) / SERVO_CAL_STEP;
+}
+
+/// Measures the servo OCR for one calibration angle
+/**
+ * Place a narrow target (a pole or table leg) 20-60 cm from the robot at exactly point * SERVO_CAL_STEP degrees first.  Sweeps the servo
+ * SERVO_CAL_WINDOW degrees either side of where the current calibration says that angle is, and takes the middle of the OCR range where the IR sees the
+ * target as the true OCR for the angle.  Blocks for a few seconds; returns early if a stop is requested.
+ * @param point which calibration angle, 0 to SERVO_CAL_POINTS - 1
+ * @return the measured OCR ticks, or -1 if no target was found
+ */
+int servo_calibrate(uint8_t point)
+{
+	int expected = calib.servo_ocr[point];
+	int span = (calib.servo_ocr[SERVO_CAL_POINTS - 1] - calib.servo_ocr[0]) * SERVO_CAL_WINDOW / 180;
+	int nearest = 1000;
+	int first = -1;
+	int last = -1;
+
+	// Swing to the start of the window from wherever the servo is, then creep across it
+	set_servo_OCR(expected - span);
+	wait_ms(180 * SERVO_MS_PER_DEG);
+	// First pass finds how close the target is, second pass finds its edges
+	for (char pass = 0; pass < 2; pass++) {
+		for (int ocr = expected - span; ocr <= expected + span; ocr += SERVO_CAL_OCR_STEP) {
+			if (stop_requested()) {
+				servo_angle = -1;
+				return -1;
+			}
+			set_servo_OCR(ocr);
+			wait_ms(SERVO_SETTLE_MS);
+			int dist = ir_distance_cm();
+			if (!pass) {
+				if (dist > 0 && dist < nearest) {
+					nearest = dist;
+				}
+			} else if (dist > 0 && dist <= nearest + SERVO_CAL_TOLERANCE) {
+				if (first < 0) {
+					first = ocr;
+				}
+				last = ocr;
+			}
+		}
+		if (!pass && nearest > SERVO_CAL_MAX_DIST) {
+			break;
+		}
+		set_servo_OCR(expected - span);
+		wait_ms(SERVO_CAL_WINDOW * 2 * SERVO_MS_PER_DEG + SERVO_SETTLE_MS);
+	}
+	// The OCR no longer matches any angle in the table
+	servo_angle = -1;
+
+	if (first < 0) {
+		return -1;
+	}
+	return (first + last) / 2;
 }
 
 /// Reads a value from the ADC and converts it to cm
@@ -152,7 +403,10 @@ int calc_servo_OCR_ticks(float deg)
 int ir_distance_cm(void)
 {
 	int val = ADC_read();
-	return ir_ADC_to_cm(val);
+	PROF_BEGIN(PROF_IR_ADC_TO_CM);
+	int cm = ir_ADC_to_cm(val);
+	PROF_END(PROF_IR_ADC_TO_CM);
+	return cm;
 }
 
 /// Gets a reading from the ADC
@@ -162,28 +416,23 @@ int ir_distance_cm(void)
  */
 int ADC_read()
 {
-	// Start the ADC conversion
-	ADCSRA |= _BV(ADSC);
-	// Wait for the result
-	while (!(ADCSRA & _BV(ADIF)))
-		{}
-	return ADC;
+	uint16_t value = hal_adc_read();
+	capture_word(CAPTURE_ADC, value);
+	return value;
 }
 
 /// Converts a raw ADC reading to cm
 /**
- * Using a magical calibrated conversion, converts a raw reading to cm.
+ * Evaluates the calibrated polynomial in calib.ir_coeff with Horner's rule, which takes six multiplies instead of the pow() calls.
  * @param reading the raw reading from the ADC
  * @return the conversion in cm
  */
 int ir_ADC_to_cm(int reading)
 {
-	// Magical formula created by taking samples and creating an equation in Mathematica. ;)
-	return 133.987 -
-			0.69158 * reading +
-			0.00176938 * pow(reading, 2) -
-			2.25827 * pow(10, -6) * pow(reading, 3) +
-			1.14087 * pow(10, -9) * pow(reading, 4) +
-			1.59493 * pow(10, -13) * pow(reading, 5) -
-			2.46348 * pow(10, -16) * pow(reading, 6);
+	float x = reading;
+	float cm = calib.ir_coeff[IR_COEFFS - 1];
+	for (int8_t i = IR_COEFFS - 2; i >= 0; i--) {
+		cm = cm * x + calib.ir_coeff[i];
+	}
+	return cm;
 }
\ No newline at end of file
@@ -1,18 +1,71 @@
 #ifndef SCAN_H_
 #define SCAN_H_
 
+#include <stdint.h>
+#include "task.h"
 
+// Time for the servo to move one degree step and stop shaking
+#define SERVO_SETTLE_MS 50
+// Travel time of the servo per degree, with some margin over the datasheet's 0.19 s / 60 deg
+#define SERVO_MS_PER_DEG 5
+
+
+// Servo calibration sweep: degrees searched either side of the expected angle, OCR ticks per step (~0.4 degrees), the farthest a target may
+// be, and how much farther than the nearest reading still counts as the target
+#define SERVO_CAL_WINDOW 15
+#define SERVO_CAL_OCR_STEP 8
+#define SERVO_CAL_MAX_DIST 80
+#define SERVO_CAL_TOLERANCE 5
+
+// Capacity of the object table filled by a scan; objects past it are counted by scan_overflow() and dropped
+#define MAX_OBJECTS 15
+// IR readings nearer than this (cm) are on an object
+#define SCAN_OBJECT_CM 60
+// A single reading past SCAN_OBJECT_CM inside an object is taken as a dropout, and the object goes on, if the next reading is within this many
+// cm of the last one before it
+#define SCAN_MERGE_CM 8
+// Distances kept per object for the median; wider objects keep every second, fourth, ... reading
+#define SCAN_MEDIAN_SAMPLES 32
+// Fractional bits of obj_t.width_q4
+#define OBJ_WIDTH_SHIFT 4
+
+/// An object found by a scan
+/**
+ * Angles are servo degrees, so 90 is straight ahead; the object covers start to end - 1.  Distances are cm; width_q4 is the chord across the
+ * object at the median distance in 1/16 cm.
+ */
 typedef struct
 {
-	int width;
-	int dist;
-	int angular_location;
-	int angular_width;
+	uint8_t start;
+	uint8_t end;
+	uint8_t dist_min;
+	uint8_t dist;		// median
+	uint8_t dist_max;
+	uint8_t samples;	// readings on the object, not counting dropouts
+	uint16_t width_q4;
 } obj_t;
 
+/// The servo angle of the middle of an object
+static inline int obj_angle(const obj_t* obj) {
+	return (obj->start + obj->end) / 2;
+}
+
+/// The width of an object in whole cm
+static inline int obj_width(const obj_t* obj) {
+	return (obj->width_q4 + (1 << (OBJ_WIDTH_SHIFT - 1))) >> OBJ_WIDTH_SHIFT;
+}
+
 obj_t* do_scan(int* obj_count);
+void scan_init(void);
+char scan_task(void);
+obj_t* scan_objects(int* obj_count);
+uint8_t scan_overflow(void);
 void set_servo_pos(int deg);
+void start_servo_pos(int deg);
+char servo_settled(void);
+int servo_calibrate(uint8_t point);
 int dist_at_angle(int angle);
+int ir_distance_cm(void);
 int ADC_read(void);
 int side_side_side(int far_side, int adjascent_sides);
 int side_angle_side2(int angle, int side1_len, int side2_len);
@@ -0,0 +1,234 @@
+/**
+ * arena.c: the simulated course
+ *
+ * Loaded from a text file, one item per line, '#' starts a comment:
+ *   floor x1 y1 x2 y2		the floor; anything outside it is a drop
+ *   start x y heading		where the robot starts
+ *   post x y r				a round obstacle the IR sees
+ *   low x y r				a round obstacle below the IR, only the bumper finds it
+ *   box x1 y1 x2 y2		a rectangular obstacle the IR sees
+ *   tape x1 y1 x2 y2		bright tape on the floor
+ *   hole x1 y1 x2 y2		a drop in the floor
+ *   goal x1 y1 x2 y2		the retrieval zone, used to score the run
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "arena.h"
+
+arena_t arena;
+
+static int in_rect(const arena_rect_t* r, float x, float y);
+static arena_rect_t make_rect(float x1, float y1, float x2, float y2);
+
+/// Reads a course description
+/**
+ * @param text the whole description
+ * @param name file name for error messages
+ * @return 0, or -1 after printing what is wrong
+ */
+int arena_parse(const char* text, const char* name) {
+	memset(&arena, 0, sizeof(arena));
+	arena.floor = make_rect(-1e6, -1e6, 1e6, 1e6);
+	int line_number = 0;
+	while (*text) {
+		char line[200];
+		size_t len = strcspn(text, "\n");
+		if (len >= sizeof(line)) {
+			len = sizeof(line) - 1;
+		}
+		memcpy(line, text, len);
+		line[len] = '\0';
+		text += strcspn(text, "\n");
+		if (*text) {
+			text++;
+		}
+		line_number++;
+		char* comment = strchr(line, '#');
+		if (comment) {
+			*comment = '\0';
+		}
+
+		char word[16];
+		float a, b, c, d;
+		int n = sscanf(line, "%15s %f %f %f %f", word, &a, &b, &c, &d);
+		if (n <= 0) {
+			continue;
+		}
+		int full = 0;
+		if (!strcmp(word, "floor") && n == 5) {
+			arena.floor = make_rect(a, b, c, d);
+		} else if (!strcmp(word, "start") && n == 4) {
+			arena.start_x = a;
+			arena.start_y = b;
+			arena.start_heading = c;
+		} else if ((!strcmp(word, "post") || !strcmp(word, "low")) && n == 4 && c > 0 && !(full = arena.obstacle_count == ARENA_MAX_ITEMS)) {
+			arena_obstacle_t* o = &arena.obstacles[arena.obstacle_count++];
+			o->x = a;
+			o->y = b;
+			o->r = c;
+			o->tall = word[0] == 'p';
+		} else if (!strcmp(word, "box") && n == 5 && !(full = arena.obstacle_count == ARENA_MAX_ITEMS)) {
+			arena_obstacle_t* o = &arena.obstacles[arena.obstacle_count++];
+			o->box = make_rect(a, b, c, d);
+			o->tall = 1;
+		} else if (!strcmp(word, "tape") && n == 5 && !(full = arena.tape_count == ARENA_MAX_ITEMS)) {
+			arena.tape[arena.tape_count++] = make_rect(a, b, c, d);
+		} else if (!strcmp(word, "hole") && n == 5 && !(full = arena.hole_count == ARENA_MAX_ITEMS)) {
+			arena.holes[arena.hole_count++] = make_rect(a, b, c, d);
+		} else if (!strcmp(word, "goal") && n == 5) {
+			arena.goal = make_rect(a, b, c, d);
+			arena.has_goal = 1;
+		} else {
+			fprintf(stderr, "%s:%d: %s\n", name, line_number, full ? "too many items" : "cannot read this line");
+			return -1;
+		}
+	}
+	return 0;
+}
+
+/// Reads a course description from a file
+/**
+ * @return 0, or -1 after printing what is wrong
+ */
+int arena_load(const char* path) {
+	FILE* f = fopen(path, "r");
+	if (!f) {
+		perror(path);
+		return -1;
+	}
+	static char text[32768];
+	size_t len = fread(text, 1, sizeof(text) - 1, f);
+	fclose(f);
+	text[len] = '\0';
+	return arena_parse(text, path);
+}
+
+/// Distance along a ray to the first obstacle the IR sees
+/**
+ * @param x, y where the ray starts
+ * @param heading its direction
+ * @param max the farthest to look
+ * @return the distance, or max if nothing is closer
+ */
+float arena_ray(float x, float y, float heading, float max) {
+	float dx = cosf(heading * (float) M_PI / 180);
+	float dy = sinf(heading * (float) M_PI / 180);
+	float best = max;
+	for (int i = 0; i < arena.obstacle_count; i++) {
+		const arena_obstacle_t* o = &arena.obstacles[i];
+		if (!o->tall) {
+			continue;
+		}
+		if (o->r > 0) {
+			// |p + t d - c| = r
+			float px = x - o->x;
+			float py = y - o->y;
+			float b = px * dx + py * dy;
+			float c = px * px + py * py - o->r * o->r;
+			float disc = b * b - c;
+			if (disc < 0) {
+				continue;
+			}
+			float t = -b - sqrtf(disc);
+			if (t < 0) {
+				t = -b + sqrtf(disc);
+			}
+			if (t >= 0 && t < best) {
+				best = t;
+			}
+		} else {
+			// Slabs
+			float t0 = 0, t1 = best;
+			float lo[2] = {o->box.x1 - x, o->box.y1 - y};
+			float hi[2] = {o->box.x2 - x, o->box.y2 - y};
+			float dir[2] = {dx, dy};
+			int hit = 1;
+			for (int k = 0; k < 2 && hit; k++) {
+				if (fabsf(dir[k]) < 1e-6f) {
+					hit = lo[k] <= 0 && hi[k] >= 0;
+					continue;
+				}
+				float ta = lo[k] / dir[k];
+				float tb = hi[k] / dir[k];
+				if (ta > tb) {
+					float swap = ta;
+					ta = tb;
+					tb = swap;
+				}
+				t0 = ta > t0 ? ta : t0;
+				t1 = tb < t1 ? tb : t1;
+				hit = t0 <= t1;
+			}
+			if (hit && t0 < best) {
+				best = t0;
+			}
+		}
+	}
+	return best;
+}
+
+/// Checks if a round body overlaps an obstacle
+/**
+ * @param x, y the center of the body
+ * @param radius its radius
+ * @param bearing set to the direction from the center to the deepest contact
+ * @return 1 if it touches an obstacle
+ */
+int arena_contact(float x, float y, float radius, float* bearing) {
+	float deepest = 0;
+	for (int i = 0; i < arena.obstacle_count; i++) {
+		const arena_obstacle_t* o = &arena.obstacles[i];
+		float cx, cy, reach;
+		if (o->r > 0) {
+			cx = o->x;
+			cy = o->y;
+			reach = radius + o->r;
+		} else {
+			// Closest point of the box
+			cx = x < o->box.x1 ? o->box.x1 : x > o->box.x2 ? o->box.x2 : x;
+			cy = y < o->box.y1 ? o->box.y1 : y > o->box.y2 ? o->box.y2 : y;
+			reach = radius;
+		}
+		float dist = hypotf(cx - x, cy - y);
+		if (dist < reach && reach - dist > deepest) {
+			deepest = reach - dist;
+			*bearing = atan2f(cy - y, cx - x) * 180 / (float) M_PI;
+		}
+	}
+	return deepest > 0;
+}
+
+/// What the floor is at a point
+arena_floor_t arena_floor_at(float x, float y) {
+	if (!in_rect(&arena.floor, x, y)) {
+		return ARENA_CLIFF;
+	}
+	for (int i = 0; i < arena.hole_count; i++) {
+		if (in_rect(&arena.holes[i], x, y)) {
+			return ARENA_CLIFF;
+		}
+	}
+	for (int i = 0; i < arena.tape_count; i++) {
+		if (in_rect(&arena.tape[i], x, y)) {
+			return ARENA_TAPE;
+		}
+	}
+	return ARENA_FLOOR;
+}
+
+/// Checks if a point is in the retrieval zone
+int arena_in_goal(float x, float y) {
+	return arena.has_goal && in_rect(&arena.goal, x, y);
+}
+
+static int in_rect(const arena_rect_t* r, float x, float y) {
+	return x >= r->x1 && x <= r->x2 && y >= r->y1 && y <= r->y2;
+}
+
+static arena_rect_t make_rect(float x1, float y1, float x2, float y2) {
+	arena_rect_t r = {fminf(x1, x2), fminf(y1, y2), fmaxf(x1, x2), fmaxf(y1, y2)};
+	return r;
+}
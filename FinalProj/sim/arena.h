@@ -0,0 +1,53 @@
+/**
+ * arena.h: the simulated course
+ *
+ * A floor with tall obstacles the IR sees, low ones only the bumper finds, tape the cliff sensors see, and holes.  Positions are in mm and headings
+ * in degrees counterclockwise from +x.
+ */
+
+#ifndef ARENA_H_
+#define ARENA_H_
+
+#define ARENA_MAX_ITEMS 32
+
+/// What the floor is at a point, as the cliff sensors see it
+typedef enum {
+	ARENA_FLOOR,
+	ARENA_TAPE,
+	ARENA_CLIFF
+} arena_floor_t;
+
+typedef struct {
+	float x1, y1, x2, y2;
+} arena_rect_t;
+
+/// A round (r > 0) or rectangular obstacle
+typedef struct {
+	float x, y, r;
+	arena_rect_t box;
+	char tall;	// 1 if the IR sees it
+} arena_obstacle_t;
+
+typedef struct {
+	arena_rect_t floor;
+	arena_obstacle_t obstacles[ARENA_MAX_ITEMS];
+	int obstacle_count;
+	arena_rect_t tape[ARENA_MAX_ITEMS];
+	int tape_count;
+	arena_rect_t holes[ARENA_MAX_ITEMS];
+	int hole_count;
+	arena_rect_t goal;	// the retrieval zone; only used to score a run
+	char has_goal;
+	float start_x, start_y, start_heading;
+} arena_t;
+
+extern arena_t arena;
+
+int arena_parse(const char* text, const char* name);
+int arena_load(const char* path);
+float arena_ray(float x, float y, float heading, float max);
+int arena_contact(float x, float y, float radius, float* bearing);
+arena_floor_t arena_floor_at(float x, float y);
+int arena_in_goal(float x, float y);
+
+#endif /* ARENA_H_ */
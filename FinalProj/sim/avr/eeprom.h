@@ -0,0 +1,31 @@
+/**
+ * avr/eeprom.h for the native build
+ *
+ * EEMEM variables are ordinary zeroed memory, which reads like a blank EEPROM to calib_load(): it falls back to the defaults.
+ */
+
+#ifndef SIM_AVR_EEPROM_H_
+#define SIM_AVR_EEPROM_H_
+
+#include <stdint.h>
+#include <string.h>
+
+#define EEMEM
+
+static inline void eeprom_read_block(void* dst, const void* src, size_t n) {
+	memcpy(dst, src, n);
+}
+
+static inline void eeprom_update_block(const void* src, void* dst, size_t n) {
+	memcpy(dst, src, n);
+}
+
+static inline uint8_t eeprom_read_byte(const uint8_t* addr) {
+	return *addr;
+}
+
+static inline void eeprom_update_byte(uint8_t* addr, uint8_t value) {
+	*addr = value;
+}
+
+#endif /* SIM_AVR_EEPROM_H_ */
@@ -0,0 +1,15 @@
+/**
+ * avr/interrupt.h for the native build
+ *
+ * Simulated interrupts only run inside hal_idle(), and only while SREG_I is set.
+ */
+
+#ifndef SIM_AVR_INTERRUPT_H_
+#define SIM_AVR_INTERRUPT_H_
+
+#include <avr/io.h>
+
+#define sei() (SREG |= _BV(SREG_I))
+#define cli() (SREG &= ~_BV(SREG_I))
+
+#endif /* SIM_AVR_INTERRUPT_H_ */
@@ -0,0 +1,20 @@
+/**
+ * avr/io.h for the native build
+ *
+ * Only what the firmware outside lib/hal_avr.c still uses: SREG for the interrupt flag and _BV().
+ */
+
+#ifndef SIM_AVR_IO_H_
+#define SIM_AVR_IO_H_
+
+#include <stdint.h>
+
+#define _BV(bit) (1 << (bit))
+
+// The global interrupt enable bit of SREG
+#define SREG_I 7
+
+/// The status register; only SREG_I means anything.  See hal_sim.c.
+extern volatile uint8_t SREG;
+
+#endif /* SIM_AVR_IO_H_ */
@@ -0,0 +1,38 @@
+#!/bin/sh
+# Runs autonomous mode with both exploration strategies over a few seeds and tabulates the time to the goal.
+#   ./compare.sh [arena] [seeds]
+# The arena defaults to the built-in course and seeds to 16.  Seed 1 starts where the arena says and every other seed from its own start pose
+# (see sim.c), so both strategies get the same set of starts.  "claimed" counts runs where the firmware said WE WIN; "found" only those where
+# the robot really was in the retrieval zone, and the times are of those.
+
+arena=${1:+-a $1}
+seeds=${2:-16}
+cd "$(dirname "$0")"
+
+printf "%-9s %7s %6s %10s %10s %7s %7s %8s\n" strategy claimed found "median s" "worst s" bumps cliffs "m/run"
+for strategy in straight frontier; do
+	seed=1
+	while [ $seed -le $seeds ]; do
+		./sim -q $arena -s $strategy -r $seed | grep '^sim,'
+		seed=$((seed + 1))
+	done | awk -F, -v strategy=$strategy -v seeds=$seeds '
+		{
+			claimed += $2 == "win"
+			if ($2 == "win" && $4 == 1) {
+				times[found++] = $3 / 1000
+			}
+			bumps += $5; cliffs += $6; mm += $7
+		}
+		END {
+			# Sort the times to the goal for the median
+			for (i = 1; i < found; i++) {
+				for (j = i; j > 0 && times[j - 1] > times[j]; j--) {
+					t = times[j]; times[j] = times[j - 1]; times[j - 1] = t
+				}
+			}
+			median = found ? (found % 2 ? times[int(found / 2)] : (times[found / 2 - 1] + times[found / 2]) / 2) : 0
+			printf "%-9s %4d/%-2d %3d/%-2d %10s %10s %7.1f %7.1f %8.1f\n", strategy, claimed, seeds, found, seeds,
+				found ? sprintf("%.1f", median) : "-", found ? sprintf("%.1f", times[found - 1]) : "-",
+				bumps / seeds, cliffs / seeds, mm / seeds / 1000
+		}'
+done
@@ -0,0 +1,343 @@
+/**
+ * create.c: the simulated iRobot Create
+ *
+ * Parses the Open Interface byte stream, runs the wheels and body through the arena in CREATE_STEP_US steps, and answers sensor queries through
+ * sim_oi_send().  Bytes sent at a baud rate other than the Create's are dropped and counted, like a real framing error.  Odometry keeps counting while
+ * the body is pushed against an obstacle, since the wheels slip.
+ */
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include "create.h"
+#include "arena.h"
+#include "sim.h"
+
+create_t create;
+
+// Where the cliff sensors are: angle from straight ahead and distance from the center
+static const float cliff_angle[4] = {60, 20, -20, -60};
+#define CLIFF_SENSOR_MM 150
+
+static uint8_t command[64];
+static uint8_t have = 0;
+
+static uint8_t argument_count(uint8_t opcode);
+static void execute(void);
+static void answer(const uint8_t* ids, uint8_t count);
+static uint8_t encode(uint8_t id, uint8_t* out);
+static void sense(void);
+static int16_t report(float* value);
+static float approach(float value, float target, float step);
+
+/// Puts the Create at its start, powered up and in passive mode at 57600 baud
+void create_init(float x, float y, float heading, uint32_t seed) {
+	memset(&create, 0, sizeof(create));
+	create.x = x;
+	create.y = y;
+	create.heading = heading;
+	create.mode = 1;
+	create.baud = 57600;
+	create.last_step = sim_now;
+	srand(seed);
+	have = 0;
+	sense();
+}
+
+/// A byte from the firmware
+/**
+ * @param value the byte
+ * @param baud the rate USART1 sent it at
+ */
+void create_receive(uint8_t value, uint32_t baud) {
+	if (baud != create.baud) {
+		create.garbled++;
+		return;
+	}
+	command[have++] = value;
+	if (have >= create_command_length(command, have) || have == sizeof(command)) {
+		execute();
+		have = 0;
+	}
+}
+
+/// Moves the robot up to a time
+void create_step(uint64_t now) {
+	const float dt = CREATE_STEP_US / 1e6f;
+	while (create.last_step + CREATE_STEP_US <= now) {
+		create.last_step += CREATE_STEP_US;
+		if (create.fell) {
+			continue;
+		}
+		create.left = approach(create.left, create.mode >= 2 ? create.cmd_left : 0, CREATE_ACCEL * dt);
+		create.right = approach(create.right, create.mode >= 2 ? create.cmd_right : 0, CREATE_ACCEL * dt);
+		if (create.left == 0 && create.right == 0) {
+			continue;
+		}
+		float v = (create.left + create.right) / 2;
+		float turn = (create.right - create.left) / CREATE_WHEELBASE * dt * 180 / (float) M_PI;
+		float mid = (create.heading + turn / 2) * (float) M_PI / 180;
+		float dx = v * dt * cosf(mid);
+		float dy = v * dt * sinf(mid);
+		create.heading = fmodf(create.heading + turn + 360, 360);
+		create.odo_distance += v * dt;
+		create.odo_angle += turn;
+		create.mm += fabsf(v * dt);
+
+		// The body stops at an obstacle unless it is moving away from it
+		float bearing;
+		if (!arena_contact(create.x + dx, create.y + dy, CREATE_RADIUS, &bearing)
+				|| dx * cosf(bearing * (float) M_PI / 180) + dy * sinf(bearing * (float) M_PI / 180) < 0) {
+			create.x += dx;
+			create.y += dy;
+		}
+		sense();
+	}
+}
+
+/// Updates the bumper and cliff sensors from where the robot is
+static void sense(void) {
+	float bearing;
+	uint8_t left = 0, right = 0;
+	if (arena_contact(create.x, create.y, CREATE_RADIUS + 2, &bearing)) {
+		float relative = fmodf(bearing - create.heading + 540, 360) - 180;
+		// The bumper covers the front half; both sides close near the middle
+		if (relative > -100 && relative < 100) {
+			left = relative > -15;
+			right = relative < 15;
+		}
+	}
+	if ((left || right) && !create.bump_left && !create.bump_right) {
+		create.bumps++;
+	}
+	create.bump_left = left;
+	create.bump_right = right;
+
+	char any_cliff = 0;
+	for (int i = 0; i < 4; i++) {
+		float a = (create.heading + cliff_angle[i]) * (float) M_PI / 180;
+		arena_floor_t floor = arena_floor_at(create.x + CLIFF_SENSOR_MM * cosf(a), create.y + CLIFF_SENSOR_MM * sinf(a));
+		any_cliff |= create.cliff[i];
+		create.cliff[i] = floor == ARENA_CLIFF;
+		uint16_t signal = floor == ARENA_CLIFF ? CREATE_CLIFF_SIGNAL : floor == ARENA_TAPE ? CREATE_TAPE_SIGNAL : CREATE_FLOOR_SIGNAL;
+		create.cliff_signal[i] = signal + rand() % (signal / 20 + 1);
+	}
+	if (!any_cliff && (create.cliff[0] | create.cliff[1] | create.cliff[2] | create.cliff[3])) {
+		create.cliffs++;
+	}
+	if (arena_floor_at(create.x, create.y) == ARENA_CLIFF) {
+		create.fell = 1;
+		create.left = create.right = 0;
+	}
+}
+
+/// Length of an Open Interface command, as far as its first bytes tell
+/**
+ * A song or a query list first gets the length that reaches the argument holding its real length.
+ * @param command the bytes so far, at least the opcode
+ * @param have how many
+ * @return the length of the whole command in bytes
+ */
+uint8_t create_command_length(const uint8_t* command, uint8_t have) {
+	if (command[0] == 140 && have >= 3) {
+		return 3 + 2 * command[2];
+	}
+	if (command[0] == 149 && have >= 2) {
+		return 2 + command[1];
+	}
+	return 1 + argument_count(command[0]);
+}
+
+/// Arguments after each opcode; commands of variable length are finished by create_command_length()
+static uint8_t argument_count(uint8_t opcode) {
+	switch (opcode) {
+	case 129: case 136: case 138: case 141: case 142: case 147: case 150: case 151: case 155: case 158:
+		return 1;
+	case 140: case 156: case 157:
+		return 2;
+	case 139: case 144:
+		return 3;
+	case 137: case 145:
+		return 4;
+	case 149:
+		return 1;
+	default:
+		return 0;
+	}
+}
+
+static void execute(void) {
+	uint8_t* a = &command[1];
+	switch (command[0]) {
+	case 128:
+		create.mode = 1;
+		break;
+	case 129: {
+		static const uint32_t rates[] = {300, 600, 1200, 2400, 4800, 9600, 14400, 19200, 28800, 38400, 57600, 115200};
+		if (a[0] < sizeof(rates) / sizeof(rates[0])) {
+			create.baud = rates[a[0]];
+		}
+		break;
+	}
+	case 131:
+		create.mode = 2;
+		break;
+	case 132:
+		create.mode = 3;
+		break;
+	case 137: {
+		// Velocity and turn radius
+		create.cmd_velocity = (int16_t) (a[0] << 8 | a[1]);
+		create.cmd_radius = (int16_t) (a[2] << 8 | a[3]);
+		float v = create.cmd_velocity;
+		int16_t r = create.cmd_radius;
+		if (r == (int16_t) 0x8000 || r == 0x7FFF) {
+			create.cmd_left = create.cmd_right = v;
+		} else if (r == 1 || r == -1) {
+			create.cmd_right = r * v;
+			create.cmd_left = -r * v;
+		} else {
+			create.cmd_right = v * (r + CREATE_WHEELBASE / 2.0f) / r;
+			create.cmd_left = v * (r - CREATE_WHEELBASE / 2.0f) / r;
+		}
+		break;
+	}
+	case 145:
+		create.cmd_right = (int16_t) (a[0] << 8 | a[1]);
+		create.cmd_left = (int16_t) (a[2] << 8 | a[3]);
+		create.cmd_velocity = (create.cmd_right + create.cmd_left) / 2;
+		create.cmd_radius = 0x7FFF;
+		break;
+	case 140: {
+		uint16_t ticks = 0;
+		for (int i = 0; i < a[1]; i++) {
+			ticks += a[3 + 2 * i];
+		}
+		create.song_ticks[a[0] & 15] = ticks > 255 ? 255 : ticks;
+		break;
+	}
+	case 141:
+		create.song_number = a[0] & 15;
+		create.song_end = sim_now + create.song_ticks[create.song_number] * 1000000ull / 64;
+		break;
+	case 142:
+		if (a[0] <= 6) {
+			static const uint8_t groups[7][2] = {{7, 26}, {7, 16}, {17, 20}, {21, 26}, {27, 34}, {35, 42}, {7, 42}};
+			uint8_t ids[36];
+			uint8_t count = 0;
+			for (uint8_t id = groups[a[0]][0]; id <= groups[a[0]][1]; id++) {
+				ids[count++] = id;
+			}
+			answer(ids, count);
+		} else {
+			answer(a, 1);
+		}
+		break;
+	case 149:
+		answer(&a[1], a[0]);
+		break;
+	default:
+		// LEDs, demos and the rest change nothing the firmware can see
+		break;
+	}
+}
+
+/// Sends the packets asked for
+static void answer(const uint8_t* ids, uint8_t count) {
+	uint8_t out[128];
+	uint8_t len = 0;
+	create_step(sim_now);
+	for (uint8_t i = 0; i < count && len < sizeof(out) - 2; i++) {
+		len += encode(ids[i], &out[len]);
+	}
+	sim_oi_send(out, len, CREATE_REPLY_US);
+}
+
+/// One sensor packet on the wire
+/**
+ * @return its size in bytes
+ */
+static uint8_t encode(uint8_t id, uint8_t* out) {
+	int32_t value;
+	uint8_t size = 2;
+	switch (id) {
+	case 7:
+		out[0] = create.bump_right | create.bump_left << 1 | (create.fell ? 0x1C : 0);
+		return 1;
+	case 9: case 10: case 11: case 12:
+		out[0] = create.cliff[id - 9];
+		return 1;
+	case 17:
+		out[0] = 255;	// no IR character
+		return 1;
+	case 19:
+		value = report(&create.odo_distance);
+		break;
+	case 20:
+		value = report(&create.odo_angle);
+		break;
+	case 22:
+		value = 16000;
+		break;
+	case 23:
+		value = -300;
+		break;
+	case 24:
+		out[0] = 25;
+		return 1;
+	case 25:
+		value = 2500;
+		break;
+	case 26:
+		value = 2700;
+		break;
+	case 27: case 33:
+		value = 0;
+		break;
+	case 28: case 29: case 30: case 31:
+		value = create.cliff_signal[id - 28];
+		break;
+	case 35:
+		out[0] = create.mode;
+		return 1;
+	case 36:
+		out[0] = create.song_number;
+		return 1;
+	case 37:
+		out[0] = sim_now < create.song_end;
+		return 1;
+	case 39:
+		value = create.cmd_velocity;
+		break;
+	case 40:
+		value = create.cmd_radius;
+		break;
+	case 41:
+		value = create.cmd_right;
+		break;
+	case 42:
+		value = create.cmd_left;
+		break;
+	default:
+		// Flags, buttons and everything else that stays 0 here are one byte
+		out[0] = 0;
+		return 1;
+	}
+	out[0] = (uint16_t) value >> 8;
+	out[1] = value & 0xFF;
+	return size;
+}
+
+/// Reports odometry since the last report, keeping what is below one unit for the next
+static int16_t report(float* value) {
+	int16_t whole = (int16_t) *value;
+	*value -= whole;
+	return whole;
+}
+
+static float approach(float value, float target, float step) {
+	if (value < target) {
+		return value + step < target ? value + step : target;
+	}
+	return value - step > target ? value - step : target;
+}
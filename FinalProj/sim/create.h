@@ -0,0 +1,60 @@
+/**
+ * create.h: the simulated iRobot Create
+ *
+ * Understands the Open Interface commands the firmware sends, drives a differential base around the arena, and answers sensor queries.
+ */
+
+#ifndef CREATE_H_
+#define CREATE_H_
+
+#include <stdint.h>
+
+// Distance between the wheels and radius of the body, mm
+#define CREATE_WHEELBASE 258
+#define CREATE_RADIUS 165
+// How fast the wheels follow a new speed, mm/s^2
+#define CREATE_ACCEL 2000
+// From the end of a query to the first byte of the answer, us
+#define CREATE_REPLY_US 1000
+// Physics step, us
+#define CREATE_STEP_US 1000
+
+// Cliff signals over the floor, over tape, and over a drop
+#define CREATE_FLOOR_SIGNAL 500
+#define CREATE_TAPE_SIGNAL 1500
+#define CREATE_CLIFF_SIGNAL 5
+
+typedef struct {
+	// Where the robot really is, in the arena frame
+	float x, y, heading;
+	// Wheel speeds now and commanded, mm/s
+	float left, right;
+	int16_t cmd_left, cmd_right;
+	int16_t cmd_velocity, cmd_radius;
+	// Odometry not reported yet
+	float odo_distance, odo_angle;
+	uint8_t bump_left, bump_right;
+	uint8_t cliff[4];			// left, front left, front right, right
+	uint16_t cliff_signal[4];
+	uint8_t mode;				// 0 off, 1 passive, 2 safe, 3 full
+	uint32_t baud;
+	uint8_t song_number;
+	uint64_t song_end;
+	uint8_t song_ticks[16];		// length of each song, 1/64 s
+	uint64_t last_step;
+	// Totals for the report
+	uint32_t bumps;
+	uint32_t cliffs;
+	float mm;
+	uint32_t garbled;			// bytes sent at the wrong baud rate
+	char fell;					// drove off the floor
+} create_t;
+
+extern create_t create;
+
+void create_init(float x, float y, float heading, uint32_t seed);
+void create_receive(uint8_t value, uint32_t baud);
+void create_step(uint64_t now);
+uint8_t create_command_length(const uint8_t* command, uint8_t have);
+
+#endif /* CREATE_H_ */
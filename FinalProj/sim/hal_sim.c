@@ -0,0 +1,434 @@
+/**
+ * hal_sim.c: the hardware abstraction layer on a simulated robot
+ *
+ * Time is virtual and only passes when the firmware waits: every hal_idle() is SIM_POLL_US, an ADC conversion is SIM_ADC_US.  Interrupts that came
+ * due in that time are run from inside the wait, in time order, and only while SREG_I is set, so a run is exactly repeatable.  An interrupt
+ * handler that waits lets time pass without running other interrupts, like on the robot.
+ *
+ * USART0 takes scripted input and hands the output to sim.c at 57600 baud.  USART1 talks to the Create model at whatever rate each side is set to.
+ * The servo swings at SIM_SERVO_DEG_PER_MS to the angle the default calibration gives its pulse, and the IR reads the distance along the servo's
+ * heading in the arena through the inverse of ir_ADC_to_cm().  The LCD is decoded into a screen that sim.c can print.
+ *
+ * Once a replay (replay.c) has taken over, the bytes to the Create, the IR readings and the servo pulses go to it instead of the models.
+ */
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <avr/io.h>
+#include "../lib/hal.h"
+#include "sim.h"
+#include "create.h"
+#include "arena.h"
+#include "replay.h"
+
+// Time that passes each time the firmware waits, us
+#define SIM_POLL_US 10
+// One ADC conversion: 13 cycles at 125 kHz
+#define SIM_ADC_US 104
+// Servo speed: 60 degrees in 0.19 s
+#define SIM_SERVO_DEG_PER_MS 0.32f
+// Pulse width at 0 and 180 degrees, timer 3 ticks
+#define SIM_SERVO_OCR_0 800
+#define SIM_SERVO_OCR_180 4200
+// Range of the IR, mm; past it the reading is noise from far away
+#define SIM_IR_MAX_MM 800
+#define SIM_BT_BAUD 57600
+
+#define QUEUE_SIZE 4096
+
+/// Bytes waiting to be received, each with the time it is complete
+typedef struct {
+	uint64_t at[QUEUE_SIZE];
+	uint8_t value[QUEUE_SIZE];
+	uint16_t head, tail;
+} byte_queue_t;
+
+volatile uint8_t SREG = 0;
+uint64_t sim_now = 0;
+
+static char in_interrupt = 0;
+
+static struct {
+	char on;
+	uint64_t next;
+} tick;
+
+static struct {
+	char on;
+	char udrie;
+	uint64_t tx_free;
+	byte_queue_t rx;
+} bt;
+
+static struct {
+	char on;
+	char udrie;
+	uint32_t baud;
+	uint64_t tx_free;
+	byte_queue_t rx;
+} oi;
+
+static struct {
+	char on;
+	float angle;
+	float target;
+	uint64_t moved;
+} servo = {0, 90, 90, 0};
+
+static float cm_of_adc[1024];
+static char adc_table = 0;
+
+// LCD: port A, data on bits 0 - 3, RS on bit 4, E on bit 6
+static uint8_t lcd_port;
+static char lcd_4bit = 0;
+static char lcd_half = 0;
+static uint8_t lcd_high;
+static uint8_t lcd_address;
+char sim_lcd[4][21];
+uint64_t sim_lcd_changed = 0;
+
+static uint64_t next_event(uint8_t* which);
+static void dispatch(uint8_t which);
+static void queue_put(byte_queue_t* q, uint64_t at, uint8_t value);
+static void lcd_port_set(uint8_t value);
+static void lcd_byte(uint8_t value, char rs);
+static void servo_update(void);
+
+int ir_ADC_to_cm(int reading);
+
+/// Lets time pass while the firmware waits
+void hal_idle(void) {
+	sim_advance(SIM_POLL_US);
+}
+
+/// Lets time pass and runs the interrupts that come due
+/**
+ * @param us how long
+ */
+void sim_advance(uint32_t us) {
+	uint64_t end = sim_now + us;
+	if (!in_interrupt) {
+		uint8_t which = 0;
+		uint64_t at;
+		while ((SREG & _BV(SREG_I)) && (at = next_event(&which)) <= end) {
+			if (at > sim_now) {
+				sim_now = at;
+			}
+			dispatch(which);
+		}
+	}
+	if (end > sim_now) {
+		sim_now = end;
+	}
+	create_step(sim_now);
+	sim_check();
+}
+
+/// Queues Bluetooth input
+/**
+ * @param text bytes to send
+ * @param at when the first one starts; later bytes follow back to back
+ */
+void sim_bt_send(const char* text, uint64_t at) {
+	if (bt.rx.head != bt.rx.tail) {
+		uint64_t last = bt.rx.at[(bt.rx.head - 1) % QUEUE_SIZE];
+		at = at > last ? at : last;
+	}
+	for (; *text; text++) {
+		at += SIM_BYTE_US(SIM_BT_BAUD);
+		queue_put(&bt.rx, at, *text);
+	}
+}
+
+/// Queues bytes from the Create at its current baud rate
+/**
+ * @param data the bytes
+ * @param count how many
+ * @param delay from now to the start of the first one, us
+ */
+void sim_oi_send(const uint8_t* data, uint8_t count, uint32_t delay) {
+	uint64_t at = sim_now + delay;
+	if (oi.rx.head != oi.rx.tail) {
+		uint64_t last = oi.rx.at[(oi.rx.head - 1) % QUEUE_SIZE];
+		at = at > last ? at : last;
+	}
+	for (uint8_t i = 0; i < count; i++) {
+		at += SIM_BYTE_US(create.baud);
+		// The receiver is at another rate; the byte is lost
+		if (create.baud != oi.baud) {
+			create.garbled++;
+			continue;
+		}
+		queue_put(&oi.rx, at, data[i]);
+	}
+}
+
+/// Where the servo points now, in degrees
+float sim_servo_angle(void) {
+	servo_update();
+	return servo.angle;
+}
+
+static uint64_t next_event(uint8_t* which) {
+	// Same priority as the ATmega128 vectors when two are due together
+	uint64_t times[5] = {
+		tick.on ? tick.next : UINT64_MAX,
+		bt.on && bt.rx.head != bt.rx.tail ? bt.rx.at[bt.rx.tail] : UINT64_MAX,
+		bt.udrie ? bt.tx_free : UINT64_MAX,
+		oi.on && oi.rx.head != oi.rx.tail ? oi.rx.at[oi.rx.tail] : UINT64_MAX,
+		oi.udrie ? oi.tx_free : UINT64_MAX,
+	};
+	uint64_t best = UINT64_MAX;
+	for (uint8_t i = 0; i < 5; i++) {
+		if (times[i] < best) {
+			best = times[i];
+			*which = i;
+		}
+	}
+	return best;
+}
+
+static void dispatch(uint8_t which) {
+	int16_t value;
+	uint8_t sreg = SREG;
+	SREG &= ~_BV(SREG_I);
+	in_interrupt = 1;
+	switch (which) {
+	case 0:
+		tick.next += 1000;
+		clock_tick_isr();
+		break;
+	case 1:
+		value = bt.rx.value[bt.rx.tail];
+		bt.rx.tail = (bt.rx.tail + 1) % QUEUE_SIZE;
+		bt_rx_isr(value);
+		break;
+	case 2:
+		value = bt_tx_isr();
+		if (value < 0) {
+			bt.udrie = 0;
+		} else {
+			bt.tx_free = sim_now + SIM_BYTE_US(SIM_BT_BAUD);
+			sim_bt_received(value);
+		}
+		break;
+	case 3:
+		value = oi.rx.value[oi.rx.tail];
+		oi.rx.tail = (oi.rx.tail + 1) % QUEUE_SIZE;
+		oi_rx_isr(value);
+		break;
+	case 4:
+		value = oi_tx_isr();
+		if (value < 0) {
+			oi.udrie = 0;
+		} else {
+			oi.tx_free = sim_now + SIM_BYTE_US(oi.baud);
+			if (replay_on) {
+				replay_oi_tx(value);
+			} else {
+				create_receive(value, oi.baud);
+			}
+		}
+		break;
+	}
+	in_interrupt = 0;
+	SREG = sreg;
+}
+
+static void queue_put(byte_queue_t* q, uint64_t at, uint8_t value) {
+	uint16_t next = (q->head + 1) % QUEUE_SIZE;
+	if (next == q->tail) {
+		return;
+	}
+	q->at[q->head] = at;
+	q->value[q->head] = value;
+	q->head = next;
+}
+
+void hal_bt_init(void) {
+	bt.on = 1;
+	SREG |= _BV(SREG_I);
+}
+
+void hal_bt_tx_start(void) {
+	if (!bt.udrie && bt.tx_free < sim_now) {
+		bt.tx_free = sim_now;
+	}
+	bt.udrie = 1;
+}
+
+void hal_oi_init(uint32_t baud) {
+	oi.on = 1;
+	oi.baud = baud;
+	SREG |= _BV(SREG_I);
+}
+
+void hal_oi_baud(uint32_t baud) {
+	oi.baud = baud;
+}
+
+void hal_oi_tx_start(void) {
+	if (!oi.udrie && oi.tx_free < sim_now) {
+		oi.tx_free = sim_now;
+	}
+	oi.udrie = 1;
+}
+
+char hal_oi_tx_empty(void) {
+	return sim_now >= oi.tx_free;
+}
+
+void hal_clock_init(void) {
+	tick.on = 1;
+	tick.next = (sim_now / 1000 + 1) * 1000;
+	SREG |= _BV(SREG_I);
+}
+
+uint8_t hal_clock_ticks(void) {
+	// 4 us timer ticks since the last 1 ms wrap, which may not have been serviced yet
+	uint64_t wrap = sim_now >= tick.next ? tick.next : tick.next - 1000;
+	return (sim_now - wrap) / 4 % 250;
+}
+
+char hal_clock_pending(void) {
+	return tick.on && sim_now >= tick.next;
+}
+
+void hal_servo_start(void) {
+	servo_update();
+	servo.on = 1;
+}
+
+void hal_servo_set(uint16_t ticks) {
+	if (replay_on) {
+		replay_servo(ticks);
+	}
+	servo_update();
+	float angle = (float) ((int32_t) ticks - SIM_SERVO_OCR_0) * 180 / (SIM_SERVO_OCR_180 - SIM_SERVO_OCR_0);
+	servo.target = angle < 0 ? 0 : angle > 180 ? 180 : angle;
+}
+
+static void servo_update(void) {
+	if (servo.on) {
+		float step = (sim_now - servo.moved) / 1000.0f * SIM_SERVO_DEG_PER_MS;
+		if (fabsf(servo.target - servo.angle) <= step) {
+			servo.angle = servo.target;
+		} else {
+			servo.angle += servo.target > servo.angle ? step : -step;
+		}
+	}
+	servo.moved = sim_now;
+}
+
+void hal_adc_init(void) {
+}
+
+/// Reads the IR
+/**
+ * The distance along the servo's heading gets noise of about 0.5 cm + 1 % and is turned into the ADC value that ir_ADC_to_cm() maps closest to
+ * it, with the calibration loaded at the first reading.
+ */
+uint16_t hal_adc_read(void) {
+	sim_advance(SIM_ADC_US);
+	if (replay_on) {
+		return replay_adc();
+	}
+	if (!adc_table) {
+		for (int i = 0; i < 1024; i++) {
+			cm_of_adc[i] = ir_ADC_to_cm(i);
+		}
+		adc_table = 1;
+	}
+	float mm = arena_ray(create.x, create.y, create.heading + sim_servo_angle() - 90, SIM_IR_MAX_MM);
+	float cm;
+	if (mm >= SIM_IR_MAX_MM) {
+		cm = 100 + rand() % 40;
+	} else {
+		// Box-Muller
+		float u1 = (rand() + 1.0f) / (RAND_MAX + 2.0f);
+		float u2 = (rand() + 1.0f) / (RAND_MAX + 2.0f);
+		float gauss = sqrtf(-2 * logf(u1)) * cosf(2 * (float) M_PI * u2);
+		cm = mm / 10 + gauss * (0.5f + mm / 1000);
+	}
+	// cm_of_adc falls from 0 to about 1000
+	int lo = 0, hi = 1000;
+	while (lo < hi) {
+		int mid = (lo + hi) / 2;
+		if (cm_of_adc[mid] > cm) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+	return lo;
+}
+
+void hal_lcd_init(void) {
+	lcd_port = 0;
+}
+
+void hal_lcd_write(uint8_t value) {
+	lcd_port_set(value);
+}
+
+void hal_lcd_set(uint8_t bits) {
+	lcd_port_set(lcd_port | bits);
+}
+
+void hal_lcd_clear(uint8_t bits) {
+	lcd_port_set(lcd_port & ~bits);
+}
+
+/// Latches a nibble on the falling edge of E like the HD44780
+static void lcd_port_set(uint8_t value) {
+	char falling = (lcd_port & 0x40) && !(value & 0x40);
+	lcd_port = value;
+	if (!falling) {
+		return;
+	}
+	uint8_t nibble = value & 0x0F;
+	char rs = (value & 0x10) != 0;
+	if (!lcd_4bit) {
+		// 8 bit mode until the function set that switches to 4 bits
+		lcd_4bit = nibble == 0x02 && !rs;
+		return;
+	}
+	if (!lcd_half) {
+		lcd_high = nibble;
+		lcd_half = 1;
+	} else {
+		lcd_half = 0;
+		lcd_byte(lcd_high << 4 | nibble, rs);
+	}
+}
+
+static void lcd_byte(uint8_t value, char rs) {
+	// DDRAM address of each line on a 4 x 20 display
+	static const uint8_t line_start[4] = {0x00, 0x40, 0x14, 0x54};
+	if (rs) {
+		for (int line = 0; line < 4; line++) {
+			if (lcd_address >= line_start[line] && lcd_address < line_start[line] + 20) {
+				sim_lcd[line][lcd_address - line_start[line]] = value;
+				sim_lcd_changed = sim_now;
+			}
+		}
+		lcd_address++;
+	} else if (value == 0x01) {
+		memset(sim_lcd, 0, sizeof(sim_lcd));
+		lcd_address = 0;
+		sim_lcd_changed = sim_now;
+	} else if (value == 0x02 || value == 0x03) {
+		lcd_address = 0;
+	} else if (value & 0x80) {
+		lcd_address = value & 0x7F;
+	}
+}
+
+void hal_dock_init(void) {
+}
+
+/// There is no dock in the arena; report being on it so go_charge() returns
+char hal_docked(void) {
+	return 1;
+}
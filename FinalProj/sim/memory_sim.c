@@ -0,0 +1,31 @@
+/**
+ * memory_sim.c: memory.c for the native build
+ *
+ * The SRAM layout is the ATmega128's and means nothing on the host, so every figure is 0.
+ */
+
+#include "../memory.h"
+
+uint16_t data_size(void) {
+	return 0;
+}
+
+uint16_t bss_size(void) {
+	return 0;
+}
+
+uint16_t stack_now(void) {
+	return 0;
+}
+
+uint16_t stack_peak(void) {
+	return 0;
+}
+
+uint16_t sram_unused(void) {
+	return 0;
+}
+
+uint16_t sram_free(void) {
+	return 0;
+}
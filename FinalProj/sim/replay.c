@@ -0,0 +1,521 @@
+/**
+ * replay.c: plays a capture from the robot back into the firmware
+ *
+ * The capture is read whole first.  Bytes to the Create are cut into Open Interface commands, and each sensor query keeps the answer that followed
+ * it and how long that took.  During the replay a query from the firmware takes the first unused recorded query with the same bytes, at most
+ * REPLAY_QUERY_WINDOW queries ahead, so polls that land in a different order than on the robot are still answered right.  Other commands are
+ * compared one by one in order.
+ *
+ * Two latencies are measured the same way on the recording and on the replay.  Command latency runs from the end of a line typed over Bluetooth
+ * to the first Create command or servo move after it; the replay also measures the time to the first text sent back.  Decision latency runs from
+ * the last byte received from the Create to the next drive command.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "replay.h"
+#include "sim.h"
+#include "create.h"
+#include "../lib/open_interface.h"
+
+// Back to back bytes on each link, us
+#define REPLAY_BT_BYTE_US SIM_BYTE_US(57600)
+#define REPLAY_OI_BYTE_US SIM_BYTE_US(28800)
+// How far ahead a query may be matched
+#define REPLAY_QUERY_WINDOW 64
+// Bluetooth input is queued this far ahead of its time, us
+#define REPLAY_BT_AHEAD_US 100000
+// Divergences printed before they are only counted
+#define REPLAY_SHOW 5
+
+/// A recorded Open Interface command
+typedef struct {
+	uint64_t sent;			// when its last byte went into USART1
+	uint8_t len;
+	uint8_t bytes[64];
+	uint32_t answer_delay;	// from sent to the first byte of the answer
+	uint8_t answer_len;
+	uint8_t answer[128];
+	char used;
+} oi_command_t;
+
+/// A line typed over Bluetooth
+typedef struct {
+	char text[16];
+	uint64_t end;			// when its '\r' arrived, recorded time
+	int64_t action[2];		// to the first Create command or servo move, on the robot and in the replay, -1 if none
+	int64_t reply;			// to the first text sent back in the replay, -1 if none
+} line_t;
+
+/// Minimum, average and maximum of a latency, us
+typedef struct {
+	uint32_t count;
+	uint64_t total;
+	uint64_t min, max;
+	uint64_t max_at;
+} latency_t;
+
+char replay_on = 0;
+
+// The recording; times are us since its start record
+static uint64_t* bt_at;
+static uint8_t* bt_value;
+static size_t bt_count;
+static oi_command_t* commands;
+static size_t command_count;
+static uint16_t* adc;
+static size_t adc_count;
+static uint16_t* servo;
+static size_t servo_count;
+static line_t* lines;
+static size_t line_count;
+static size_t records;
+static unsigned lost;
+static uint64_t last_event;
+static latency_t decisions[2];
+
+// Progress of the replay
+static size_t bt_next;
+static size_t query_first;		// first unused query
+static size_t other_next;		// next command that is not a query
+static size_t adc_next;
+static size_t servo_next;
+static size_t line_now[2];		// lines that have ended, on the recorded and the replayed clock
+static uint64_t answer_end[2];	// last byte from the Create not followed by a drive command yet, 0 if none
+static uint64_t answer_first;	// first byte of the last answer the replay sent
+static uint8_t answer_len;		// and its length, 0 if it has all arrived
+static uint8_t sent[64];		// command the firmware is sending
+static uint8_t sent_len;
+static uint32_t answered, unanswered, others, diverged, servo_diverged, past;
+
+static void add_command(const uint8_t* bytes, uint8_t len, uint64_t at);
+static void add_bt(uint8_t value, uint64_t at);
+static void on_action(int side, uint64_t at);
+static void on_answer(uint64_t at);
+static void on_drive(int side, uint64_t at);
+static void latency_add(latency_t* latency, uint64_t us, uint64_t at);
+static char is_query(const uint8_t* command);
+static char is_drive(const uint8_t* command);
+static void print_command(const char* prefix, const uint8_t* bytes, uint8_t len);
+static void* grow(void* array, size_t count, size_t size);
+
+/// Takes the next byte of a Bluetooth stream
+/**
+ * @param parser the parser state, zeroed before the first byte
+ * @param value the byte
+ * @return whether the byte was text or part of a record; the record is in parser once it is done
+ */
+capture_parse_result capture_parse(capture_parser_t* parser, uint8_t value) {
+	switch (parser->state) {
+	case 0:
+		if (value != CAPTURE_ESC) {
+			return CAPTURE_PARSE_TEXT;
+		}
+		parser->state = 1;
+		break;
+	case 1:
+		parser->channel = value >> 5;
+		parser->len = (value & 0x1F) + 1;
+		parser->have = 0;
+		parser->ticks = 0;
+		parser->shift = 0;
+		parser->state = 2;
+		break;
+	case 2:
+		parser->ticks |= (uint32_t) (value & 0x7F) << parser->shift;
+		parser->shift += 7;
+		if (!(value & 0x80)) {
+			parser->state = 3;
+		}
+		break;
+	default:
+		parser->payload[parser->have++] = value;
+		if (parser->have == parser->len) {
+			parser->state = 0;
+			return CAPTURE_PARSE_DONE;
+		}
+		break;
+	}
+	return CAPTURE_PARSE_MORE;
+}
+
+/// Reads a capture
+/**
+ * Takes a raw log of the robot's Bluetooth output or the records sim -c saved; text between the records is skipped.  Only the first capture in
+ * the file is used.
+ * @param path the file
+ * @return 0 on success
+ */
+int replay_load(const char* path) {
+	FILE* file = fopen(path, "rb");
+	if (!file) {
+		perror(path);
+		return 1;
+	}
+	capture_parser_t parser = {0};
+	char started = 0;
+	uint64_t now = 0;
+	uint8_t command[64];
+	uint8_t command_len = 0;
+	size_t last_query = SIZE_MAX;
+	int c;
+	while ((c = getc(file)) != EOF) {
+		if (capture_parse(&parser, c) != CAPTURE_PARSE_DONE) {
+			continue;
+		}
+		if (parser.channel == CAPTURE_START) {
+			if (started) {
+				break;
+			}
+			if (parser.payload[0] != CAPTURE_VERSION) {
+				fprintf(stderr, "%s: capture format %u, expected %u\n", path, parser.payload[0], CAPTURE_VERSION);
+				fclose(file);
+				return 1;
+			}
+			started = 1;
+			continue;
+		}
+		if (!started) {
+			continue;
+		}
+		records++;
+		now += (uint64_t) parser.ticks * 4;
+		for (uint8_t i = 0; i < parser.len; i++) {
+			uint8_t value = parser.payload[i];
+			switch (parser.channel) {
+			case CAPTURE_BT_RX:
+				add_bt(value, now + i * REPLAY_BT_BYTE_US);
+				break;
+			case CAPTURE_OI_TX:
+				command[command_len++] = value;
+				if (command_len >= create_command_length(command, command_len) || command_len == sizeof(command)) {
+					add_command(command, command_len, now + i * REPLAY_OI_BYTE_US);
+					if (is_query(command)) {
+						last_query = command_count - 1;
+					}
+					command_len = 0;
+				}
+				break;
+			case CAPTURE_OI_RX:
+				// The answer goes with the last query, even if a command went out while it was coming in
+				if (last_query < command_count) {
+					oi_command_t* query = &commands[last_query];
+					if (!query->answer_len) {
+						query->answer_delay = now - query->sent;
+					}
+					if (query->answer_len < sizeof(query->answer)) {
+						query->answer[query->answer_len++] = value;
+					}
+					answer_end[0] = now + i * REPLAY_OI_BYTE_US;
+				}
+				break;
+			case CAPTURE_ADC:
+			case CAPTURE_SERVO:
+				if (i % 2) {
+					uint16_t reading = parser.payload[i - 1] | value << 8;
+					if (parser.channel == CAPTURE_ADC) {
+						adc = grow(adc, adc_count, sizeof(*adc));
+						adc[adc_count++] = reading;
+					} else {
+						servo = grow(servo, servo_count, sizeof(*servo));
+						servo[servo_count++] = reading;
+						on_action(0, now);
+					}
+				}
+				break;
+			case CAPTURE_LOST:
+				lost += value;
+				break;
+			}
+		}
+		last_event = now;
+	}
+	fclose(file);
+	if (!started) {
+		fprintf(stderr, "%s: no capture in it\n", path);
+		return 1;
+	}
+	answer_end[0] = 0;
+	if (lost) {
+		fprintf(stderr, "%s: %u records were lost on the link; expect the replay to diverge\n", path, lost);
+	}
+	return 0;
+}
+
+/// Starts the replay at REPLAY_START_US and feeds it; called whenever time passes
+/**
+ * @return 1 once the recording is over
+ */
+char replay_check(void) {
+	if (sim_now < REPLAY_START_US) {
+		return 0;
+	}
+	replay_on = 1;
+	while (bt_next < bt_count && REPLAY_START_US + bt_at[bt_next] <= sim_now + REPLAY_BT_AHEAD_US) {
+		char text[2] = {bt_value[bt_next], 0};
+		sim_bt_send(text, REPLAY_START_US + bt_at[bt_next] - REPLAY_BT_BYTE_US);
+		bt_next++;
+	}
+	while (line_now[1] < line_count && REPLAY_START_US + lines[line_now[1]].end <= sim_now) {
+		line_now[1]++;
+	}
+	return sim_now > REPLAY_START_US + last_event + REPLAY_TAIL_US;
+}
+
+/// A byte the firmware sent to the Create
+void replay_oi_tx(uint8_t value) {
+	sent[sent_len++] = value;
+	if (sent_len < create_command_length(sent, sent_len) && sent_len < sizeof(sent)) {
+		return;
+	}
+	uint8_t len = sent_len;
+	sent_len = 0;
+	if (is_query(sent)) {
+		while (query_first < command_count && (commands[query_first].used || !is_query(commands[query_first].bytes))) {
+			query_first++;
+		}
+		size_t found = command_count;
+		for (size_t i = query_first, seen = 0; i < command_count && seen < REPLAY_QUERY_WINDOW; i++) {
+			if (commands[i].used || !is_query(commands[i].bytes)) {
+				continue;
+			}
+			if (commands[i].len == len && !memcmp(commands[i].bytes, sent, len)) {
+				found = i;
+				break;
+			}
+			seen++;
+		}
+		if (found == command_count) {
+			if (unanswered++ < REPLAY_SHOW) {
+				fprintf(stderr, "replay: %.3f s: no recorded answer to", sim_now / 1e6);
+				print_command("", sent, len);
+			}
+			return;
+		}
+		oi_command_t* query = &commands[found];
+		query->used = 1;
+		answered++;
+		if (query->answer_len) {
+			uint32_t delay = query->answer_delay > REPLAY_OI_BYTE_US ? query->answer_delay - REPLAY_OI_BYTE_US : 0;
+			sim_oi_send(query->answer, query->answer_len, delay);
+			on_answer(sim_now);
+			answer_first = sim_now + delay + REPLAY_OI_BYTE_US;
+			answer_len = query->answer_len;
+		}
+		return;
+	}
+
+	others++;
+	while (other_next < command_count && is_query(commands[other_next].bytes)) {
+		other_next++;
+	}
+	if (other_next >= command_count) {
+		past++;
+	} else if (commands[other_next].len != len || memcmp(commands[other_next].bytes, sent, len)) {
+		if (diverged++ < REPLAY_SHOW) {
+			fprintf(stderr, "replay: %.3f s: the firmware sent", sim_now / 1e6);
+			print_command("", sent, len);
+			print_command("  the robot sent", commands[other_next].bytes, commands[other_next].len);
+		}
+	}
+	if (other_next < command_count) {
+		other_next++;
+	}
+	on_action(1, sim_now);
+	if (is_drive(sent)) {
+		on_drive(1, sim_now);
+	}
+}
+
+/// The next recorded IR reading
+uint16_t replay_adc(void) {
+	if (adc_next < adc_count) {
+		return adc[adc_next++];
+	}
+	past++;
+	return adc_count ? adc[adc_count - 1] : 0;
+}
+
+/// A servo pulse the firmware set
+void replay_servo(uint16_t ticks) {
+	if (servo_next >= servo_count) {
+		past++;
+	} else if (servo[servo_next] != ticks) {
+		if (servo_diverged++ < REPLAY_SHOW) {
+			fprintf(stderr, "replay: %.3f s: servo set to %u, the robot set %u\n", sim_now / 1e6, ticks, servo[servo_next]);
+		}
+	}
+	if (servo_next < servo_count) {
+		servo_next++;
+	}
+	on_action(1, sim_now);
+}
+
+/// A text byte the firmware sent over Bluetooth
+void replay_bt_text(uint8_t value) {
+	(void) value;
+	if (replay_on && line_now[1] && lines[line_now[1] - 1].reply < 0) {
+		lines[line_now[1] - 1].reply = sim_now - REPLAY_START_US - lines[line_now[1] - 1].end;
+	}
+}
+
+/// Prints the divergences and both latencies
+/**
+ * @param result why the run ended
+ * @param wall_ms how long it took
+ */
+void replay_report(const char* result, double wall_ms) {
+	printf("\nreplay: %zu records over %.1f s, %u lost; %zu lines, %zu Create commands, %zu IR readings, %zu servo moves\n", records,
+		last_event / 1e6, lost, line_count, command_count, adc_count, servo_count);
+	printf("replay: %s at %.1f s; %u queries answered, %u unanswered, %u of %u other Create commands and %u of %zu servo moves diverged, "
+		"%u commands, moves and IR readings past the end of the recording\n", result, sim_now / 1e6, answered, unanswered, diverged, others,
+		servo_diverged, servo_next, past);
+	printf("command latency, ms from the end of the line to the first Create command or servo move; reply is to the first text back\n");
+	printf("     at s  line              robot   replay    reply\n");
+	for (size_t i = 0; i < line_count; i++) {
+		printf("%9.3f  %-14s", lines[i].end / 1e6, lines[i].text);
+		for (int side = 0; side < 2; side++) {
+			if (lines[i].action[side] < 0) {
+				printf("        -");
+			} else {
+				printf(" %8.3f", lines[i].action[side] / 1e3);
+			}
+		}
+		if (lines[i].reply < 0) {
+			printf("        -\n");
+		} else {
+			printf(" %8.3f\n", lines[i].reply / 1e3);
+		}
+	}
+	printf("decision latency, ms from the last byte from the Create to the next drive command\n");
+	printf("          count      min      avg      max  slowest at s\n");
+	static const char* const side_name[2] = {"robot", "replay"};
+	for (int side = 0; side < 2; side++) {
+		latency_t* d = &decisions[side];
+		if (!d->count) {
+			printf("  %-6s      0\n", side_name[side]);
+			continue;
+		}
+		printf("  %-6s %6u %8.3f %8.3f %8.3f %13.3f\n", side_name[side], d->count, d->min / 1e3, (double) d->total / d->count / 1e3,
+			d->max / 1e3, d->max_at / 1e6);
+	}
+	printf("replay,%s,%u,%u,%u,%.0f,%.0f,%.0f\n", result, unanswered, diverged, servo_diverged,
+		decisions[0].count ? (double) decisions[0].total / decisions[0].count : 0,
+		decisions[1].count ? (double) decisions[1].total / decisions[1].count : 0, wall_ms);
+}
+
+static void add_command(const uint8_t* bytes, uint8_t len, uint64_t at) {
+	commands = grow(commands, command_count, sizeof(*commands));
+	oi_command_t* command = &commands[command_count++];
+	memset(command, 0, sizeof(*command));
+	memcpy(command->bytes, bytes, len);
+	command->len = len;
+	command->sent = at;
+	if (!is_query(bytes)) {
+		on_action(0, at);
+		if (is_drive(bytes)) {
+			on_drive(0, at);
+		}
+	}
+}
+
+static void add_bt(uint8_t value, uint64_t at) {
+	static char text[16];
+	static uint8_t len = 0;
+	bt_at = grow(bt_at, bt_count, sizeof(*bt_at));
+	bt_value = grow(bt_value, bt_count, sizeof(*bt_value));
+	bt_at[bt_count] = at;
+	bt_value[bt_count++] = value;
+	if (value == '\r') {
+		lines = grow(lines, line_count, sizeof(*lines));
+		line_t* line = &lines[line_count++];
+		memcpy(line->text, text, len);
+		line->text[len] = '\0';
+		line->end = at;
+		line->action[0] = line->action[1] = line->reply = -1;
+		line_now[0] = line_count;
+		len = 0;
+	} else if (value == 127) {
+		len -= len > 0;
+	} else if (len < sizeof(text) - 1) {
+		text[len++] = value;
+	}
+}
+
+/// A Create command other than a query, or a servo move
+/**
+ * @param side 0 on the recording, 1 in the replay
+ * @param at when, on its own clock
+ */
+static void on_action(int side, uint64_t at) {
+	if (line_now[side] && lines[line_now[side] - 1].action[side] < 0) {
+		line_t* line = &lines[line_now[side] - 1];
+		line->action[side] = at - (side ? REPLAY_START_US : 0) - line->end;
+	}
+}
+
+/// Moves answer_end to the last byte of the replayed answer that has arrived by a time
+static void on_answer(uint64_t at) {
+	if (!answer_len || at < answer_first) {
+		return;
+	}
+	uint64_t arrived = (at - answer_first) / REPLAY_OI_BYTE_US;
+	if (arrived >= answer_len - 1u) {
+		arrived = answer_len - 1;
+		answer_len = 0;
+	}
+	answer_end[1] = answer_first + arrived * REPLAY_OI_BYTE_US;
+}
+
+static void on_drive(int side, uint64_t at) {
+	if (side) {
+		on_answer(at);
+	}
+	if (answer_end[side] && answer_end[side] <= at) {
+		latency_add(&decisions[side], at - answer_end[side], side ? at - REPLAY_START_US : at);
+	}
+	answer_end[side] = 0;
+}
+
+static void latency_add(latency_t* latency, uint64_t us, uint64_t at) {
+	if (!latency->count || us < latency->min) {
+		latency->min = us;
+	}
+	if (us >= latency->max) {
+		latency->max = us;
+		latency->max_at = at;
+	}
+	latency->total += us;
+	latency->count++;
+}
+
+static char is_query(const uint8_t* command) {
+	return command[0] == OI_OPCODE_SENSORS || command[0] == OI_OPCODE_QUERY_LIST;
+}
+
+static char is_drive(const uint8_t* command) {
+	return command[0] == OI_OPCODE_DRIVE || command[0] == OI_OPCODE_DRIVE_WHEELS;
+}
+
+static void print_command(const char* prefix, const uint8_t* bytes, uint8_t len) {
+	fputs(prefix, stderr);
+	for (uint8_t i = 0; i < len; i++) {
+		fprintf(stderr, " %u", bytes[i]);
+	}
+	fputc('\n', stderr);
+}
+
+/// Makes room for one more element, doubling the array when it is full
+static void* grow(void* array, size_t count, size_t size) {
+	if (count & (count - 1) || (count && count < 16)) {
+		return array;
+	}
+	array = realloc(array, (count ? count * 2 : 16) * size);
+	if (!array) {
+		perror("replay");
+		exit(2);
+	}
+	return array;
+}
@@ -0,0 +1,51 @@
+/**
+ * replay.h: plays a capture from the robot back into the firmware
+ *
+ * The firmware boots against the Create model like any other run and is put in the program UI with capture on, so the Bluetooth link carries the
+ * same load as when the capture was made.  At REPLAY_START_US the capture takes over: what came in over Bluetooth arrives again at the same times
+ * after that point, every sensor query is answered with what the Create answered to the same query, with the same delay, and IR readings come back
+ * in the order they were taken.  Create commands and servo moves that differ from the recording are counted as divergences.
+ */
+
+#ifndef REPLAY_H_
+#define REPLAY_H_
+
+#include <stdint.h>
+#include "../capture.h"
+
+// Where the capture's start lands on the simulated clock, us
+#define REPLAY_START_US 2000000
+// The replay ends this long after the last recorded event, us
+#define REPLAY_TAIL_US 2000000
+
+/// What capture_parse() made of a byte
+typedef enum {
+	CAPTURE_PARSE_TEXT,		// not part of a record
+	CAPTURE_PARSE_MORE,		// part of a record that is not complete yet
+	CAPTURE_PARSE_DONE		// the last byte of a record
+} capture_parse_result;
+
+/// Picks capture records out of a Bluetooth stream
+typedef struct {
+	uint8_t state;
+	uint8_t channel;
+	uint8_t len;
+	uint8_t have;
+	uint8_t shift;
+	uint32_t ticks;			// time since the record before, 4 us
+	uint8_t payload[CAPTURE_MAX_PAYLOAD];
+} capture_parser_t;
+
+/// Set once the capture has taken over from the Create model and the arena
+extern char replay_on;
+
+capture_parse_result capture_parse(capture_parser_t* parser, uint8_t value);
+int replay_load(const char* path);
+char replay_check(void);
+void replay_oi_tx(uint8_t value);
+uint16_t replay_adc(void);
+void replay_servo(uint16_t ticks);
+void replay_bt_text(uint8_t value);
+void replay_report(const char* result, double wall_ms);
+
+#endif /* REPLAY_H_ */
@@ -0,0 +1,315 @@
+/**
+ * sim.c: runs the firmware against the simulated robot
+ *
+ *   sim [-a arena] [-s straight|frontier] [-i line]... [-w ms] [-t seconds] [-r seed] [-p ms] [-q] [-l] [-c capture] [-R capture]
+ *
+ * By default the firmware is told to run autonomous mode from the program UI ("p", then "a" or "a f") on the built-in course.  -i sends lines of
+ * your own instead, -w ms apart (300 by default); -l prints the LCD whenever it settles and -p prints where the robot really is every so many ms,
+ * both on stderr.  -r seeds the sensor noise and, for any seed but 1 (the default), the start pose, which is drawn clear of everything on the
+ * arena.  The run ends shortly after the firmware says WE WIN (timed from the claim), when the robot falls off the floor, or at the time limit,
+ * and prints one line for people and one "sim," line for scripts:
+ *   sim,<result>,<ms>,<in zone>,<bumps>,<cliffs>,<mm driven>,<garbled bytes>,<wall ms>
+ *
+ * -c turns capture on ("y 1") before the strategy and saves the capture records in the output to a file.  -R replays a capture, from sim -c or a
+ * raw log of the robot's Bluetooth output, instead of running the models (see replay.h); it ends after the recording and prints the
+ * divergences, the latencies, and a "replay," line:
+ *   replay,<result>,<unanswered queries>,<diverged commands>,<diverged servo moves>,<robot decision us>,<replay decision us>,<wall ms>
+ */
+
+#include <math.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "sim.h"
+#include "create.h"
+#include "arena.h"
+#include "replay.h"
+
+int firmware_main(void);
+
+// A 3 x 2.4 m walled course with two rocks, a low rock, a crater, and the retrieval zone behind two posts and a tape line on the far wall
+static const char default_course[] =
+	"floor 0 0 3000 2400\n"
+	"start 400 400 45\n"
+	"box -50 -50 3050 0\n"
+	"box -50 2400 3050 2450\n"
+	"box -50 0 0 2400\n"
+	"box 3000 0 3050 2400\n"
+	"post 1300 900 100\n"
+	"post 1900 1700 120\n"
+	"low 900 1600 80\n"
+	"hole 2100 300 2500 700\n"
+	"post 2600 1200 10\n"
+	"post 2600 1800 10\n"
+	"tape 2580 1200 2620 1800\n"
+	"goal 2580 1200 3000 1800\n";
+
+#define MAX_INPUT_LINES 16
+// The first line is sent this long after reset, the rest this far apart
+#define INPUT_START_US 500000
+#define INPUT_GAP_MS 300
+// After WE WIN the firmware drives into the zone before it stops; the run ends this long after the claim
+#define WIN_SETTLE_US 2000000
+// A start drawn for a seed keeps this clear of obstacles, tape, holes and the floor's edge, and this far from the retrieval zone, in mm
+#define START_CLEARANCE_MM 150
+#define START_GOAL_MM 1000
+
+static uint64_t time_limit = 600000000;
+static char quiet = 0;
+static char show_lcd = 0;
+static uint64_t path_period = 0;
+static uint64_t path_next = 0;
+static char won = 0;
+static uint64_t won_at;
+static struct timespec wall_start;
+static FILE* capture_file = NULL;
+static const char* replay_path = NULL;
+static capture_parser_t output;
+
+static void pick_start(unsigned seed);
+static int start_clear(float x, float y);
+static float next_unit(uint32_t* state);
+static void finish(const char* result);
+static void print_lcd(void);
+static void stuck(int signal);
+
+int main(int argc, char** argv) {
+	const char* arena_path = NULL;
+	const char* lines[MAX_INPUT_LINES];
+	int line_count = 0;
+	const char* strategy = "straight";
+	unsigned seed = 1;
+	uint32_t gap_ms = INPUT_GAP_MS;
+	int opt;
+	const char* capture_path = NULL;
+	while ((opt = getopt(argc, argv, "a:s:i:w:t:r:p:qlc:R:")) != -1) {
+		switch (opt) {
+		case 'a':
+			arena_path = optarg;
+			break;
+		case 's':
+			strategy = optarg;
+			break;
+		case 'i':
+			if (line_count < MAX_INPUT_LINES) {
+				lines[line_count++] = optarg;
+			}
+			break;
+		case 'w':
+			gap_ms = atoi(optarg);
+			break;
+		case 't':
+			time_limit = (uint64_t) (atof(optarg) * 1e6);
+			break;
+		case 'r':
+			seed = strtoul(optarg, NULL, 0);
+			break;
+		case 'p':
+			path_period = (uint64_t) atoi(optarg) * 1000;
+			break;
+		case 'q':
+			quiet = 1;
+			break;
+		case 'l':
+			show_lcd = 1;
+			break;
+		case 'c':
+			capture_path = optarg;
+			break;
+		case 'R':
+			replay_path = optarg;
+			break;
+		default:
+			fprintf(stderr, "usage: %s [-a arena] [-s straight|frontier] [-i line]... [-w ms] [-t seconds] [-r seed] [-p ms] [-q] [-l] [-c capture] "
+				"[-R capture]\n", argv[0]);
+			return 2;
+		}
+	}
+	if (arena_path ? arena_load(arena_path) : arena_parse(default_course, "built-in course")) {
+		return 2;
+	}
+	if (capture_path && !(capture_file = fopen(capture_path, "wb"))) {
+		perror(capture_path);
+		return 2;
+	}
+	if (replay_path) {
+		// The recording starts in the program UI with capture on
+		if (replay_load(replay_path)) {
+			return 2;
+		}
+		line_count = 0;
+		lines[line_count++] = "p";
+		lines[line_count++] = "y 1";
+	} else if (line_count == 0) {
+		if (strcmp(strategy, "straight") && strcmp(strategy, "frontier")) {
+			fprintf(stderr, "unknown strategy %s\n", strategy);
+			return 2;
+		}
+		lines[line_count++] = "p";
+		if (capture_path) {
+			lines[line_count++] = "y 1";
+		}
+		lines[line_count++] = strategy[0] == 'f' ? "a f" : "a";
+	}
+	for (int i = 0; i < line_count; i++) {
+		char line[64];
+		snprintf(line, sizeof(line), "%s\r", lines[i]);
+		sim_bt_send(line, INPUT_START_US + (uint64_t) i * gap_ms * 1000);
+	}
+	if (!replay_path) {
+		pick_start(seed);
+	}
+	create_init(arena.start_x, arena.start_y, arena.start_heading, seed);
+
+	// A firmware loop that never waits would never let virtual time pass
+	signal(SIGALRM, stuck);
+	alarm(300);
+	clock_gettime(CLOCK_MONOTONIC, &wall_start);
+	firmware_main();
+	return 0;
+}
+
+/// Moves the arena's start for a seed
+/**
+ * Seed 1 keeps the start the arena gives.  Any other seed draws a position clear of everything and at least START_GOAL_MM from the retrieval
+ * zone, and a heading, so runs over several seeds start from different places and not only with different sensor noise.  The draw has its own
+ * generator, so the noise of create.c is the same as with the arena's start.
+ * @param seed the -r seed
+ */
+static void pick_start(unsigned seed) {
+	uint32_t state = seed * 2654435761u + 1;
+	if (seed == 1) {
+		return;
+	}
+	for (int tries = 0; tries < 10000; tries++) {
+		float x = arena.floor.x1 + next_unit(&state) * (arena.floor.x2 - arena.floor.x1);
+		float y = arena.floor.y1 + next_unit(&state) * (arena.floor.y2 - arena.floor.y1);
+		if (start_clear(x, y)) {
+			arena.start_x = roundf(x);
+			arena.start_y = roundf(y);
+			arena.start_heading = floorf(next_unit(&state) * 360);
+			return;
+		}
+	}
+	fprintf(stderr, "sim: no clear start for seed %u, starting where the arena says\n", seed);
+}
+
+/// Checks if the robot can start at a point
+static int start_clear(float x, float y) {
+	float bearing;
+	if (arena_contact(x, y, CREATE_RADIUS + START_CLEARANCE_MM, &bearing) || arena_floor_at(x, y) != ARENA_FLOOR) {
+		return 0;
+	}
+	for (int angle = 0; angle < 360; angle += 15) {
+		float a = angle * (float) M_PI / 180;
+		if (arena_floor_at(x + (CREATE_RADIUS + START_CLEARANCE_MM) * cosf(a), y + (CREATE_RADIUS + START_CLEARANCE_MM) * sinf(a)) != ARENA_FLOOR) {
+			return 0;
+		}
+	}
+	float dx = fmaxf(fmaxf(arena.goal.x1 - x, x - arena.goal.x2), 0);
+	float dy = fmaxf(fmaxf(arena.goal.y1 - y, y - arena.goal.y2), 0);
+	return !arena.has_goal || hypotf(dx, dy) >= START_GOAL_MM;
+}
+
+/// The next number of a small xorshift generator, 0 to just under 1
+static float next_unit(uint32_t* state) {
+	*state ^= *state << 13;
+	*state ^= *state >> 17;
+	*state ^= *state << 5;
+	return (*state >> 8) / 16777216.0f;
+}
+
+/// A byte the firmware sent over Bluetooth
+void sim_bt_received(uint8_t value) {
+	static char last[6];
+	if (capture_parse(&output, value) != CAPTURE_PARSE_TEXT) {
+		if (capture_file) {
+			putc(value, capture_file);
+		}
+		return;
+	}
+	if (replay_path) {
+		replay_bt_text(value);
+	}
+	if (!quiet && value != '\r') {
+		putchar(value);
+	}
+	memmove(last, last + 1, sizeof(last) - 1);
+	last[sizeof(last) - 1] = value;
+	if (!won && !memcmp(last, "WE WIN", sizeof(last))) {
+		won = 1;
+		won_at = sim_now;
+	}
+}
+
+/// Ends the run once it is decided; called whenever time passes
+void sim_check(void) {
+	if (show_lcd && sim_lcd_changed && sim_now - sim_lcd_changed > 20000) {
+		print_lcd();
+	}
+	if (path_period && sim_now >= path_next) {
+		fprintf(stderr, "path %.3f %.0f %.0f %.0f\n", sim_now / 1e6, create.x, create.y, create.heading);
+		path_next = sim_now + path_period;
+	}
+	if (replay_path) {
+		if (replay_check()) {
+			finish("end");
+		} else if (sim_now >= time_limit) {
+			finish("timeout");
+		}
+	} else if (create.fell) {
+		finish("fell");
+	} else if (won && sim_now - won_at >= WIN_SETTLE_US) {
+		finish("win");
+	} else if (sim_now >= time_limit) {
+		finish("timeout");
+	}
+}
+
+static void finish(const char* result) {
+	struct timespec wall;
+	clock_gettime(CLOCK_MONOTONIC, &wall);
+	double wall_ms = (wall.tv_sec - wall_start.tv_sec) * 1e3 + (wall.tv_nsec - wall_start.tv_nsec) / 1e6;
+	// In the zone if the body overlaps it
+	// A win is timed from the claim, the rest from the end
+	uint64_t end = won ? won_at : sim_now;
+	float dx = fmaxf(fmaxf(arena.goal.x1 - create.x, create.x - arena.goal.x2), 0);
+	float dy = fmaxf(fmaxf(arena.goal.y1 - create.y, create.y - arena.goal.y2), 0);
+	int in_zone = arena.has_goal && hypotf(dx, dy) <= CREATE_RADIUS;
+	if (show_lcd) {
+		print_lcd();
+	}
+	if (capture_file) {
+		fclose(capture_file);
+	}
+	fflush(stdout);
+	if (replay_path) {
+		replay_report(result, wall_ms);
+		exit(0);
+	}
+	printf("\nsim: started at %.0f, %.0f mm facing %.0f deg\n", arena.start_x, arena.start_y, arena.start_heading);
+	printf("sim: robot at %.0f, %.0f mm facing %.0f deg\n", create.x, create.y, create.heading);
+	printf("sim: %s after %.1f s%s, %u bumps, %u cliffs, %.1f m driven, %u garbled bytes, %.0fx real time\n", result, end / 1e6,
+		in_zone ? " (in the retrieval zone)" : "", create.bumps, create.cliffs, create.mm / 1000, create.garbled, sim_now / 1e3 / fmax(wall_ms, 1));
+	printf("sim,%s,%llu,%d,%u,%u,%.0f,%u,%.0f\n", result, (unsigned long long) (end / 1000), in_zone, create.bumps, create.cliffs, create.mm,
+		create.garbled, wall_ms);
+	exit(0);
+}
+
+static void print_lcd(void) {
+	fprintf(stderr, "lcd @ %.3f s\n", sim_now / 1e6);
+	for (int line = 0; line < 4; line++) {
+		fprintf(stderr, "  |%-20.20s|\n", sim_lcd[line]);
+	}
+	sim_lcd_changed = 0;
+}
+
+static void stuck(int signal) {
+	static const char message[] = "\nsim: stuck, the firmware stopped letting time pass\nsim,stuck\n";
+	(void) signal;
+	write(STDOUT_FILENO, message, sizeof(message) - 1);
+	_exit(1);
+}
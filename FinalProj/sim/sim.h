@@ -0,0 +1,33 @@
+/**
+ * sim.h: the simulator around the native build
+ *
+ * hal_sim.c keeps the virtual clock and plays the peripherals' interrupts, create.c is the Create on the other end of USART1, arena.c is the
+ * course, and sim.c runs it all and scores the run.
+ */
+
+#ifndef SIM_H_
+#define SIM_H_
+
+#include <stdint.h>
+
+/// Virtual time since reset, in us
+extern uint64_t sim_now;
+
+/// Time a byte takes on a serial line, 8N1, in us
+#define SIM_BYTE_US(baud) (10000000u / (baud))
+
+// hal_sim.c
+void sim_advance(uint32_t us);
+void sim_bt_send(const char* text, uint64_t at);
+void sim_oi_send(const uint8_t* data, uint8_t count, uint32_t delay);
+float sim_servo_angle(void);
+/// What the LCD shows, one string per line
+extern char sim_lcd[4][21];
+/// When the LCD last changed, 0 once sim.c has printed it
+extern uint64_t sim_lcd_changed;
+
+// sim.c
+void sim_bt_received(uint8_t value);
+void sim_check(void);
+
+#endif /* SIM_H_ */
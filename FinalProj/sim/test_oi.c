@@ -0,0 +1,281 @@
+/**
+ * test_oi.c: checks the Open Interface sensor decoder on the host
+ *
+ *   test_oi [capture]...
+ *
+ * Feeds group 6 and query list responses, laid out byte for byte as the Create sends them, through oi_decode_byte() and checks every decoded
+ * field, including the sign extension of the signed packets and the byte order of the two byte ones.  Each capture given (from sim -c or a raw
+ * log of the robot) is also played through the decoder: every recorded sensor query must decode its recorded answer to the last byte exactly.
+ * Prints one line per failure and exits with 1 if there were any.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "replay.h"
+#include "create.h"
+#include "../lib/open_interface.h"
+
+static int failures = 0;
+
+#define CHECK(field, expected) check(#field, (long) (field), (long) (expected), __LINE__)
+
+static void check(const char* name, long got, long expected, int line) {
+	if (got != expected) {
+		printf("test_oi.c:%d: %s is %ld, expected %ld\n", line, name, got, expected);
+		failures++;
+	}
+}
+
+/// Decodes a response and checks it ends on its last byte
+static void decode(oi_decoder_t* decoder, oi_t* sensors, const uint8_t* bytes, uint8_t len, int line) {
+	for (uint8_t i = 0; i < len; i++) {
+		char done = oi_decode_byte(decoder, sensors, bytes[i]);
+		if (done != (i == len - 1)) {
+			printf("test_oi.c:%d: decoder %s at byte %u of %u\n", line, done ? "finished" : "still running", i + 1, len);
+			failures++;
+			return;
+		}
+	}
+}
+
+static void test_group6(void) {
+	static const uint8_t response[52] = {
+		0x1E,			// 7 bump left, wheel drops right, left, caster; bump right clear
+		0x01,			// 8 wall
+		0x00, 0x01,		// 9, 10 cliff left, front left
+		0x00, 0x01,		// 11, 12 cliff front right, right
+		0x00,			// 13 virtual wall
+		0x15,			// 14 overcurrents: ld1, ld2, drive left
+		0x00, 0x00,		// 15, 16 unused
+		0xF2,			// 17 infrared byte
+		0x04,			// 18 buttons: advance
+		0xFF, 0xE9,		// 19 distance -23
+		0x00, 0x05,		// 20 angle 5
+		0x02,			// 21 charging state
+		0x3D, 0x10,		// 22 voltage 15632
+		0xFE, 0xC8,		// 23 current -312
+		0xF6,			// 24 temperature -10
+		0x09, 0x7F,		// 25 charge 2431
+		0x0A, 0x8E,		// 26 capacity 2702
+		0x00, 0x2A,		// 27 wall signal 42
+		0x02, 0x9A,		// 28 cliff left signal 666
+		0x06, 0x0F,		// 29 cliff front left signal 1551
+		0x00, 0x05,		// 30 cliff front right signal 5
+		0x80, 0x01,		// 31 cliff right signal 32769, above int16_t
+		0x12,			// 32 cargo bay: io1, baud
+		0x01, 0xF4,		// 33 cargo bay voltage 500
+		0x02,			// 34 home base charger
+		0x03,			// 35 full mode
+		0x07,			// 36 song 7
+		0x01,			// 37 playing
+		0x00,			// 38 packets
+		0xFF, 0x38,		// 39 requested velocity -200
+		0x80, 0x00,		// 40 requested radius 0x8000, straight
+		0x01, 0xF4,		// 41 requested right 500
+		0xFE, 0x0C		// 42 requested left -500
+	};
+	oi_t s;
+	oi_decoder_t decoder;
+	memset(&s, 0xA5, sizeof(s));
+	oi_decode_group(&decoder, 6);
+	decode(&decoder, &s, response, sizeof(response), __LINE__);
+
+	CHECK(s.bumper_right, 0);
+	CHECK(s.bumper_left, 1);
+	CHECK(s.wheeldrop_right, 1);
+	CHECK(s.wheeldrop_left, 1);
+	CHECK(s.wheeldrop_caster, 1);
+	CHECK(s.wall, 1);
+	CHECK(s.cliff_left, 0);
+	CHECK(s.cliff_frontleft, 1);
+	CHECK(s.cliff_frontright, 0);
+	CHECK(s.cliff_right, 1);
+	CHECK(s.virtual_wall, 0);
+	CHECK(s.overcurrent_ld1, 1);
+	CHECK(s.overcurrent_ld0, 0);
+	CHECK(s.overcurrent_ld2, 1);
+	CHECK(s.overcurrent_driveright, 0);
+	CHECK(s.overcurrent_driveleft, 1);
+	CHECK(s.infrared_byte, 0xF2);
+	CHECK(s.button_play, 0);
+	CHECK(s.button_advance, 1);
+	CHECK(s.distance, -23);
+	CHECK(s.angle, 5);
+	CHECK(s.charging_state, 2);
+	CHECK(s.voltage, 15632);
+	CHECK(s.current, -312);
+	CHECK(s.temperature, -10);
+	CHECK(s.charge, 2431);
+	CHECK(s.capacity, 2702);
+	CHECK(s.wall_signal, 42);
+	CHECK(s.cliff_left_signal, 666);
+	CHECK(s.cliff_frontleft_signal, 1551);
+	CHECK(s.cliff_frontright_signal, 5);
+	CHECK(s.cliff_right_signal, 32769);
+	CHECK(s.cargo_bay_io0, 0);
+	CHECK(s.cargo_bay_io1, 1);
+	CHECK(s.cargo_bay_io2, 0);
+	CHECK(s.cargo_bay_io3, 0);
+	CHECK(s.cargo_bay_baud, 1);
+	CHECK(s.cargo_bay_voltage, 500);
+	CHECK(s.internal_charger_on, 0);
+	CHECK(s.home_base_charger_on, 1);
+	CHECK(s.oi_mode, 3);
+	CHECK(s.song_number, 7);
+	CHECK(s.song_playing, 1);
+	CHECK(s.number_packets, 0);
+	CHECK(s.requested_velocity, -200);
+	CHECK(s.requested_radius, -32768);
+	CHECK(s.requested_right_velocity, 500);
+	CHECK(s.requested_left_velocity, -500);
+}
+
+static void test_query_list(void) {
+	// The safety poll's packets, then odometry and a cliff signal out of order
+	static const uint8_t ids[] = {7, 9, 12, 20, 19, 31, 24};
+	static const uint8_t response[] = {
+		0x03,			// 7 both bumps
+		0x00,			// 9
+		0x01,			// 12
+		0xFF, 0x4C,		// 20 angle -180
+		0x7F, 0xFF,		// 19 distance 32767
+		0x00, 0xFF,		// 31 cliff right signal 255
+		0x80			// 24 temperature -128
+	};
+	oi_t s;
+	oi_decoder_t decoder;
+	memset(&s, 0, sizeof(s));
+	s.cliff_left_signal = 1234;
+	s.voltage = 15000;
+	oi_decode_list(&decoder, ids, sizeof(ids));
+	decode(&decoder, &s, response, sizeof(response), __LINE__);
+
+	CHECK(s.bumper_right, 1);
+	CHECK(s.bumper_left, 1);
+	CHECK(s.wheeldrop_caster, 0);
+	CHECK(s.cliff_left, 0);
+	CHECK(s.cliff_right, 1);
+	CHECK(s.angle, -180);
+	CHECK(s.distance, 32767);
+	CHECK(s.cliff_right_signal, 255);
+	CHECK(s.temperature, -128);
+	// Packets that were not asked for keep their values
+	CHECK(s.cliff_left_signal, 1234);
+	CHECK(s.voltage, 15000);
+
+	// A single packet query goes through the same path
+	static const uint8_t one[] = {22};
+	static const uint8_t voltage[] = {0x41, 0x2C};
+	oi_decode_list(&decoder, one, 1);
+	decode(&decoder, &s, voltage, sizeof(voltage), __LINE__);
+	CHECK(s.voltage, 16684);
+}
+
+/// Sensor bytes a query asks for, or 0 if the decoder cannot tell
+static uint16_t answer_size(const uint8_t* query, uint8_t len) {
+	static const uint8_t group_size[7] = {26, 10, 6, 10, 14, 12, 52};
+	uint16_t size = 0;
+	if (query[0] == OI_OPCODE_SENSORS) {
+		if (query[1] <= 6) {
+			return group_size[query[1]];
+		}
+		return oi_packet_size(query[1]);
+	}
+	for (uint8_t i = 2; i < len; i++) {
+		if (!oi_packet_size(query[i])) {
+			return 0;
+		}
+		size += oi_packet_size(query[i]);
+	}
+	return size;
+}
+
+// The last sensor query of a capture and what came back
+static uint8_t query[64];
+static uint8_t query_len = 0;
+static uint8_t answer[128];
+static uint16_t answer_len = 0;
+static unsigned answers = 0;
+
+/// Decodes the answer to the last query of a capture
+static void check_answer(const char* path) {
+	uint16_t size = answer_size(query, query_len);
+	if (!query_len || !answer_len || !size) {
+		return;
+	}
+	oi_t s;
+	oi_decoder_t decoder;
+	answers++;
+	if (answer_len != size) {
+		printf("%s: answer %u to query %u is %u bytes, the decoder expects %u\n", path, answers, query[0], answer_len, size);
+		failures++;
+		return;
+	}
+	if (query[0] == OI_OPCODE_SENSORS && query[1] <= 6) {
+		oi_decode_group(&decoder, query[1]);
+	} else if (query[0] == OI_OPCODE_SENSORS) {
+		oi_decode_list(&decoder, &query[1], 1);
+	} else {
+		oi_decode_list(&decoder, &query[2], query[1]);
+	}
+	decode(&decoder, &s, answer, answer_len, __LINE__);
+}
+
+/// Decodes every sensor answer in a capture
+static void test_capture(const char* path) {
+	FILE* file = fopen(path, "rb");
+	if (!file) {
+		perror(path);
+		failures++;
+		return;
+	}
+	capture_parser_t parser = {0};
+	uint8_t command[64];
+	uint8_t command_len = 0;
+	int c;
+
+	while ((c = getc(file)) != EOF) {
+		if (capture_parse(&parser, c) != CAPTURE_PARSE_DONE) {
+			continue;
+		}
+		for (uint8_t i = 0; i < parser.len; i++) {
+			if (parser.channel == CAPTURE_OI_TX) {
+				command[command_len++] = parser.payload[i];
+				if (command_len >= create_command_length(command, command_len) || command_len == sizeof(command)) {
+					if (command[0] == OI_OPCODE_SENSORS || command[0] == OI_OPCODE_QUERY_LIST) {
+						check_answer(path);
+						memcpy(query, command, command_len);
+						query_len = command_len;
+						answer_len = 0;
+					}
+					command_len = 0;
+				}
+			} else if (parser.channel == CAPTURE_OI_RX && answer_len < sizeof(answer)) {
+				answer[answer_len++] = parser.payload[i];
+			}
+		}
+	}
+	check_answer(path);
+	fclose(file);
+	printf("%s: %u answers decoded\n", path, answers);
+	answers = 0;
+	query_len = 0;
+}
+
+int main(int argc, char** argv) {
+	test_group6();
+	test_query_list();
+	for (int i = 1; i < argc; i++) {
+		test_capture(argv[i]);
+	}
+	printf("test_oi: %s\n", failures ? "FAILED" : "ok");
+	return failures != 0;
+}
+
+// The simulator's hooks into sim.c, which is not linked here
+void sim_bt_received(uint8_t value) {
+	(void) value;
+}
+
+void sim_check(void) {
+}
@@ -0,0 +1,26 @@
+/**
+ * util/atomic.h for the native build
+ *
+ * Same shape as avr-libc's: interrupts are off for the block and SREG is put back when it is left, however it is left.
+ */
+
+#ifndef SIM_UTIL_ATOMIC_H_
+#define SIM_UTIL_ATOMIC_H_
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+
+static inline uint8_t sim_atomic_enter(void) {
+	cli();
+	return 1;
+}
+
+static inline void sim_atomic_restore(const uint8_t* sreg) {
+	SREG = *sreg;
+}
+
+#define ATOMIC_RESTORESTATE uint8_t sreg_save __attribute__((__cleanup__(sim_atomic_restore))) = SREG
+
+#define ATOMIC_BLOCK(type) for (type, sim_atomic_once = sim_atomic_enter(); sim_atomic_once; sim_atomic_once = 0)
+
+#endif /* SIM_UTIL_ATOMIC_H_ */
@@ -0,0 +1,22 @@
+/**
+ * util/crc16.h for the native build: the C version given in the avr-libc documentation
+ */
+
+#ifndef SIM_UTIL_CRC16_H_
+#define SIM_UTIL_CRC16_H_
+
+#include <stdint.h>
+
+static inline uint16_t _crc16_update(uint16_t crc, uint8_t a) {
+	crc ^= a;
+	for (int i = 0; i < 8; ++i) {
+		if (crc & 1) {
+			crc = (crc >> 1) ^ 0xA001;
+		} else {
+			crc = crc >> 1;
+		}
+	}
+	return crc;
+}
+
+#endif /* SIM_UTIL_CRC16_H_ */
@@ -5,51 +5,146 @@
  * @date 4/13/2016 
  *  
  */ 
+#include <avr/pgmspace.h>
 #include "lib/open_interface.h"
+#include "lib/util.h"
 #include "sound.h"
 
-static uint8_t StarwarsNumNotes = 19;
-static uint8_t StarwarsNotes[19] = {55, 55, 55, 51, 58, 55, 51, 58, 55, 0,  62, 62, 62, 63, 58, 54, 51, 58, 55};
-static uint8_t StarwarsDurations[19] = {32, 32, 32, 20, 12, 32, 20, 12, 32, 32, 32, 32, 32, 20, 12, 32, 20, 12, 32};
+static const uint8_t StarwarsNotes[19] PROGMEM = {55, 55, 55, 51, 58, 55, 51, 58, 55, 0,  62, 62, 62, 63, 58, 54, 51, 58, 55};
+static const uint8_t StarwarsDurations[19] PROGMEM = {32, 32, 32, 20, 12, 32, 20, 12, 32, 32, 32, 32, 32, 20, 12, 32, 20, 12, 32};
 
-static uint8_t marioNumNotes = 49;
-static uint8_t marioNotes[49] =
+static const uint8_t marioNotes[49] PROGMEM =
 	{48, 60, 45, 57, 46, 58,  0, 48, 60, 45, 57, 46, 58,  0, 41, 53, 38, 50,
 	 39, 51,  0, 41, 53, 38, 50, 39, 51,  0, 51, 50, 49, 48, 51, 50, 44, 43,
 	 49, 48, 54, 53, 52, 58, 57, 56, 51, 47, 46, 45, 44 };
-static uint8_t marioDuration[49] =
+static const uint8_t marioDuration[49] PROGMEM =
 	{12, 12, 12, 12, 12, 12, 62, 12, 12, 12, 12, 12, 12, 62, 12, 12, 12, 12,
 	 12, 12, 62, 12, 12, 12, 12, 12, 12, 48,  8,  8,  8, 24, 24, 24, 24, 24,
 	 24,  8,  8,  8,  8,  8,  8, 16, 16, 16, 16, 16, 16 };
 	 
-static uint8_t rickrollNumNotes = 11;
-static uint8_t rickrollNotes[11] = {53, 55, 48, 55, 57, 60, 58, 57, 53, 55, 48};
-static uint8_t rickrollDurations[11] = {48, 64, 16, 48, 48, 8,  8,  8,  48, 64, 64};
+static const uint8_t rickrollNotes[11] PROGMEM = {53, 55, 48, 55, 57, 60, 58, 57, 53, 55, 48};
+static const uint8_t rickrollDurations[11] PROGMEM = {48, 64, 16, 48, 48, 8,  8,  8,  48, 64, 64};
 
 
+// The Create holds 16 songs of at most 16 notes each
+#define OI_SONG_SLOTS 16
+#define OI_SONG_MAX_NOTES 16
+
+/*
+* Where each tune lives on the Create.  Tunes longer than OI_SONG_MAX_NOTES are split over consecutive slots and played one segment after another.
+*/
+typedef struct {
+	const uint8_t* notes;		// in program memory
+	const uint8_t* durations;	// in program memory
+	uint8_t num_notes;
+	uint8_t first_slot;
+} song_t;
+
+static song_t registry[] = {
+	[MARIO] = {marioNotes, marioDuration, sizeof(marioNotes), 0},
+	[DARTHVADER] = {StarwarsNotes, StarwarsDurations, sizeof(StarwarsNotes), 0},
+	[RICKROLLED] = {rickrollNotes, rickrollDurations, sizeof(rickrollNotes), 0}
+};
+#define SONG_COUNT (sizeof(registry) / sizeof(registry[0]))
+
+static char loaded = 0;
+
+// Where songs_load_step() is in the upload
+static uint8_t load_id = 1;
+static uint8_t load_note = 0;
+static uint8_t load_slot = 0;
+
+// The segment being played, and when it ends
+static uint8_t playing = 0;
+static uint8_t segment;
+static uint32_t segment_end;
+
+static void play_segment(void);
+
+/*
+* Uploads every tune into the Create's song slots.  This pushes all the notes over the 28.8k link once, so later plays only send two bytes.
+*/
+void songs_load(void)
+{
+	load_id = 1;
+	load_note = 0;
+	load_slot = 0;
+	while (songs_load_step())
+		;
+}
+
 /*
-* This method loads the song onto the rover and then plays it according to the song id assigned to it.
-* @param id The song id to load the song associated with it.
+* Uploads the next song slot (~12 ms on the 28.8k link), so the upload can be spread between other work.  The boot sequencer calls this until it
+* returns 0; the first play finishes the upload if it is not done yet.
+* @return 1 while there are slots left to upload
+*/
+char songs_load_step(void)
+{
+	if (load_id >= SONG_COUNT) {
+		loaded = 1;
+		return 0;
+	}
+	song_t* song = &registry[load_id];
+	if (load_note == 0) {
+		song->first_slot = load_slot;
+	}
+	if (load_note < song->num_notes && load_slot < OI_SONG_SLOTS) {
+		uint8_t count = song->num_notes - load_note < OI_SONG_MAX_NOTES ? song->num_notes - load_note : OI_SONG_MAX_NOTES;
+		oi_load_song_P(load_slot, count, song->notes + load_note, song->durations + load_note);
+		load_note += OI_SONG_MAX_NOTES;
+		load_slot++;
+	}
+	if (load_note >= song->num_notes || load_slot >= OI_SONG_SLOTS) {
+		load_id++;
+		load_note = 0;
+	}
+	return 1;
+}
+
+/*
+* Starts playing a tune from its preloaded slots.  Returns right away; sound_poll() plays the remaining segments of long tunes.
+* @param id The song id to play.
 */
 void songs(uint8_t id)
 {
-		// This will load the song associated with the id.
-		switch (id) 
-		{
-		case MARIO: //This will play the Mario song.
-			oi_load_song(MARIO, marioNumNotes, marioNotes, marioDuration);
-			oi_play_song(MARIO);
-			break;
-		case DARTHVADER: //This will play the Star wars song.
-			oi_load_song(DARTHVADER, StarwarsNumNotes,StarwarsNotes, StarwarsDurations);
-			oi_play_song(DARTHVADER);
-			break;
-		case RICKROLLED: //This will play the Rick Roll song.
-			oi_load_song(RICKROLLED, rickrollNumNotes, rickrollNotes, rickrollDurations);
-			oi_play_song(RICKROLLED);
-			break;
-		
-		default: //This will be executed if no proper id is provided.
-				break;
+	if (id == 0 || id >= SONG_COUNT) {
+		//This will be executed if no proper id is provided.
+		return;
+	}
+	while (!loaded) {
+		songs_load_step();
+	}
+	playing = id;
+	segment = 0;
+	play_segment();
+}
+
+/*
+* Plays the next segment of a long tune once the current one has finished.  Call from any loop that runs between OI transactions.
+*/
+void sound_poll(void)
+{
+	if (playing && deadline_passed(segment_end)) {
+		segment++;
+		if (segment * OI_SONG_MAX_NOTES < registry[playing].num_notes) {
+			play_segment();
+		} else {
+			playing = 0;
 		}
-}
\ No newline at end of file
+	}
+}
+
+/*
+* Sends the play command for the current segment and works out when it ends.  Durations are in 1/64 s.
+*/
+static void play_segment(void)
+{
+	song_t* song = &registry[playing];
+	uint8_t first = segment * OI_SONG_MAX_NOTES;
+	uint16_t length = 0;
+	for (uint8_t n = first; n < song->num_notes && n < first + OI_SONG_MAX_NOTES; n++) {
+		length += pgm_read_byte(song->durations + n);
+	}
+	oi_play_song(song->first_slot + segment);
+	segment_end = deadline_in(length * 125UL / 8);
+}
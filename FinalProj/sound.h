@@ -18,11 +18,23 @@
 //Defined the variable star wars with the int id 3
 #define RICKROLLED 3
 /*
-* This method loads the song onto the rover and then plays it according to the song id assigned to it.
+* This method uploads all the songs into the rover's song slots.
+*/
+void songs_load(void);
+/*
+* Uploads one song slot.  Returns 1 while there are slots left.
+*/
+char songs_load_step(void);
+/*
+* This method plays the preloaded song assigned to the song id.  It does not wait for the song to finish.
 * @author Vaibhav Malhotra
-* @param id The song id to load the song associated with it.
+* @param id The song id of the song to play.
 * @date 4/17/2016
 */
 void songs(uint8_t);
+/*
+* This method keeps long songs playing; call it regularly between OI transactions.
+*/
+void sound_poll(void);
 
 #endif /* _SONGS_H */
\ No newline at end of file
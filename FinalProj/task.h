@@ -0,0 +1,25 @@
+#ifndef TASK_H_
+#define TASK_H_
+
+/**
+ * Protothread-style cooperative tasks.  A task is a function that is called over and over from a main loop.  TASK_YIELD returns to the caller and the
+ * next call resumes right after the yield, so several long operations can make progress in the same loop.
+ * Local variables do not survive a yield; keep task state in a struct.  A task body must not contain its own switch statement.
+ */
+typedef unsigned int task_t;
+
+#define TASK_DONE 0
+#define TASK_RUNNING 1
+
+/// Rewinds a task so the next call starts from the beginning
+#define TASK_INIT(t) (*(t) = 0)
+/// Starts the body of a task function
+#define TASK_BEGIN(t) switch (*(t)) { case 0:
+/// Returns TASK_RUNNING; the next call resumes after the yield
+#define TASK_YIELD(t) do { *(t) = __LINE__; return TASK_RUNNING; case __LINE__:; } while (0)
+/// Yields until the condition is true
+#define TASK_WAIT_UNTIL(t, cond) do { *(t) = __LINE__; case __LINE__: if (!(cond)) return TASK_RUNNING; } while (0)
+/// Ends the body of a task function and returns TASK_DONE
+#define TASK_END(t) } *(t) = 0; return TASK_DONE
+
+#endif /* TASK_H_ */
@@ -0,0 +1,116 @@
+#include "telemetry.h"
+#include "bluetooth.h"
+#include "lib/util.h"
+#include "lib/prof.h"
+#include "pose.h"
+
+// Fastest push rate allowed.  A frame is ~50 characters, which takes ~9 ms at 57.6k baud.
+#define TELEMETRY_MIN_PERIOD 20
+
+// Longest possible frame, with every field at its widest
+#define TELEMETRY_FRAME_MAX 64
+
+// Bits of the flags field in a telemetry frame
+#define TELEMETRY_BUMP_L     0x01
+#define TELEMETRY_BUMP_R     0x02
+#define TELEMETRY_CLIFF_L    0x04
+#define TELEMETRY_CLIFF_FL   0x08
+#define TELEMETRY_CLIFF_FR   0x10
+#define TELEMETRY_CLIFF_R    0x20
+#define TELEMETRY_WHEELDROP  0x40
+
+static soft_timer_t frame_timer;
+static volatile char frame_due = 0;
+
+static void frame_tick(void);
+
+// Cached copy of the last OI update so a frame never triggers I/O with the Create
+static uint8_t flags = 0;
+static uint16_t cliff_signal[4];
+static int32_t odometer = 0;	// mm driven, backwards is negative
+static int ir_angle = 90;
+static int ir_dist = 0;
+
+static unsigned int seq = 0;
+
+/// Starts pushing telemetry frames at a fixed rate
+/**
+ * Starts a software timer that marks a frame as due every period_ms milliseconds.  Frames are only built and sent from telemetry_poll().
+ * @param period_ms the time between frames in ms, clamped to TELEMETRY_MIN_PERIOD
+ */
+void telemetry_start(unsigned int period_ms) {
+	if (period_ms < TELEMETRY_MIN_PERIOD) {
+		period_ms = TELEMETRY_MIN_PERIOD;
+	}
+	frame_due = 0;
+	timer_start(&frame_timer, period_ms, period_ms, frame_tick);
+}
+
+/// Stops pushing telemetry frames
+void telemetry_stop(void) {
+	timer_stop(&frame_timer);
+	frame_due = 0;
+}
+
+/// Caches the sensor values of the latest OI update
+/**
+ * Must be called after every oi_update() so the odometer in the frames does not miss any distance; the heading comes from pose_update().
+ * Sends a frame if one is due.
+ * @param sensor_data the freshly updated sensor data
+ */
+void telemetry_update(oi_t* sensor_data) {
+	uint8_t f = 0;
+	if (sensor_data->bumper_left) f |= TELEMETRY_BUMP_L;
+	if (sensor_data->bumper_right) f |= TELEMETRY_BUMP_R;
+	if (sensor_data->cliff_left) f |= TELEMETRY_CLIFF_L;
+	if (sensor_data->cliff_frontleft) f |= TELEMETRY_CLIFF_FL;
+	if (sensor_data->cliff_frontright) f |= TELEMETRY_CLIFF_FR;
+	if (sensor_data->cliff_right) f |= TELEMETRY_CLIFF_R;
+	if (sensor_data->wheeldrop_left || sensor_data->wheeldrop_right || sensor_data->wheeldrop_caster) f |= TELEMETRY_WHEELDROP;
+	flags = f;
+	cliff_signal[0] = sensor_data->cliff_left_signal;
+	cliff_signal[1] = sensor_data->cliff_frontleft_signal;
+	cliff_signal[2] = sensor_data->cliff_frontright_signal;
+	cliff_signal[3] = sensor_data->cliff_right_signal;
+
+	odometer += sensor_data->distance;
+	telemetry_poll();
+}
+
+/// Caches the latest IR reading
+/**
+ * Records where the servo is pointing and what the IR sensor saw there, then sends a frame if one is due.
+ * @param angle the servo angle of the reading in degrees
+ * @param dist the IR distance in cm
+ */
+void telemetry_ir_sample(int angle, int dist) {
+	ir_angle = angle;
+	ir_dist = dist;
+	telemetry_poll();
+}
+
+/// Sends a telemetry frame if one is due
+/**
+ * Cheap enough to call from any loop.  The frame is built only from cached values and formatted straight into the UART output ring.  If the ring
+ * does not have room for the longest possible frame, the frame is dropped rather than waiting for the link; the sequence number still advances so
+ * the receiver can count the gaps.
+ */
+void telemetry_poll(void) {
+	if (!frame_due) {
+		return;
+	}
+	frame_due = 0;
+	if (out_buffer_free() < TELEMETRY_FRAME_MAX) {
+		seq++;
+		return;
+	}
+	PROF_BEGIN(PROF_FORMAT);
+	send_fmt("t,%u,%u,%u,%u,%u,%u,%ld,%d,%d,%d.", seq++, flags, cliff_signal[0], cliff_signal[1], cliff_signal[2], cliff_signal[3],
+		(long) odometer, pose_get()->heading, ir_angle, ir_dist);
+	PROF_END(PROF_FORMAT);
+}
+
+/// Telemetry pacing timer callback
+static void frame_tick(void) {
+	frame_due = 1;
+}
@@ -0,0 +1,12 @@
+#ifndef TELEMETRY_H_
+#define TELEMETRY_H_
+
+#include "lib/open_interface.h"
+
+void telemetry_start(unsigned int period_ms);
+void telemetry_stop(void);
+void telemetry_update(oi_t* sensor_data);
+void telemetry_ir_sample(int angle, int dist);
+void telemetry_poll(void);
+
+#endif /* TELEMETRY_H_ */
@@ -0,0 +1,33 @@
+#include "trace.h"
+#include "bluetooth.h"
+#include "ui.h"
+
+trace_rec_t trace_ring[TRACE_SIZE];
+uint8_t trace_head = 0;
+uint8_t trace_count = 0;
+
+/// Sends the trace ring over UART, oldest event first
+/**
+ * Sends one line per event.  If in_program_ui is set, the output is in a machine readable format and ends with an empty "d." line.  The ring is
+ * left as it is; use trace_clear() to start over.
+ */
+void trace_dump(void) {
+	uint8_t i = (trace_head - trace_count) & TRACE_MASK;
+	for (uint8_t n = 0; n < trace_count; n++) {
+		trace_rec_t* rec = &trace_ring[i];
+		if (in_program_ui) {
+			send_fmt("d,%lu,%u,%u,%d.", (unsigned long) rec->time, rec->event, rec->a, rec->b);
+		} else {
+			send_fmt("%8lu ms  event %2u  %3u %6d\r\n", (unsigned long) rec->time, rec->event, rec->a, rec->b);
+		}
+		i = (i + 1) & TRACE_MASK;
+	}
+	if (in_program_ui) {
+		send_msg_P(PSTR("d."));
+	}
+}
+
+/// Empties the trace ring
+void trace_clear(void) {
+	trace_count = 0;
+}
@@ -0,0 +1,82 @@
+#ifndef TRACE_H_
+#define TRACE_H_
+
+#include <stdint.h>
+#include <avr/interrupt.h>
+#include "lib/util.h"
+
+// Must be a power of two
+#define TRACE_SIZE 64
+#define TRACE_MASK (TRACE_SIZE - 1)
+
+/**
+ * Trace events.  The meaning of the two arguments depends on the event.
+ */
+typedef enum {
+	TRACE_SCAN_START = 1,	// -
+	TRACE_SCAN_END,			// a = objects found, b = objects that did not fit in the table
+	TRACE_OBJECT,			// a = angular location, b = median distance
+	TRACE_MOVE_START,		// b = requested mm
+	TRACE_MOVE_STOP,		// a = stop_reason, b = mm moved
+	TRACE_ROTATE_START,		// b = requested degrees
+	TRACE_ROTATE_STOP,		// b = degrees turned
+	TRACE_GOAL,				// a = angle to the goal, b = distance
+	TRACE_PATH_BLOCKED,		// a = object index, b = avoidance angle
+	TRACE_STOP,				// b = stop latency in ms
+	TRACE_ANOMALY,			// a = trace_anomaly, b = value
+	TRACE_RADAR_HIT,		// a = servo angle, b = mm ahead
+	TRACE_EXPLORE,			// a = unknown cells expected (at most 255), b = turn in degrees
+	TRACE_PLAN,				// a = waypoints, b = angle to the goal
+	TRACE_GOAL_NEW,			// a = hypothesis slot, b = score
+	TRACE_LEG				// a = average speed in cm/s, b = ms saved by the speed governor
+} trace_event;
+
+/**
+ * Sensor anomalies logged with TRACE_ANOMALY.
+ */
+typedef enum {
+	ANOMALY_IR_RANGE = 1,	// IR conversion outside 0-200 cm
+	ANOMALY_WHEEL_DROP,		// a wheel dropped while driving
+	ANOMALY_ODOMETRY		// OI distance or angle delta too large for one update
+} trace_anomaly;
+
+/**
+ * One trace record; 8 bytes.
+ */
+typedef struct {
+	uint32_t time;	// millis()
+	uint8_t event;
+	uint8_t a;
+	int16_t b;
+} trace_rec_t;
+
+extern trace_rec_t trace_ring[TRACE_SIZE];
+extern uint8_t trace_head;
+extern uint8_t trace_count;
+
+/// Appends an event to the trace ring, overwriting the oldest event when full
+/**
+ * Safe to call from an ISR.
+ * @param event the trace_event
+ * @param a the small argument
+ * @param b the large argument
+ */
+static inline void trace(uint8_t event, uint8_t a, int16_t b) {
+	uint8_t sreg = SREG;
+	cli();
+	trace_rec_t* rec = &trace_ring[trace_head];
+	trace_head = (trace_head + 1) & TRACE_MASK;
+	if (trace_count < TRACE_SIZE) {
+		trace_count++;
+	}
+	SREG = sreg;
+	rec->time = millis();
+	rec->event = event;
+	rec->a = a;
+	rec->b = b;
+}
+
+void trace_dump(void);
+void trace_clear(void);
+
+#endif /* TRACE_H_ */
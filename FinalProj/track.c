@@ -0,0 +1,167 @@
+/**
+ * track.c: object tracker
+ *
+ * Follows the objects of successive scans in the pose frame, so an object keeps the same id while the robot drives around it.  Each detection
+ * is matched to the nearest tracked object within TRACK_GATE_MM of where odometry says it should be, and its position and width are smoothed.
+ * Each object remembers what changed since it was last reported, so the program UI only has to send the changes.
+ */
+
+#include <stdlib.h>
+#include "track.h"
+#include "pose.h"
+#include "lib/trig.h"
+
+static track_t tracks[MAX_TRACKS];
+static uint8_t next_id = 1;
+static uint8_t track_dropped;	// detections of the last update that found no slot
+
+static track_t* free_slot(void);
+static int32_t dist2(int32_t x1, int32_t y1, int32_t x2, int32_t y2);
+
+/// Matches the objects of a scan to the tracked objects
+/**
+ * Call once after every scan, from where the scan was taken.  Detections that match nothing become new objects, or are counted by
+ * track_overflow() if every slot is taken.  Tracked objects that should have been in view but were not matched count a miss, and are marked gone
+ * after TRACK_MAX_MISSES.
+ * @param objects the objects from the scan
+ * @param count the number of objects
+ */
+void track_update(obj_t* objects, int count)
+{
+	uint16_t matched = 0;	// bit per track
+
+	track_dropped = 0;
+	for (int i = 0; i < count; i++) {
+		int32_t x, y;
+		pose_project(obj_angle(&objects[i]), objects[i].dist, &x, &y);
+		track_t* best = NULL;
+		int32_t best_d2 = (int32_t) TRACK_GATE_MM * TRACK_GATE_MM;
+		for (uint8_t k = 0; k < MAX_TRACKS; k++) {
+			track_t* t = &tracks[k];
+			if (t->id && !(t->changes & TRACK_GONE) && !(matched & (1 << k))) {
+				int32_t d2 = dist2(x, y, t->x, t->y);
+				if (d2 < best_d2) {
+					best_d2 = d2;
+					best = t;
+				}
+			}
+		}
+		if (best != NULL) {
+			matched |= 1 << (best - tracks);
+			best->x += (x - best->x) / 2;
+			best->y += (y - best->y) / 2;
+			best->width = (best->width + obj_width(&objects[i]) + 1) / 2;
+			best->misses = 0;
+			if (dist2(best->x, best->y, best->rx, best->ry) > (int32_t) TRACK_MOVED_MM * TRACK_MOVED_MM) {
+				best->changes |= TRACK_MOVED;
+			}
+		} else if ((best = free_slot()) != NULL) {
+			matched |= 1 << (best - tracks);
+			best->id = next_id;
+			next_id = next_id == 255 ? 1 : next_id + 1;
+			best->changes = TRACK_NEW;
+			best->misses = 0;
+			best->width = obj_width(&objects[i]);
+			best->x = x;
+			best->y = y;
+			best->rx = x;
+			best->ry = y;
+		} else if (track_dropped < 255) {
+			track_dropped++;
+		}
+	}
+
+	for (uint8_t k = 0; k < MAX_TRACKS; k++) {
+		track_t* t = &tracks[k];
+		if (!t->id || (t->changes & TRACK_GONE) || (matched & (1 << k))) {
+			continue;
+		}
+		int32_t ahead, left;
+		pose_to_robot(t->x, t->y, &ahead, &left);
+		if (ahead >= 0 && ahead * ahead + left * left < (int32_t) TRACK_VIEW_MM * TRACK_VIEW_MM && ++t->misses >= TRACK_MAX_MISSES) {
+			t->changes |= TRACK_GONE;
+		}
+	}
+}
+
+/// The number of detections the last update had no slot for
+/**
+ * Those objects are not tracked.  Counts up to 255.
+ */
+uint8_t track_overflow(void)
+{
+	return track_dropped;
+}
+
+/// All the track slots
+/**
+ * @return MAX_TRACKS slots; free ones have an id of 0
+ */
+const track_t* track_list(void)
+{
+	return tracks;
+}
+
+/// Clears the changes after they have been reported
+/**
+ * Objects marked gone are dropped, and the others remember where they were reported.
+ */
+void track_reported(void)
+{
+	for (uint8_t k = 0; k < MAX_TRACKS; k++) {
+		track_t* t = &tracks[k];
+		if (t->changes & TRACK_GONE) {
+			t->id = 0;
+		}
+		t->changes = 0;
+		t->rx = t->x;
+		t->ry = t->y;
+	}
+}
+
+/// Where a tracked object is from the robot now
+/**
+ * @param t a tracked object
+ * @param angle (return) its direction in servo degrees (90 is straight ahead), -89 to 270
+ * @param dist (return) its distance in cm
+ */
+void track_locate(const track_t* t, int* angle, int* dist)
+{
+	int32_t ahead, left;
+	pose_to_robot(t->x, t->y, &ahead, &left);
+	*angle = 90 + atan2_deg(left, ahead);
+	*dist = isqrt32(ahead * ahead + left * left) / 10;
+}
+
+/// Forgets all tracked objects
+void track_clear(void)
+{
+	for (uint8_t k = 0; k < MAX_TRACKS; k++) {
+		tracks[k].id = 0;
+	}
+}
+
+/// A slot for a new object
+/**
+ * An object that is gone keeps its slot until track_reported() so the program UI hears that it went, unless it was never reported at all.
+ * @return a free slot, or failing that one whose object came and went since the last report, or NULL if all are in use
+ */
+static track_t* free_slot(void)
+{
+	track_t* unreported = NULL;
+	for (uint8_t k = 0; k < MAX_TRACKS; k++) {
+		if (!tracks[k].id) {
+			return &tracks[k];
+		}
+		if ((tracks[k].changes & (TRACK_NEW | TRACK_GONE)) == (TRACK_NEW | TRACK_GONE)) {
+			unreported = &tracks[k];
+		}
+	}
+	return unreported;
+}
+
+/// Squared distance between two points
+static int32_t dist2(int32_t x1, int32_t y1, int32_t x2, int32_t y2)
+{
+	return (x2 - x1) * (x2 - x1) + (y2 - y1) * (y2 - y1);
+}
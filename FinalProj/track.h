@@ -0,0 +1,42 @@
+#ifndef TRACK_H_
+#define TRACK_H_
+
+#include <stdint.h>
+#include "scan.h"
+
+// Most objects tracked at once
+#define MAX_TRACKS 12
+// A detection this close (mm) to where a tracked object should be is taken as the same object
+#define TRACK_GATE_MM 150
+// How far (mm) an object has to move from where it was last reported to be reported again
+#define TRACK_MOVED_MM 50
+// An object that should have been seen but was not this many scans in a row is dropped
+#define TRACK_MAX_MISSES 2
+// Objects closer than this (mm) and ahead of the sensor should show up in a scan (scan.c finds objects up to 60 cm)
+#define TRACK_VIEW_MM 550
+
+// Changes to a tracked object since it was last reported
+#define TRACK_NEW   0x01
+#define TRACK_MOVED 0x02
+#define TRACK_GONE  0x04
+
+/**
+ * An object followed across scans, in the pose frame.
+ */
+typedef struct {
+	uint8_t id;			// 0 is a free slot
+	uint8_t changes;	// TRACK_ bits
+	uint8_t misses;
+	uint8_t width;		// cm, smoothed
+	int16_t x, y;		// mm, smoothed
+	int16_t rx, ry;		// where it was last reported
+} track_t;
+
+void track_update(obj_t* objects, int count);
+const track_t* track_list(void);
+uint8_t track_overflow(void);
+void track_reported(void);
+void track_locate(const track_t* t, int* angle, int* dist);
+void track_clear(void);
+
+#endif /* TRACK_H_ */
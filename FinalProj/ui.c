@@ -5,11 +5,35 @@
 #include "movement.h"
 #include "scan.h"
 #include "lib/util.h"
-#include <stdio.h>
+#include "telemetry.h"
+#include "lib/prof.h"
+#include "sound.h"
+#include "memory.h"
+#include "trace.h"
+#include "boot.h"
+#include "calib.h"
+#include "safety.h"
+#include "pose.h"
+#include "grid.h"
+#include "plan.h"
+#include "goal.h"
+#include "track.h"
 #include <stdlib.h>
+#include <avr/pgmspace.h>
 
 char in_program_ui = 0;
 
+static const char main_menu_text[] PROGMEM =
+	"\r\n"
+	"a) autonomous\r\n"
+	"b) begin the test\r\n"
+	"e) reached the retrieval zone\r\n"
+	"r) retrieval zone has been identified\r\n"
+	"m) move the robot\r\n"
+	"i) move the robot ignoring sensors\r\n"
+	"s) scan the area\r\n"
+	"Your choice: ";
+
 /// Displays the main menu to the user over UART and waits for the choice
 /**
  * Sends the main menu over UART and waits for the user to make a selection from the menu.  Invalid input results in repeating the menu and prompt.
@@ -19,17 +43,13 @@ menu_option main_menu()
 {
 	char user_input[2];
 	while (1) {
-		send_msg("\r\n");
-		send_msg("a) autonomous\r\n");
-		send_msg("b) begin the test\r\n");
-		send_msg("e) reached the retrieval zone\r\n");
-		send_msg("r) retrieval zone has been identified\r\n");
-		send_msg("m) move the robot\r\n");
-		send_msg("i) move the robot ignoring sensors\r\n");
-		send_msg("s) scan the area\r\n");
-		send_msg("Your choice: ");
+		send_msg_P(main_menu_text);
+		while (!line_ready()) {
+			boot_poll();
+			sound_poll();
+		}
 		read_line(user_input, 2);
-		send_msg("\r\n\r\n");
+		send_msg_P(PSTR("\r\n\r\n"));
 	
 		switch (user_input[0])
 		{
@@ -65,23 +85,56 @@ menu_option main_menu()
 void show_objects()
 {
 	int obj_count;
-	char msg[100];
-	obj_t* objs;
 	
-	objs = do_scan(&obj_count);
+	do_scan(&obj_count);
+	report_objects(0);
+}
+
+/// Sends the tracked objects over UART
+/**
+ * Sends the id, distance, angular location from where the robot is now, and width of each tracked object, then marks the changes as reported.
+ * If in_program_ui is set, the output is in a machine readable format, and unless full is set only the objects that are new, have moved, or
+ * are gone since the last report are sent, followed by an empty c line.
+ * @param full 1 to send every object in program UI mode
+ */
+void report_objects(char full)
+{
+	const track_t* tracks = track_list();
+	int angle, dist;
+
 	if (!in_program_ui) {
-		sprintf(msg, "Objects found: %d\r\n", obj_count);
-		send_msg(msg);
+		send_msg_P(PSTR("Objects:\r\n"));
 	}
-	
-	for (int i = 0; i < obj_count; i++) {
+	for (uint8_t k = 0; k < MAX_TRACKS; k++) {
+		const track_t* t = &tracks[k];
+		// Skip free slots, and objects that came and went between two reports
+		if (!t->id || (t->changes & (TRACK_NEW | TRACK_GONE)) == (TRACK_NEW | TRACK_GONE)) {
+			continue;
+		}
+		char state = t->changes & TRACK_GONE ? 'g' : t->changes & TRACK_NEW ? 'n' : t->changes & TRACK_MOVED ? 'm' : 's';
+		if (in_program_ui && state == 's' && !full) {
+			continue;
+		}
+		track_locate(t, &angle, &dist);
+		PROF_BEGIN(PROF_FORMAT);
 		if (in_program_ui) {
-			sprintf(msg, "c,%d,%d,%d.", objs[i].dist, objs[i].angular_location, objs[i].width);
+			send_fmt("c,%u,%c,%d,%d,%u.", t->id, state, dist, angle, t->width);
 		} else {
-			sprintf(msg, "%d: angular location: %3d    distance: %3d    width: %3d    angular width: %3d\r\n", i + 1, objs[i].angular_location, objs[i].dist, objs[i].width, objs[i].angular_width);
+			send_fmt("%3u: angular location: %3d    distance: %3d    width: %3u    %c\r\n", t->id, angle, dist, t->width, state);
+		}
+		PROF_END(PROF_FORMAT);
+	}
+	if (in_program_ui) {
+		send_msg_P(PSTR("c."));
+	} else {
+		if (scan_overflow()) {
+			send_fmt("%u more objects did not fit in the table\r\n", scan_overflow());
+		}
+		if (track_overflow()) {
+			send_fmt("%u more objects could not be tracked\r\n", track_overflow());
 		}
-		send_msg(msg);
 	}
+	track_reported();
 }
 
 /// Reads all the relevant sensors and sends them over UART
@@ -92,8 +145,8 @@ void show_objects()
  */
 void show_sensors(oi_t* sensor_data)
 {
-	char msg[80];
 	oi_update(sensor_data);
+	telemetry_update(sensor_data);
 
 	// Distance
 	set_servo_pos(90);
@@ -104,24 +157,19 @@ void show_sensors(oi_t* sensor_data)
 	dist = dist_at_angle(90);
 	
 	if (in_program_ui) {
-		sprintf(msg, "e,%d,%d,%d,%d,%d,%d,%d,%d,%d,%d,%d.", sensor_data->bumper_left, sensor_data->bumper_right, sensor_data->cliff_left, sensor_data->cliff_frontleft, sensor_data->cliff_frontright,
+		send_fmt("e,%d,%d,%d,%d,%d,%d,%d,%d,%d,%d,%d.", sensor_data->bumper_left, sensor_data->bumper_right, sensor_data->cliff_left, sensor_data->cliff_frontleft, sensor_data->cliff_frontright,
 			sensor_data->cliff_right, sensor_data->cliff_left_signal, sensor_data->cliff_frontleft_signal, sensor_data->cliff_frontright_signal, sensor_data->cliff_right_signal, dist);
-		send_msg(msg);
 	} else {
-		sprintf(msg, "IR distance: %3d val %3d\r\n", dist, val);
-		send_msg(msg);
+		send_fmt("IR distance: %3d val %3d\r\n", dist, val);
 		// Cliff
-		send_msg("Cliff Sensors\r\n");
-		sprintf(msg, "  Left: %4d\tF-Left: %4d\tF-Right: %4d\tRight: %4d\r\n", sensor_data->cliff_left, sensor_data->cliff_frontleft, sensor_data->cliff_frontright, sensor_data->cliff_right);
-		send_msg(msg);
+		send_msg_P(PSTR("Cliff Sensors\r\n"));
+		send_fmt("  Left: %4d\tF-Left: %4d\tF-Right: %4d\tRight: %4d\r\n", sensor_data->cliff_left, sensor_data->cliff_frontleft, sensor_data->cliff_frontright, sensor_data->cliff_right);
 		// Cliff brightness
-		send_msg("Cliff Sensor Signals\r\n");
-		sprintf(msg, "  Left: %4d\tF-Left: %4d\tF-Right: %4d\tRight: %4d\r\n", sensor_data->cliff_left_signal, sensor_data->cliff_frontleft_signal, sensor_data->cliff_frontright_signal, sensor_data->cliff_right_signal);
-		send_msg(msg);
+		send_msg_P(PSTR("Cliff Sensor Signals\r\n"));
+		send_fmt("  Left: %4d\tF-Left: %4d\tF-Right: %4d\tRight: %4d\r\n", sensor_data->cliff_left_signal, sensor_data->cliff_frontleft_signal, sensor_data->cliff_frontright_signal, sensor_data->cliff_right_signal);
 		// Bump
-		send_msg("Bump:\r\n");
-		sprintf(msg, "  Left: %d\tRight: %d\r\n", sensor_data->bumper_left, sensor_data->bumper_right);
-		send_msg(msg);
+		send_msg_P(PSTR("Bump:\r\n"));
+		send_fmt("  Left: %d\tRight: %d\r\n", sensor_data->bumper_left, sensor_data->bumper_right);
 	}
 }
 
@@ -134,28 +182,239 @@ void show_sensors(oi_t* sensor_data)
 void move_menu(oi_t* sensor_data, char ignore_sensors)
 {
 	stop_reason s_reason;
-	send_msg("r [-]#) rotate\r\n");
-	send_msg("m [-]#) move\r\n");
+	send_msg_P(PSTR("r [-]#) rotate\r\n"));
+	send_msg_P(PSTR("m [-]#) move\r\n"));
 	char user_input[8];
 	int val;
-	char msg[80];
 	read_line(user_input, sizeof(user_input));
-	send_msg("\r\n");
+	send_msg_P(PSTR("\r\n"));
 	switch (user_input[0])
 	{
 	case 'r':
 		val = atoi(user_input + 2);
 		val = rotate_deg(val, sensor_data);
-		sprintf(msg, "Degrees rotated: %d\r\n", val);
-		send_msg(msg);
+		send_fmt("Degrees rotated: %d\r\n", val);
 		break;
 	case 'm':
 		val = atoi(user_input + 2);
 		val = move_result(val, sensor_data, ignore_sensors, ignore_sensors, &s_reason);
-		sprintf(msg, "Moved %d\r\nStop reason: %s\r\n", val, stop_reason_descrip[s_reason]);
-		send_msg(msg);
+		send_fmt("Moved %d\r\nStop reason: %S\r\n", val, stop_reason_descrip[s_reason]);
 		break;
 	default:
-		send_msg("Invalid input\r\n");
+		send_msg_P(PSTR("Invalid input\r\n"));
+	}
+}
+
+#if PROFILE
+/// Sends the profiler statistics over UART
+/**
+ * Sends one line per profiled region with the count, min, max, and total cycles and the log2 histogram.  If in_program_ui is set, the output is in a
+ * machine readable format.
+ */
+void show_profile(void)
+{
+	if (!in_program_ui) {
+		send_msg_P(PSTR("region          count        min        max       total  histogram (<2^8, 2^10 ... 2^20, more)\r\n"));
+	}
+	for (int r = 0; r < PROF_REGION_COUNT; r++) {
+		const prof_stats_t* s = prof_get(r);
+		if (in_program_ui) {
+			send_fmt("f,%S,%u,%lu,%lu,%lu", prof_name(r), s->count, (unsigned long) s->min, (unsigned long) s->max, (unsigned long) s->total);
+		} else {
+			send_fmt("%-14S %6u %10lu %10lu %11lu ", prof_name(r), s->count, (unsigned long) s->min, (unsigned long) s->max, (unsigned long) s->total);
+		}
+		for (int b = 0; b < PROF_HIST_BUCKETS; b++) {
+			send_fmt("%c%u", in_program_ui ? ',' : ' ', s->hist[b]);
+		}
+		send_msg_P(in_program_ui ? PSTR(".") : PSTR("\r\n"));
+	}
+}
+#endif
+
+/// Sends the SRAM usage over UART
+/**
+ * Sends the size of .data and .bss, the free SRAM right now, the peak stack use and the SRAM never touched since reset (see memory.c), followed
+ * by the size of each large static buffer.  If in_program_ui is set, the output is in a machine readable format.
+ */
+void show_memory(void)
+{
+	static const char names[][12] PROGMEM = {"tx_ring", "rx_line", "trace", "objects", "sensor_data", "grid", "plan", "tracks"};
+	const uint16_t sizes[] = {OUT_BUFFER_SIZE, IN_BUFFER_SIZE, sizeof(trace_ring), MAX_OBJECTS * sizeof(obj_t) + SCAN_MEDIAN_SAMPLES, sizeof(oi_t), GRID_BYTES, PLAN_SIZE * PLAN_SIZE, sizeof(track_t) * MAX_TRACKS};
+
+	if (in_program_ui) {
+		send_fmt("u,%u,%u,%u,%u,%u,%d.", data_size(), bss_size(), sram_free(), stack_peak(), sram_unused(), out_buffer_peak());
+	} else {
+		send_fmt(".data: %u  .bss: %u  free: %u  stack peak: %u  never used: %u  tx ring peak: %d\r\n", data_size(), bss_size(), sram_free(),
+			stack_peak(), sram_unused(), out_buffer_peak());
+	}
+	for (uint8_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+		if (in_program_ui) {
+			send_fmt("u,%S,%u.", names[i], sizes[i]);
+		} else {
+			send_fmt("  %-12S %5u\r\n", names[i], sizes[i]);
+		}
+	}
+}
+
+/// Sends the boot timing over UART
+/**
+ * Sends the time from reset until all the hardware was up, then when each boot step started and ended, in ms since reset.  The steps overlap.
+ * If in_program_ui is set, the output is in a machine readable format.
+ */
+void show_boot(void)
+{
+	if (in_program_ui) {
+		send_fmt("n,%u.", boot_ready_ms());
+	} else {
+		send_fmt("Ready after %u ms\r\n", boot_ready_ms());
+	}
+	for (int i = 0; i < BOOT_STEP_COUNT; i++) {
+		const boot_time_t* t = boot_time(i);
+		if (in_program_ui) {
+			send_fmt("n,%S,%u,%u.", boot_step_name(i), t->start, t->end);
+		} else {
+			send_fmt("  %-6S %5u - %5u ms\r\n", boot_step_name(i), t->start, t->end);
+		}
+	}
+}
+
+/// Sends the calibration in use over UART
+/**
+ * Sends where the calibration came from (1 = EEPROM, 0 = defaults), the servo OCR at 0, 45, 90, 135 and 180 degrees with a bit mask of the
+ * measured ones, the cliff baselines, and the rotation overshoot.  The IR polynomial is not sent since the formatter has no floating point.
+ * If in_program_ui is set, the output is in a machine readable format.
+ */
+void show_calib(void)
+{
+	if (in_program_ui) {
+		send_fmt("k,%d,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%d,%d.", calib_from_eeprom(), calib.servo_ocr[0], calib.servo_ocr[1], calib.servo_ocr[2],
+			calib.servo_ocr[3], calib.servo_ocr[4], calib.servo_measured, calib.cliff_baseline[0], calib.cliff_baseline[1], calib.cliff_baseline[2],
+			calib.cliff_baseline[3], calib.rotate_overshoot_cw, calib.rotate_overshoot_ccw);
+	} else {
+		send_fmt("Calibration from %S\r\n  servo OCR: %u %u %u %u %u (measured %x)\r\n  cliff baselines: %u %u %u %u\r\n"
+			"  rotation overshoot: cw %d ccw %d\r\n", calib_from_eeprom() ? PSTR("EEPROM") : PSTR("defaults"), calib.servo_ocr[0], calib.servo_ocr[1],
+			calib.servo_ocr[2], calib.servo_ocr[3], calib.servo_ocr[4], calib.servo_measured, calib.cliff_baseline[0], calib.cliff_baseline[1],
+			calib.cliff_baseline[2], calib.cliff_baseline[3], calib.rotate_overshoot_cw, calib.rotate_overshoot_ccw);
+	}
+}
+
+/// Sends the safety reflex statistics over UART
+/**
+ * Sends how many bump and cliff polls were answered, skipped because the link was busy, and timed out, how many times the reflex stopped the
+ * wheels, and the last and worst time from the trip being sampled to the stop command being queued.  If in_program_ui is set, the output is in
+ * a machine readable format.
+ */
+void show_safety(void)
+{
+	const safety_stats_t* s = safety_stats();
+	if (in_program_ui) {
+		send_fmt("z,%u,%u,%u,%u,%lu,%lu.", s->polls, s->skipped, s->timeouts, s->trips, (unsigned long) s->last_us, (unsigned long) s->worst_us);
+	} else {
+		send_fmt("Polls: %u  skipped: %u  timeouts: %u\r\nTrips: %u  latency last: %lu us  worst: %lu us\r\n", s->polls, s->skipped, s->timeouts,
+			s->trips, (unsigned long) s->last_us, (unsigned long) s->worst_us);
+	}
+}
+
+/// Sends the speed governor statistics over UART
+/**
+ * Sends the number of governed legs, the distance and time they took, their average speed, and the time saved over driving them at
+ * MOVE_SAFE_SPEED.  If in_program_ui is set, the output is in a machine readable format.
+ */
+void show_speed(void)
+{
+	const speed_stats_t* s = speed_stats();
+	unsigned int average = s->ms ? s->mm * 1000 / s->ms : 0;
+	if (in_program_ui) {
+		send_fmt("v,%u,%lu,%lu,%u,%ld.", s->legs, (unsigned long) s->mm, (unsigned long) s->ms, average, (long) s->saved_ms);
+	} else {
+		send_fmt("Legs: %u  distance: %lu mm  time: %lu ms\r\nAverage speed: %u mm/s  time saved: %ld ms\r\n", s->legs, (unsigned long) s->mm,
+			(unsigned long) s->ms, average, (long) s->saved_ms);
+	}
+}
+
+/// Sends the dead reckoned pose over UART
+/**
+ * Sends the position in mm and the heading in degrees in the frame set at reset, see pose.h.  If in_program_ui is set, the output is in a
+ * machine readable format.
+ */
+void show_pose(void)
+{
+	const pose_t* p = pose_get();
+	if (in_program_ui) {
+		send_fmt("x,%ld,%ld,%d.", (long) p->x, (long) p->y, p->heading);
+	} else {
+		send_fmt("Position: %ld mm, %ld mm  heading: %d deg\r\n", (long) p->x, (long) p->y, p->heading);
+	}
+}
+
+/// Sends the occupancy grid over UART
+/**
+ * Sends the size of the map and the robot's cell, then each row run length encoded: a run is a cell character ('?' unknown, '.' free,
+ * '+' maybe occupied, '#' occupied) followed by its length if that is more than one.  Rows go from the lowest y up, cells from the lowest x.
+ * If in_program_ui is set, the output is in a machine readable format.
+ */
+void show_grid(void)
+{
+	static const char cell_chars[] PROGMEM = "?.+#";
+	uint8_t col = 0, row = 0;
+	const pose_t* p = pose_get();
+	grid_locate(p->x, p->y, &col, &row);
+	if (in_program_ui) {
+		send_fmt("g,%d,%d,%u,%u.", GRID_SIZE, GRID_CELL_MM, col, row);
+	} else {
+		send_fmt("Map %dx%d cells of %d mm, robot at %u,%u\r\n", GRID_SIZE, GRID_SIZE, GRID_CELL_MM, col, row);
+	}
+	for (uint8_t r = 0; r < GRID_SIZE; r++) {
+		if (in_program_ui) {
+			send_fmt("g,%u,", r);
+		}
+		uint8_t c = 0;
+		while (c < GRID_SIZE) {
+			uint8_t cell = grid_get(c, r);
+			uint8_t run = 1;
+			while (c + run < GRID_SIZE && grid_get(c + run, r) == cell) {
+				run++;
+			}
+			if (in_program_ui) {
+				send_char(pgm_read_byte(&cell_chars[cell]));
+				if (run > 1) {
+					send_fmt("%u", run);
+				}
+			} else {
+				// The human view is not compressed so the map can be read in a terminal
+				for (uint8_t i = 0; i < run; i++) {
+					send_char(pgm_read_byte(&cell_chars[cell]));
+				}
+			}
+			c += run;
+		}
+		send_msg_P(in_program_ui ? PSTR(".") : PSTR("\r\n"));
+	}
+}
+
+/// Sends the goal hypotheses over UART
+/**
+ * Sends each hypothesis that is in use: where its two posts are in the pose frame in mm, how many scans have seen it, its confidence (it is
+ * driven to from GOAL_CONFIDENT), and if it was driven through without finding the goal.  If in_program_ui is set, the output is in a
+ * machine readable format.
+ */
+void show_goals(void)
+{
+	const goal_t* goals = goal_hypotheses();
+	for (uint8_t k = 0; k < GOAL_HYPOTHESES; k++) {
+		const goal_t* g = &goals[k];
+		if (!g->confidence) {
+			continue;
+		}
+		if (in_program_ui) {
+			send_fmt("h,%u,%ld,%ld,%ld,%ld,%u,%u,%d.", k, (long) g->x1, (long) g->y1, (long) g->x2, (long) g->y2, g->sightings, g->confidence,
+				g->rejected);
+		} else {
+			send_fmt("%u: posts at %ld,%ld and %ld,%ld mm, seen %u times, confidence %u%S\r\n", k, (long) g->x1, (long) g->y1, (long) g->x2,
+				(long) g->y2, g->sightings, g->confidence, g->rejected ? PSTR(", rejected") : PSTR(""));
+		}
+	}
+	if (in_program_ui) {
+		send_msg_P(PSTR("h."));
 	}
 }
\ No newline at end of file
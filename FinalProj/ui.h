@@ -2,6 +2,7 @@
 #define HI_H_
 
 #include "lib/open_interface.h"
+#include "scan.h"
 
 extern char in_program_ui;
 
@@ -20,6 +21,16 @@ typedef enum
 menu_option main_menu(void);
 menu_option mymenu_option;
 void show_objects(void);
+void report_objects(char full);
+void show_profile(void);
+void show_memory(void);
+void show_boot(void);
+void show_calib(void);
+void show_safety(void);
+void show_speed(void);
+void show_pose(void);
+void show_grid(void);
+void show_goals(void);
 void show_sensors(oi_t* sensor_data);
 void move_menu(oi_t* sensor_data, char ignore_sensors);
 